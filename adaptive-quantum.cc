@@ -0,0 +1,218 @@
+/*
+ * Adaptive synchronization quantum.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "adaptive-quantum.h"
+
+/* Windows without events before the quantum grows.  */
+#define IDLE_WINDOWS	2
+/* Length of a control window in quanta.  */
+#define WINDOW_QUANTA	4
+
+adaptive_quantum::adaptive_quantum(sc_module_name name,
+			sc_time min, sc_time max,
+			unsigned int nr_irqs, unsigned int busy,
+			const char *log_path)
+	: sc_module(name),
+	  min(min),
+	  max(max),
+	  quantum(min),
+	  busy(busy),
+	  events(0),
+	  idle_windows(0),
+	  irq_last(nr_irqs, false),
+	  log(NULL),
+	  changes(0),
+	  weighted(0)
+{
+	unsigned int i;
+
+	if (min > max || min == SC_ZERO_TIME) {
+		SC_REPORT_ERROR("adaptive-quantum", "invalid quantum range");
+	}
+
+	if (log_path) {
+		log = fopen(log_path, "w");
+		if (!log) {
+			perror(log_path);
+		}
+	}
+
+	/* Start small, boot usually begins with a burst of MMIO.  */
+	tlm::tlm_global_quantum::instance().set(quantum);
+
+	if (nr_irqs) {
+		SC_METHOD(irq_changed);
+		dont_initialize();
+		for (i = 0; i < nr_irqs; i++) {
+			char txt[32];
+
+			snprintf(txt, sizeof txt, "irq_%d", i);
+			irq.push_back(new sc_in<bool>(txt));
+			sensitive << *irq[i];
+		}
+	}
+
+	SC_THREAD(control);
+}
+
+adaptive_quantum::~adaptive_quantum()
+{
+	if (log) {
+		fclose(log);
+	}
+}
+
+void adaptive_quantum::irq_changed(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < irq.size(); i++) {
+		bool v = irq[i]->read();
+
+		if (v != irq_last[i]) {
+			irq_last[i] = v;
+			events++;
+		}
+	}
+}
+
+void adaptive_quantum::set_quantum(sc_time q, unsigned int ev)
+{
+	if (q == quantum) {
+		return;
+	}
+
+	weighted += quantum.to_seconds() *
+			(sc_time_stamp() - last_change).to_seconds();
+	last_change = sc_time_stamp();
+	quantum = q;
+	changes++;
+
+	tlm::tlm_global_quantum::instance().set(quantum);
+	if (log) {
+		fprintf(log, "%" PRIu64 " %" PRIu64 " %u\n",
+			(uint64_t) (sc_time_stamp().to_seconds() * 1e9),
+			(uint64_t) (quantum.to_seconds() * 1e9), ev);
+	}
+}
+
+void adaptive_quantum::control(void)
+{
+	if (log) {
+		fprintf(log, "0 %" PRIu64 " 0\n",
+			(uint64_t) (quantum.to_seconds() * 1e9));
+	}
+
+	while (true) {
+		unsigned int ev;
+
+		wait(quantum * WINDOW_QUANTA);
+
+		ev = events;
+		events = 0;
+
+		if (ev >= busy) {
+			idle_windows = 0;
+			set_quantum(quantum / 2 < min ? min : quantum / 2, ev);
+		} else if (ev == 0) {
+			if (++idle_windows >= IDLE_WINDOWS) {
+				idle_windows = 0;
+				set_quantum(quantum * 2 > max ?
+						max : quantum * 2, ev);
+			}
+		} else {
+			idle_windows = 0;
+		}
+	}
+}
+
+void adaptive_quantum::end_of_simulation(void)
+{
+	double total = sc_time_stamp().to_seconds();
+	double mean;
+
+	weighted += quantum.to_seconds() *
+			(sc_time_stamp() - last_change).to_seconds();
+	mean = total > 0 ? weighted / total : quantum.to_seconds();
+
+	printf("%s: %u quantum changes, mean quantum %.0f ns, final %s\n",
+		name(), changes, mean * 1e9, quantum.to_string().c_str());
+	if (log) {
+		fflush(log);
+	}
+}
+
+tlm_activity_probe::tlm_activity_probe(sc_module_name name,
+					adaptive_quantum *aq)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  init_socket("init-socket"),
+	  aq(aq)
+{
+	tgt_socket.register_b_transport(this, &tlm_activity_probe::b_transport);
+	tgt_socket.register_transport_dbg(this,
+				&tlm_activity_probe::transport_dbg);
+	tgt_socket.register_get_direct_mem_ptr(this,
+				&tlm_activity_probe::get_direct_mem_ptr);
+	init_socket.register_invalidate_direct_mem_ptr(this,
+				&tlm_activity_probe::invalidate_direct_mem_ptr);
+}
+
+void tlm_activity_probe::b_transport(tlm::tlm_generic_payload& trans,
+					sc_time& delay)
+{
+	aq->activity();
+	init_socket->b_transport(trans, delay);
+}
+
+unsigned int tlm_activity_probe::transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return init_socket->transport_dbg(trans);
+}
+
+/*
+ * DMI accesses bypass the probe, but they are plain memory traffic and
+ * not the I/O that needs a tight quantum.
+ */
+bool tlm_activity_probe::get_direct_mem_ptr(tlm::tlm_generic_payload& trans,
+					tlm::tlm_dmi& dmi_data)
+{
+	return init_socket->get_direct_mem_ptr(trans, dmi_data);
+}
+
+void tlm_activity_probe::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+					sc_dt::uint64 end)
+{
+	tgt_socket->invalidate_direct_mem_ptr(start, end);
+}
@@ -0,0 +1,99 @@
+/*
+ * Adaptive synchronization quantum.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ADAPTIVE_QUANTUM_H__
+#define __ADAPTIVE_QUANTUM_H__
+
+#include <stdio.h>
+#include <vector>
+
+/*
+ * Adjusts the global TLM quantum between min and max based on I/O
+ * activity.  Activity is interrupt edges on the irq inputs, plus
+ * transactions through the probes below (MMIO from the PS and DMA to
+ * it).  Every window, four times the current quantum, the controller
+ * halves the quantum if the window had at least busy events, and
+ * doubles it after two windows without any.
+ *
+ * Quantum keepers pick up the new value the next time they sync,
+ * including the remote-port adaptors.  Changes are logged to log_path,
+ * if given, as "time-ns quantum-ns events" lines.
+ */
+class adaptive_quantum
+: public sc_core::sc_module
+{
+public:
+	std::vector<sc_in<bool> *> irq;
+
+	adaptive_quantum(sc_core::sc_module_name name,
+			sc_time min, sc_time max,
+			unsigned int nr_irqs = 0,
+			unsigned int busy = 4,
+			const char *log_path = NULL);
+	~adaptive_quantum();
+	SC_HAS_PROCESS(adaptive_quantum);
+
+	/* Called by probes and models for each I/O event.  */
+	void activity(void) { events++; }
+
+private:
+	sc_time min;
+	sc_time max;
+	sc_time quantum;
+	unsigned int busy;
+	unsigned int events;
+	unsigned int idle_windows;
+	std::vector<bool> irq_last;
+	FILE *log;
+
+	/* Statistics for the end of simulation report.  */
+	unsigned int changes;
+	sc_time last_change;
+	double weighted;
+
+	void set_quantum(sc_time q, unsigned int ev);
+	void irq_changed(void);
+	void control(void);
+	void end_of_simulation(void);
+};
+
+/* Pass-through that reports each transaction to an adaptive_quantum.  */
+class tlm_activity_probe
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<tlm_activity_probe> tgt_socket;
+	tlm_utils::simple_initiator_socket<tlm_activity_probe> init_socket;
+
+	tlm_activity_probe(sc_core::sc_module_name name, adaptive_quantum *aq);
+
+private:
+	adaptive_quantum *aq;
+
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload& trans);
+	bool get_direct_mem_ptr(tlm::tlm_generic_payload& trans,
+				tlm::tlm_dmi& dmi_data);
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
+};
+#endif
@@ -47,11 +47,17 @@ using namespace std;
 #include "soc/xilinx/versal-net/xilinx-versal-net.h"
 #include "soc/dma/xilinx-cdma.h"
 #include "tlm-extensions/genattr.h"
+#include "tlm-pool.h"
 #include "memory.h"
+#include "shared-ram.h"
+#include "checkpoint.h"
 
 #include "catapult/catapult_device.h"
+#include "catapult/hello_world.h"
+#include "catapult/echo_role.h"
 
 using namespace Catapult;
+using namespace Role;
 
 #define NR_MASTERS	2
 #define NR_DEVICES	2
@@ -75,12 +81,16 @@ private:
     virtual void b_transport(tlm::tlm_generic_payload& trans,
             sc_time& delay)
     {
+        tlm_extension_pool<genattr_extension> &pool =
+            tlm_extension_pool<genattr_extension>::shared();
         genattr_extension *genattr;
+        bool pooled = false;
 
         trans.get_extension(genattr);
         if (!genattr) {
-            genattr = new genattr_extension();
+            genattr = pool.get();
             trans.set_extension(genattr);
+            pooled = true;
         }
 
         //
@@ -89,6 +99,11 @@ private:
         genattr->set_master_id(m_smid);
 
         initiator_socket->b_transport(trans, delay);
+
+        if (pooled) {
+            trans.clear_extension(genattr);
+            pool.put(genattr);
+        }
     }
 
     uint32_t m_smid;
@@ -100,9 +115,13 @@ SC_MODULE(Top)
 	xilinx_versal_net versal_net;
 
     CatapultDevice catapult_dev;
+	CatapultRoleInterface *role;
 	SMIDdev smid_catapult_dev;
+	shared_ram *ddr_shared;
 
 	sc_signal<bool> rst;
+	/* Set when the models were restored from a checkpoint.  */
+	bool restored;
 
 	SC_HAS_PROCESS(Top);
 
@@ -110,22 +129,39 @@ SC_MODULE(Top)
 		/* Pull the reset signal.  */
 		rst.write(true);
 		wait(1, SC_US);
-		catapult_dev.reset();
+		if (!restored) {
+			catapult_dev.reset();
+		}
 		rst.write(false);
 	}
 
-	Top(sc_module_name name, const char *sk_descr, sc_time quantum, CatapultDeviceOptions catapult_opts) :
+	Top(sc_module_name name, const char *sk_descr, sc_time quantum,
+	    CatapultDeviceOptions catapult_opts,
+	    const char *role_name, const StreamingRoleOptions &role_opts,
+	    const char *shared_ram_spec = NULL) :
 		sc_module(name),
 		bus("bus"),
 		versal_net("versal-net", sk_descr),
         catapult_dev("catapult_dev", catapult_opts),
 		smid_catapult_dev("smid-catapult_dev", 0x250),
-		rst("rst")
+		ddr_shared(NULL),
+		rst("rst"),
+		restored(false)
 	{
 		m_qk.set_global_quantum(quantum);
 
 		versal_net.rst(rst);
 
+		if (strcasecmp(role_name, "echo") == 0) {
+			role = new EchoChecksumRole("role",
+					catapult_dev.get_shell_interface(),
+					role_opts);
+		} else {
+			role = new HelloWorldRole("role",
+					catapult_dev.get_shell_interface());
+		}
+		catapult_dev.set_role(role);
+
 		//
 		// Bus slave devices
 		//
@@ -139,8 +175,17 @@ SC_MODULE(Top)
 		//
 	    bus.memmap(0xe4000000ULL, CatapultDevice::mmio_size - 1,
 			    ADDRMODE_RELATIVE, -1, catapult_dev.target_socket);
-  		bus.memmap(0x0LL, UINT64_MAX,
-  				ADDRMODE_RELATIVE, -1, *(versal_net.s_cpm));
+		if (shared_ram_spec) {
+			/* Shell DMA to host memory skips remote-port.  */
+			ddr_shared = new shared_ram("ddr-shared",
+						shared_ram_spec);
+			ddr_shared->init_socket.bind(*(versal_net.s_cpm));
+			bus.memmap(0x0LL, UINT64_MAX,
+				ADDRMODE_RELATIVE, -1, ddr_shared->tgt_socket);
+		} else {
+			bus.memmap(0x0LL, UINT64_MAX,
+				ADDRMODE_RELATIVE, -1, *(versal_net.s_cpm));
+		}
 
 		//
 		// Bus masters
@@ -170,6 +215,12 @@ void usage(const char* program_name)
 	cout << "options include:" << endl;
 	cout << "  --noslots   - disables slots DMA engine" << endl;
 	cout << "  --printregs - dumps catapult register banks before running" << endl;
+	cout << "  --role=<name> - selects the role: hello (default) or echo" << endl;
+	cout << "  --workers=<n> - number of parallel role worker processes (echo role)" << endl;
+	cout << "  --shared-ram=<file>[,base=<addr>][,size=<bytes>] - serves DMA to" << endl;
+	cout << "                  guest RAM from QEMU's memory backend file" << endl;
+	cout << "  --checkpoint=<file> - saves the models' state when the simulation ends" << endl;
+	cout << "  --restore=<file> - restores the models' state before it starts" << endl;
 }
 
 int sc_main(int argc, char* argv[])
@@ -182,6 +233,11 @@ int sc_main(int argc, char* argv[])
 	const char* quantum_arg = NULL;
 
 	CatapultDeviceOptions catapult_opts;
+	StreamingRoleOptions role_opts;
+	const char* role_name = "hello";
+	const char* shared_ram_spec = NULL;
+	const char* checkpoint = NULL;
+	const char* restore = NULL;
 
 	// check for help
 	int positional = 1;
@@ -250,6 +306,33 @@ int sc_main(int argc, char* argv[])
 			cout << "catapult: dumping registers after initialization" << endl;
 			catapult_opts.dump_regs = true;
 		}
+
+		if (strncasecmp("role=", arg, 5) == 0) {
+			role_name = arg + 5;
+			cout << "catapult: using " << role_name << " role" << endl;
+		}
+
+		if (strncasecmp("workers=", arg, 8) == 0) {
+			role_opts.worker_count = strtoul(arg + 8, NULL, 10);
+			if (role_opts.worker_count == 0) {
+				cout << "workers must be at least 1" << endl;
+				usage(argv[0]);
+				return -1;
+			}
+		}
+
+		if (strncasecmp("shared-ram=", arg, 11) == 0) {
+			shared_ram_spec = arg + 11;
+			cout << "catapult: sharing guest RAM from " << shared_ram_spec << endl;
+		}
+
+		if (strncasecmp("checkpoint=", arg, 11) == 0) {
+			checkpoint = arg + 11;
+		}
+
+		if (strncasecmp("restore=", arg, 8) == 0) {
+			restore = arg + 8;
+		}
 	}
 
 	if (socket_path == nullptr)
@@ -267,7 +350,15 @@ int sc_main(int argc, char* argv[])
 
 	sc_set_time_resolution(1, SC_PS);
 
-	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS), catapult_opts);
+	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS), catapult_opts,
+		      role_name, role_opts, shared_ram_spec);
+
+	if (restore) {
+		if (!checkpoint_restore_all(restore)) {
+			exit(EXIT_FAILURE);
+		}
+		top->restored = true;
+	}
 
 	if (argc < 3) {
 		sc_start(1, SC_PS);
@@ -280,6 +371,9 @@ int sc_main(int argc, char* argv[])
 	trace(trace_fp, *top, top->name());
 
 	sc_start();
+	if (checkpoint && !checkpoint_save_all(checkpoint)) {
+		printf("failed to save checkpoint %s\n", checkpoint);
+	}
 	if (trace_fp) {
 		sc_close_vcd_trace_file(trace_fp);
 	}
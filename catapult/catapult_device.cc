@@ -72,12 +72,37 @@ CatapultDevice::CatapultDevice(sc_core::sc_module_name name, const CatapultDevic
     init_registers();
 }
 
+void CatapultDevice::set_role(CatapultRoleInterface* role)
+{
+    _role = role;
+
+    if (options.dump_regs && _role)
+    {
+        _role->print();
+    }
+}
+
 void CatapultDevice::reset()
 {
     _shell_regs.reset();
     if (_role) { _role->reset(); }
 }
 
+void CatapultDevice::checkpoint_save(checkpoint_writer& ck)
+{
+    ck.add(string(name()) + ".regs", _shell_regs.get_values());
+}
+
+void CatapultDevice::checkpoint_restore(checkpoint_reader& ck)
+{
+    vector<pair<uint64_t, uint32_t>> regs;
+
+    if (ck.get(string(name()) + ".regs", regs))
+    {
+        _shell_regs.set_values(regs);
+    }
+}
+
 template<class T, typename V>
 function<size_t (uint64_t, size_t, V)> bind_reg_callback(
     T* target,
@@ -95,6 +120,8 @@ void CatapultDevice::b_transport(tlm::tlm_generic_payload& trans,
     unsigned char *data = trans.get_data_ptr();
     size_t len = trans.get_data_length();
     uint64_t addr = trans.get_address();
+    unsigned char *byte_enable = trans.get_byte_enable_ptr();
+    size_t byte_enable_len = trans.get_byte_enable_length();
 
     enum tlm::tlm_command cmd = trans.get_command();
     const char* cmd_name = cmd <= tlm::TLM_IGNORE_COMMAND ? tlm_commands[cmd] : "??????";
@@ -103,23 +130,110 @@ void CatapultDevice::b_transport(tlm::tlm_generic_payload& trans,
         return (cout << "CatapultDevice: " << cmd_name << " cmd @ 0x" << std::hex << addr << " for 0x" << std::hex << len << " bytes");
     };
 
-    if (len != 4 && len != 8)
+    // Registers are 4 or 8 bytes wide.  Larger accesses (memcpy'd blocks of
+    // registers, write-combined BAR writes) are accepted as long as they are
+    // made up of whole, aligned 32b words and are split below into the
+    // register-width accesses the width adapter expects.
+    if (len == 0 || (len % 4) != 0 || (addr % 4) != 0)
     {
-        log_inbound() << " - invalid length" << endl;
+        log_inbound() << " - invalid length or alignment" << endl;
         trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
         return;
     }
 
-    if (trans.get_byte_enable_ptr())
+    if (trans.get_streaming_width() < len)
+    {
+        log_inbound() << " - streaming accesses not supported" << endl;
+        trans.set_response_status(tlm::TLM_BURST_ERROR_RESPONSE);
+        return;
+    }
+
+    if (byte_enable != nullptr && byte_enable_len == 0)
     {
-        log_inbound() << " - byte_enable_ptr not supported" << endl;
+        log_inbound() << " - zero-length byte enables" << endl;
+        trans.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
+        return;
+    }
+
+    // returns 1 if all the bytes of the 32b word at 'offset' are enabled, 0 if
+    // none are, and -1 for a partial word, which no register supports.
+    auto word_enabled = [&](size_t offset) -> int {
+        if (byte_enable == nullptr)
+        {
+            return 1;
+        }
+
+        unsigned int enabled = 0;
+        for (size_t i = offset; i < offset + 4; i += 1)
+        {
+            enabled += (byte_enable[i % byte_enable_len] == tlm::TLM_BYTE_ENABLED) ? 1 : 0;
+        }
+
+        return (enabled == 4) ? 1 : (enabled == 0 ? 0 : -1);
+    };
+
+    bool bulk = (get_address_type(addr) == CatapultRegisterType::bulk);
+
+    if (bulk && ((addr % 8) != 0 || (len % 8) != 0))
+    {
+        log_inbound() << " - bulk window accesses must be whole 64b registers" << endl;
         trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
         return;
     }
 
-    auto reg_type = get_address_type(addr);
+    if (len > sizeof(uint64_t))
+    {
+        log_inbound() << " - burst" << endl;
+    }
+
+    size_t offset = 0;
+
+    while (offset < len)
+    {
+        int enabled = word_enabled(offset);
+
+        if (enabled < 0)
+        {
+            log_inbound() << " - partial byte enable at offset 0x" << std::hex << offset << endl;
+            trans.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
+            return;
+        }
+
+        if (enabled == 0)
+        {
+            // disabled words are skipped entirely (write-combined holes)
+            offset += 4;
+            continue;
+        }
+
+        // use a 64b access when the next two words are an aligned, fully
+        // enabled 64b register, otherwise fall back to 32b.
+        size_t chunk = 4;
 
+        if (((addr + offset) % 8) == 0 &&
+            (len - offset) >= 8 &&
+            word_enabled(offset + 4) == 1)
+        {
+            chunk = 8;
+        }
 
+        if (bulk && chunk != 8)
+        {
+            log_inbound() << " - bulk window access to a partial register at offset 0x" << std::hex << offset << endl;
+            trans.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
+            return;
+        }
+
+        access_register(cmd, addr + offset, chunk, data + offset);
+        offset += chunk;
+    }
+
+    trans.set_response_status(tlm::TLM_OK_RESPONSE);
+}
+
+size_t CatapultDevice::access_register(tlm::tlm_command cmd, uint64_t addr, size_t len, unsigned char* data)
+{
+    auto reg_type = get_address_type(addr);
 
     // auto read_fn  = std::bind(&CatapultDevice::read_unimplemented_register,  this, _1, _2, _3);
     // auto write_fn = std::bind(&CatapultDevice::write_unimplemented_register, this, _1, _2, _3);
@@ -150,37 +264,62 @@ void CatapultDevice::b_transport(tlm::tlm_generic_payload& trans,
             break;
         }
 
+        case bulk:
+        {
+            read_fn =  bind_reg_callback(this, &CatapultDevice::read_bulk_register);
+            write_fn = bind_reg_callback(this, &CatapultDevice::write_bulk_register);
+            break;
+        }
+
         case invalid:
         {
             break;
         }
     }
 
-    if (trans.is_read())
+    if (cmd == tlm::TLM_READ_COMMAND)
     {
-        uint64_t value = 0xdeadbeefdeadbeef;
+        uint64_t value = mmio_bad_value;
 
         size_t bytes_read = read_fn(addr, len, value);
 
         if (bytes_read == 0)
         {
-            log_inbound() << " - read (type " << reg_type << ") completed with length 0" << endl;
+            cout << "CatapultDevice: read @ 0x" << std::hex << addr << " (type " << reg_type << ") completed with length 0" << endl;
         }
         else
         {
             memcpy(reinterpret_cast<void*>(data),
                 reinterpret_cast<const void *>(&value),
-                max(len, bytes_read));
+                min(len, sizeof(value)));
         }
+
+        return bytes_read;
     }
-    else if (trans.is_write())
+    else if (cmd == tlm::TLM_WRITE_COMMAND)
     {
         uint64_t value = 0;
         memcpy(reinterpret_cast<void *>(&value),
                reinterpret_cast<void*>(data),
                min(len, sizeof(value)));
-        write_fn(addr, len, value);
+        return write_fn(addr, len, value);
     }
+
+    return 0;
+}
+
+size_t CatapultDevice::read_bulk_register(uint64_t address, size_t length, uint64_t& value)
+{
+    uint64_t soft_address = soft_reg_addr_test | (address & bulk_window_offset_mask);
+
+    return _softreg_width_adapter.read(soft_address, length, value);
+}
+
+size_t CatapultDevice::write_bulk_register(uint64_t address, size_t length, uint64_t value)
+{
+    uint64_t soft_address = soft_reg_addr_test | (address & bulk_window_offset_mask);
+
+    return _softreg_width_adapter.write(soft_address, length, value);
 }
 
 size_t CatapultDevice::read_external_register(uint64_t address, size_t length, uint64_t& value)
@@ -566,14 +705,47 @@ CatapultRegisterType CatapultDevice::get_address_type(uint64_t address)
         case soft_reg_addr_test:    return CatapultRegisterType::soft;
         case dma_reg_addr_test:
         case dma_alias_addr_test:   return CatapultRegisterType::dma;
+        case bulk_reg_addr_test:    return CatapultRegisterType::bulk;
         default:                    return CatapultRegisterType::invalid;
     }
 }
 
+// Returns the delay a DMA transfer starts from.  The engine may have been
+// idle since its last transfer, in which case the kernel has moved on and
+// the local time left over from then no longer applies.
+sc_time CatapultDevice::start_dma_transfer(void)
+{
+    if (sc_time_stamp() != _dma_qk_stamp)
+    {
+        _dma_qk.reset();
+        _dma_qk_stamp = sc_time_stamp();
+    }
+    return _dma_qk.get_local_time();
+}
+
+void CatapultDevice::finish_dma_transfer(const sc_time& delay)
+{
+    _dma_qk.set(delay);
+    if (!_dma_qk.need_sync())
+    {
+        return;
+    }
+
+    if (sc_get_current_process_handle().proc_kind() == SC_THREAD_PROC_)
+    {
+        _dma_qk.sync();
+    }
+    else
+    {
+        _dma_qk.reset();
+    }
+    _dma_qk_stamp = sc_time_stamp();
+}
+
 void CatapultDevice::dma_read_from_host(uint64_t source_address, void* destination_address, uint64_t transfer_cb)
 {
     tlm::tlm_generic_payload request;
-    sc_time delay = SC_ZERO_TIME;
+    sc_time delay = start_dma_transfer();
 
     request.set_command(tlm::TLM_READ_COMMAND);
     request.set_address(source_address);
@@ -584,6 +756,7 @@ void CatapultDevice::dma_read_from_host(uint64_t source_address, void* destinati
     request.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
 
     initiator_socket->b_transport(request, delay);
+    finish_dma_transfer(delay);
 
     cout << "CatapultDevice: DMA read complete with " << request.get_response_string()
          << " (" << request.get_response_status() << ")" << endl;
@@ -593,5 +766,20 @@ void CatapultDevice::dma_read_from_host(uint64_t source_address, void* destinati
 
 void CatapultDevice::dma_write_to_host(void* source_address, uint64_t destination_address, uint64_t transfer_cb)
 {
+    tlm::tlm_generic_payload request;
+    sc_time delay = start_dma_transfer();
+
+    request.set_command(tlm::TLM_WRITE_COMMAND);
+    request.set_address(destination_address);
+    request.set_data_ptr(static_cast<unsigned char*>(source_address));
+    request.set_data_length(transfer_cb);
+    request.set_streaming_width(transfer_cb);
+    request.set_dmi_allowed(false);
+    request.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
 
+    initiator_socket->b_transport(request, delay);
+    finish_dma_transfer(delay);
+
+    cout << "CatapultDevice: DMA write complete with " << request.get_response_string()
+         << " (" << request.get_response_status() << ")" << endl;
 }
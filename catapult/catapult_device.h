@@ -16,7 +16,7 @@
 #include "systemc.h"
 #include "tlm_utils/simple_initiator_socket.h"
 #include "tlm_utils/simple_target_socket.h"
-// #include "tlm_utils/tlm_quantumkeeper.h"
+#include "tlm_utils/tlm_quantumkeeper.h"
 //
 // #include "trace.h"
 // #include "iconnect.h"
@@ -69,11 +69,12 @@ namespace Catapult
         external = 0x1008,
         shell    = 0x0004,
         soft     = 0x0808,
-        dma      = 0x0908
+        dma      = 0x0908,
+        bulk     = 0x0a08
     };
 
 
-    class CatapultDevice : public sc_core::sc_module, CatapultShellInterface
+    class CatapultDevice : public sc_core::sc_module, CatapultShellInterface, public checkpointable
     {
     public:
         // core addresses are the 16MB of memory defined in section 9 of the shell specifications
@@ -88,6 +89,12 @@ namespace Catapult
         static const uint64_t dma_alias_addr_test    = 0x0000000000700000;  // bits [23:20] = 0b0111 // i think this is an alias of the DMA space
         static const uint64_t soft_reg_addr_test     = 0x0000000000800000;  // bits [23:20] = 0b1000
         static const uint64_t dma_reg_addr_test      = 0x0000000000900000;  // bits [23:20] = 0b1001
+        static const uint64_t bulk_reg_addr_test     = 0x0000000000a00000;  // bits [23:20] = 0b1010
+
+        // the bulk register window is an alias of the soft register space in which
+        // every access is a whole number of aligned 64b registers, so a block of
+        // soft registers can be read or written with one transaction.
+        static const uint64_t bulk_window_offset_mask= 0x00000000000ffff8;  // bits [19:3]
 
         static const uint64_t soft_reg_addr_num_mask = 0x00000000001ffff8;  // bits [20:3]
         static const uint64_t dma_reg_addr_num_mask  = 0x00000000000ffff8;  // bits [19:3]
@@ -124,9 +131,21 @@ namespace Catapult
 
         void reset();
 
+        // attaches the role which handles soft and DMA register accesses.  The
+        // role is owned by the caller and must outlive the device.
+        void set_role(CatapultRoleInterface* role);
+
+        // the interface a role uses to reach back into the shell
+        CatapultShellInterface* get_shell_interface() { return this; }
+
         virtual void dma_read_from_host(uint64_t source_address, void* destination_address, uint64_t transfer_cb) override;
         virtual void dma_write_to_host(void* source_address, uint64_t destination_address, uint64_t transfer_cb) override;
 
+        // saves and restores the shell registers.  The role and slots engine
+        // checkpoint themselves.
+        virtual void checkpoint_save(checkpoint_writer& ck) override;
+        virtual void checkpoint_restore(checkpoint_reader& ck) override;
+
     private:
 
         // A register map for shell/legacy regs
@@ -147,12 +166,31 @@ namespace Catapult
 
         CatapultRoleInterface* _role = nullptr;
 
+        // Time the DMA engine has run ahead of the kernel.  Transfers made
+        // from a thread sync once per quantum.  A method process cannot
+        // wait, so from one the local time is dropped at the quantum
+        // instead, which is what happened to all of it before.
+        tlm_utils::tlm_quantumkeeper _dma_qk;
+        sc_time _dma_qk_stamp;
+
+        sc_time start_dma_transfer(void);
+        void finish_dma_transfer(const sc_time& delay);
+
         void init_registers(void);
 
         void init_shell_registers(void);
 
         virtual void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
 
+        // performs a single register-width (4 or 8 byte) access on behalf of
+        // b_transport, which splits larger bursts into these.  Returns the number
+        // of bytes the register handler accepted.
+        size_t access_register(tlm::tlm_command cmd, uint64_t address, size_t length, unsigned char* data);
+
+        // bulk window accesses are forwarded to the soft register at the same offset
+        size_t  read_bulk_register(uint64_t address, size_t length, uint64_t& value);
+        size_t write_bulk_register(uint64_t address, size_t length, uint64_t  value);
+
         // Reads a 32b shell register.  Returns false if the register address is
         // invalid or unimplemented, true if it's valid.  If valid, value contains
         // the result, otherwise it should be untouched.
@@ -187,6 +225,7 @@ namespace Catapult
             case CatapultRegisterType::shell:     { o << "shell"; break; }
             case CatapultRegisterType::soft:      { o << "soft"; break; }
             case CatapultRegisterType::dma:       { o << "dma"; break; }
+            case CatapultRegisterType::bulk:      { o << "bulk"; break; }
             default:        { o << "unknown(" << (int) t << ")"; break; }
         }
         return o;
@@ -0,0 +1,145 @@
+#include "echo_role.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+using namespace Catapult;
+using namespace Role;
+
+EchoChecksumRole::EchoChecksumRole(sc_module_name name,
+                                   CatapultShellInterface* shell,
+                                   const StreamingRoleOptions& options) :
+    StreamingRole(name, shell, options),
+    _role_regs("role")
+{
+    _role_regs.add(mode_regnum,            "role.000.mode",            echo);
+    _role_regs.add(slots_processed_regnum, "role.001.slots_processed", 0, ReadOnlyRegister);
+    _role_regs.add(bytes_processed_regnum, "role.002.bytes_processed", 0, ReadOnlyRegister);
+
+    for (unsigned int slot_index = 0; slot_index < options.slot_count; slot_index += 1)
+    {
+        ostringstream name;
+
+        name << "role."
+             << dec << setw(3) << setfill('0') << _role_regs.size()
+             << ".checksum_slot"
+             << dec << setw(3) << setfill('0') << slot_index;
+
+        _role_regs.add(slot_checksum_regnum + slot_index, name.str().c_str(), 0, ReadOnlyRegister);
+    }
+}
+
+void EchoChecksumRole::reset()
+{
+    StreamingRole::reset();
+    _role_regs.reset();
+}
+
+void EchoChecksumRole::print()
+{
+    StreamingRole::print();
+    _role_regs.print_register_table("softreg number");
+}
+
+void EchoChecksumRole::checkpoint_save(checkpoint_writer& ck)
+{
+    ck.add(string(name()) + ".regs", _role_regs.get_values());
+}
+
+void EchoChecksumRole::checkpoint_restore(checkpoint_reader& ck)
+{
+    vector<pair<uint64_t, uint64_t>> regs;
+
+    if (ck.get(string(name()) + ".regs", regs))
+    {
+        _role_regs.set_values(regs);
+    }
+}
+
+// Fletcher-64 over 32b little-endian words, with a trailing partial word
+// zero padded.  The sums are only reduced every 92679 words, the most that
+// can be accumulated in 64b without overflowing.
+uint64_t EchoChecksumRole::fletcher64(const uint8_t* data, uint64_t length)
+{
+    const uint64_t modulus = 0xffffffffull;
+    const uint64_t words_per_reduction = 92679;
+
+    uint64_t sum1 = 0;
+    uint64_t sum2 = 0;
+
+    uint64_t word_count = (length + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    for (uint64_t i = 0; i < word_count; )
+    {
+        uint64_t block_end = min(word_count, i + words_per_reduction);
+
+        for (; i < block_end; i += 1)
+        {
+            uint32_t word = 0;
+            uint64_t offset = i * sizeof(uint32_t);
+            memcpy(&word, data + offset, min<uint64_t>(sizeof(word), length - offset));
+
+            sum1 += word;
+            sum2 += sum1;
+        }
+
+        sum1 %= modulus;
+        sum2 %= modulus;
+    }
+
+    return (sum2 << 32) | sum1;
+}
+
+uint64_t EchoChecksumRole::process_slot(const SlotBuffers& buffers)
+{
+    uint64_t sum = fletcher64(buffers.input, buffers.input_length);
+
+    _role_regs[slot_checksum_regnum + buffers.slot_number] = sum;
+    _role_regs[slots_processed_regnum] += 1;
+    _role_regs[bytes_processed_regnum] += buffers.input_length;
+
+    if (_role_regs[mode_regnum] == checksum)
+    {
+        memcpy(buffers.output, &sum, sizeof(sum));
+        return sizeof(sum);
+    }
+    else
+    {
+        memcpy(buffers.output, buffers.input, buffers.input_length);
+        return buffers.input_length;
+    }
+}
+
+bool EchoChecksumRole::read_role_register(uint32_t index, uint64_t& value)
+{
+    auto reg = _role_regs.find_register(index);
+
+    if (reg == nullptr)
+    {
+        return false;
+    }
+
+    return reg->read(index, value);
+}
+
+bool EchoChecksumRole::write_role_register(uint32_t index, uint64_t value)
+{
+    auto reg = _role_regs.find_register(index);
+
+    if (reg == nullptr || reg->is_readonly)
+    {
+        return false;
+    }
+
+    cout << "EchoChecksumRole: w softreg " << out_hex(index, 6, false)
+         << " <= " << out_hex(value, 16, true) << endl;
+
+    return reg->write(index, value);
+}
@@ -0,0 +1,74 @@
+/*
+ * Reference streaming role which echoes or checksums slot data
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "streaming_role.h"
+
+namespace Role
+{
+    // A role with no modeled compute time, for measuring the overhead of the
+    // shell and slots engine on their own.  Every slot's input is checksummed
+    // (Fletcher-64 over 32b little-endian words).  In echo mode the input is
+    // copied to the output; in checksum mode the output is the 8B checksum.
+    //
+    // Soft registers:
+    //   0x000          mode (0 = echo, 1 = checksum)
+    //   0x001          slots processed (read-only)
+    //   0x002          input bytes processed (read-only)
+    //   0x100 + slot   checksum of the slot's last input (read-only)
+    class EchoChecksumRole : public StreamingRole, public checkpointable
+    {
+    public:
+        enum Mode { echo = 0, checksum = 1 };
+
+        static const uint32_t mode_regnum            = 0x000;
+        static const uint32_t slots_processed_regnum = 0x001;
+        static const uint32_t bytes_processed_regnum = 0x002;
+        static const uint32_t slot_checksum_regnum   = 0x100;
+
+    private:
+        Catapult::RegisterMap<uint64_t> _role_regs;
+
+        static uint64_t fletcher64(const uint8_t* data, uint64_t length);
+
+    protected:
+        virtual uint64_t process_slot(const SlotBuffers& buffers) override;
+
+        virtual bool  read_role_register(uint32_t index, uint64_t& value) override;
+        virtual bool write_role_register(uint32_t index, uint64_t  value) override;
+
+    public:
+        EchoChecksumRole(sc_core::sc_module_name name,
+                         Catapult::CatapultShellInterface* shell,
+                         const StreamingRoleOptions& options);
+
+        virtual void reset() override;
+        virtual void print() override;
+
+        // saves and restores the mode, counters and checksums
+        virtual void checkpoint_save(checkpoint_writer& ck) override;
+        virtual void checkpoint_restore(checkpoint_reader& ck) override;
+    };
+}
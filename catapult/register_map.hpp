@@ -36,6 +36,7 @@
 #include <map>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "systemc.h"
 // #include "tlm_utils/simple_initiator_socket.h"
@@ -237,6 +238,34 @@ namespace Catapult
             return _map.at(address).value;
         }
 
+        // the stored value of every register, for checkpointing
+        vector<pair<uint64_t, R>> get_values() const
+        {
+            vector<pair<uint64_t, R>> values;
+
+            for (const auto& r : _map)
+            {
+                values.emplace_back(r.first, r.second.value);
+            }
+
+            return values;
+        }
+
+        // restores stored values without calling any write callbacks.  Values
+        // for addresses which aren't in the map are ignored.
+        void set_values(const vector<pair<uint64_t, R>>& values)
+        {
+            for (const auto& v : values)
+            {
+                auto reg = find_register(v.first);
+
+                if (reg != nullptr)
+                {
+                    reg->value = v.second;
+                }
+            }
+        }
+
         bool try_get(size_t address, R& value)
         {
             auto f = find_register(address);
@@ -0,0 +1,240 @@
+#include "slot_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+
+using namespace sc_core;
+using namespace std;
+
+using namespace Catapult;
+
+LatencyHistogram::LatencyHistogram() :
+    _counts(get_bucket_index(UINT64_MAX) + 1, 0)
+{
+}
+
+size_t LatencyHistogram::get_bucket_index(uint64_t value)
+{
+    if (value < sub_bucket_count)
+    {
+        return static_cast<size_t>(value);
+    }
+
+    // value >> shift lands in [sub_bucket_half, sub_bucket_count)
+    unsigned int msb = 63 - __builtin_clzll(value);
+    unsigned int shift = msb - (sub_bucket_bits - 1);
+
+    return static_cast<size_t>(sub_bucket_count
+                               + (shift - 1) * sub_bucket_half
+                               + ((value >> shift) - sub_bucket_half));
+}
+
+uint64_t LatencyHistogram::get_bucket_high_value(size_t index)
+{
+    if (index < sub_bucket_count)
+    {
+        return index;
+    }
+
+    unsigned int shift = static_cast<unsigned int>((index - sub_bucket_count) / sub_bucket_half) + 1;
+    uint64_t sub_bucket = ((index - sub_bucket_count) % sub_bucket_half) + sub_bucket_half;
+
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    _counts[get_bucket_index(value)] += 1;
+    _total += 1;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+    _sum += value;
+}
+
+void LatencyHistogram::clear()
+{
+    fill(_counts.begin(), _counts.end(), 0);
+    _total = 0;
+    _min = UINT64_MAX;
+    _max = 0;
+    _sum = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    if (_total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(ceil(fraction * _total));
+    target = std::max<uint64_t>(1, std::min(target, _total));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < _counts.size(); i += 1)
+    {
+        seen += _counts[i];
+        if (seen >= target)
+        {
+            return std::min(get_bucket_high_value(i), _max);
+        }
+    }
+
+    return _max;
+}
+
+const char* SlotStatistics::get_stage_name(Stage stage)
+{
+    switch (stage)
+    {
+        case queued:        return "queued";
+        case input_dma:     return "input_dma";
+        case role:          return "role";
+        case output_dma:    return "output_dma";
+        case total:         return "total";
+        default:            return "unknown";
+    }
+}
+
+SlotStatistics::SlotStatistics(unsigned int slot_count) :
+    _slots(slot_count)
+{
+}
+
+void SlotStatistics::clear()
+{
+    for (auto& ts : _slots)
+    {
+        ts.valid_events = 0;
+    }
+
+    for (unsigned int s = 0; s < stage_count; s += 1)
+    {
+        _sim_latency[s].clear();
+        _wall_latency[s].clear();
+    }
+
+    _input_bytes = 0;
+    _output_bytes = 0;
+    _completed_slots = 0;
+    _active = false;
+}
+
+void SlotStatistics::mark(unsigned int slot_number, Event event)
+{
+    assert(slot_number < _slots.size());
+
+    SlotTimestamps& ts = _slots[slot_number];
+
+    sc_time now_sim = sc_time_stamp();
+    wall_clock::time_point now_wall = wall_clock::now();
+
+    if (event == doorbell)
+    {
+        ts.valid_events = 0;
+
+        if (_active == false)
+        {
+            _active = true;
+            _first_sim = now_sim;
+            _first_wall = now_wall;
+            _last_sim = now_sim;
+            _last_wall = now_wall;
+        }
+    }
+
+    ts.sim[event] = now_sim;
+    ts.wall[event] = now_wall;
+    ts.valid_events |= (1u << event);
+
+    if (event == output_done)
+    {
+        _last_sim = now_sim;
+        _last_wall = now_wall;
+        record_completion(ts);
+    }
+}
+
+// folds a completed lifecycle into the histograms.  Lifecycles missing an
+// event (e.g. a slot in flight across a reset) are dropped.
+void SlotStatistics::record_completion(SlotTimestamps& ts)
+{
+    const unsigned int all_events = (1u << event_count) - 1;
+
+    if (ts.valid_events != all_events)
+    {
+        ts.valid_events = 0;
+        return;
+    }
+
+    auto record = [&](Stage stage, Event from, Event to)
+    {
+        double sim_ns = (ts.sim[to] - ts.sim[from]).to_seconds() * 1e9;
+        auto wall_ns = chrono::duration_cast<chrono::nanoseconds>(ts.wall[to] - ts.wall[from]).count();
+
+        _sim_latency[stage].record(static_cast<uint64_t>(llround(sim_ns)));
+        _wall_latency[stage].record(static_cast<uint64_t>(std::max<int64_t>(0, wall_ns)));
+    };
+
+    record(queued,     doorbell,    input_start);
+    record(input_dma,  input_start, input_done);
+    record(role,       input_done,  role_done);
+    record(output_dma, role_done,   output_done);
+    record(total,      doorbell,    output_done);
+
+    _completed_slots += 1;
+    ts.valid_events = 0;
+}
+
+double SlotStatistics::get_sim_bandwidth(uint64_t bytes) const
+{
+    double seconds = _active ? (_last_sim - _first_sim).to_seconds() : 0;
+    return (seconds > 0) ? (bytes / seconds) : 0;
+}
+
+double SlotStatistics::get_wall_bandwidth(uint64_t bytes) const
+{
+    double seconds = _active ? chrono::duration<double>(_last_wall - _first_wall).count() : 0;
+    return (seconds > 0) ? (bytes / seconds) : 0;
+}
+
+void SlotStatistics::report(ostream& o) const
+{
+    ios_base::fmtflags flags = o.flags();
+    streamsize precision = o.precision();
+
+    o << "SlotsEngine: " << _completed_slots << " slot(s) completed, "
+      << _input_bytes << "B in, " << _output_bytes << "B out" << endl;
+
+    o << "  bandwidth (MB/s)     sim: in " << fixed << setprecision(1)
+      << get_sim_bandwidth(_input_bytes) / 1e6
+      << " out " << get_sim_bandwidth(_output_bytes) / 1e6
+      << "    wall: in " << get_wall_bandwidth(_input_bytes) / 1e6
+      << " out " << get_wall_bandwidth(_output_bytes) / 1e6 << endl;
+
+    o << "  latency (ns)  " << setw(12) << "clock"
+      << setw(12) << "p50" << setw(12) << "p99" << setw(12) << "p999" << setw(12) << "max" << endl;
+
+    for (unsigned int s = 0; s < stage_count; s += 1)
+    {
+        const LatencyHistogram* histograms[] = { &_sim_latency[s], &_wall_latency[s] };
+        const char* clocks[] = { "sim", "wall" };
+
+        for (unsigned int c = 0; c < 2; c += 1)
+        {
+            const LatencyHistogram& h = *histograms[c];
+
+            o << "  " << left << setw(12) << get_stage_name(Stage(s)) << right
+              << setw(12) << clocks[c]
+              << setw(12) << h.percentile(0.50)
+              << setw(12) << h.percentile(0.99)
+              << setw(12) << h.percentile(0.999)
+              << setw(12) << h.max() << endl;
+        }
+    }
+
+    o.flags(flags);
+    o.precision(precision);
+}
@@ -0,0 +1,159 @@
+/*
+ * Latency and bandwidth accounting for the slots DMA engine
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+#include "systemc.h"
+
+namespace Catapult
+{
+    // A log-linear histogram of nanosecond values in the style of HdrHistogram.
+    // Values below 128 get their own bucket, above that each power of two is
+    // split into 64 buckets, so any recorded value is within 1/64 (~1.6%) of
+    // the value reported for its bucket.
+    class LatencyHistogram
+    {
+    public:
+        static const unsigned int sub_bucket_bits  = 7;
+        static const uint64_t     sub_bucket_count = 1ull << sub_bucket_bits;
+        static const uint64_t     sub_bucket_half  = sub_bucket_count / 2;
+
+    private:
+        std::vector<uint64_t> _counts;
+        uint64_t _total = 0;
+        uint64_t _min = UINT64_MAX;
+        uint64_t _max = 0;
+        double   _sum = 0;
+
+        static size_t get_bucket_index(uint64_t value);
+        static uint64_t get_bucket_high_value(size_t index);
+
+    public:
+        LatencyHistogram();
+
+        void record(uint64_t value);
+        void clear();
+
+        uint64_t count() const { return _total; }
+        uint64_t min()   const { return (_total == 0) ? 0 : _min; }
+        uint64_t max()   const { return _max; }
+        double   mean()  const { return (_total == 0) ? 0 : _sum / _total; }
+
+        // the smallest bucket value at or below which fraction (0..1) of the
+        // recorded values fall.  Returns 0 for an empty histogram.
+        uint64_t percentile(double fraction) const;
+    };
+
+    // Tracks each slot through its lifecycle, in both simulated time and host
+    // wall-clock time, and accumulates the time spent in each stage once the
+    // slot completes.
+    class SlotStatistics
+    {
+    public:
+        // points in a slot's lifecycle, in the order they happen
+        enum Event
+        {
+            doorbell = 0,   // host wrote the full doorbell
+            input_start,    // the engine started the input DMA
+            input_done,     // input DMA finished and was handed to the role
+            role_done,      // the role completed the slot
+            output_done,    // output and done status were written to the host
+            event_count
+        };
+
+        // intervals between events, plus the whole lifecycle
+        enum Stage
+        {
+            queued = 0,     // doorbell    -> input_start
+            input_dma,      // input_start -> input_done
+            role,           // input_done  -> role_done
+            output_dma,     // role_done   -> output_done
+            total,          // doorbell    -> output_done
+            stage_count
+        };
+
+        static const char* get_stage_name(Stage stage);
+
+    private:
+        typedef std::chrono::steady_clock wall_clock;
+
+        struct SlotTimestamps
+        {
+            unsigned int valid_events = 0;  // bitmask of Events recorded
+            std::array<sc_core::sc_time, event_count> sim;
+            std::array<wall_clock::time_point, event_count> wall;
+        };
+
+        std::vector<SlotTimestamps> _slots;
+
+        std::array<LatencyHistogram, stage_count> _sim_latency;
+        std::array<LatencyHistogram, stage_count> _wall_latency;
+
+        uint64_t _input_bytes = 0;
+        uint64_t _output_bytes = 0;
+        uint64_t _completed_slots = 0;
+
+        // the span over which bytes were moved, for bandwidth calculations
+        bool _active = false;
+        sc_core::sc_time _first_sim;
+        sc_core::sc_time _last_sim;
+        wall_clock::time_point _first_wall;
+        wall_clock::time_point _last_wall;
+
+        void record_completion(SlotTimestamps& ts);
+
+    public:
+        explicit SlotStatistics(unsigned int slot_count);
+
+        // timestamps an event for a slot.  A doorbell event starts a new
+        // lifecycle, and an output_done event records it in the histograms.
+        void mark(unsigned int slot_number, Event event);
+
+        void add_input_bytes(uint64_t bytes)  { _input_bytes += bytes; }
+        void add_output_bytes(uint64_t bytes) { _output_bytes += bytes; }
+
+        void clear();
+
+        const LatencyHistogram& get_sim_latency(Stage stage) const  { return _sim_latency[stage]; }
+        const LatencyHistogram& get_wall_latency(Stage stage) const { return _wall_latency[stage]; }
+
+        uint64_t get_input_bytes() const     { return _input_bytes; }
+        uint64_t get_output_bytes() const    { return _output_bytes; }
+        uint64_t get_completed_slots() const { return _completed_slots; }
+
+        // bytes per second over the span from the first doorbell to the last
+        // completion, in simulated and wall-clock seconds.
+        double get_sim_bandwidth(uint64_t bytes) const;
+        double get_wall_bandwidth(uint64_t bytes) const;
+
+        void report(std::ostream& o) const;
+    };
+}
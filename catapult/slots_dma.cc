@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <numeric>
@@ -15,25 +16,115 @@ using namespace std;
 
 using namespace Catapult;
 
-SlotsEngine::SlotsEngine(sc_module_name module_name, unsigned int slot_count, CatapultShellInterface* shell) :
+SlotsEngine::SlotsEngine(sc_module_name module_name,
+                         unsigned int slot_count,
+                         CatapultShellInterface* shell,
+                         uint64_t slot_buffer_size,
+                         bool use_method) :
     sc_module(module_name),
     _slot_count(slot_count),
     _shell(shell),
-    _dma_regs("dma")
+    _slot_buffer_size(slot_buffer_size),
+    _slot_buffers(nullptr, &free),
+    _slot_output_buffers(nullptr, &free),
+    _slot_config(slot_count, nullptr),
+    _dma_regs("dma"),
+    _slot_active(slot_count, false),
+    _stats(slot_count)
 {
     if (slot_count > maximum_slot_count)
     {
         throw logic_error("slot_count is larger than maximum allowed value (64)");
     }
 
+    if (slot_buffer_size == 0 || (slot_buffer_size % dma_block_size) != 0)
+    {
+        throw logic_error("slot_buffer_size must be a non-zero multiple of the DMA block size (16B)");
+    }
+
+    // allocate the buffers for all slots in one go, so that merged slots are
+    // contiguous and a single DMA can fill them.
+    void* buffers = nullptr;
+    if (posix_memalign(&buffers, slot_buffer_alignment, slot_count * slot_buffer_size) != 0)
+    {
+        throw bad_alloc();
+    }
+
+    _slot_buffers.reset(static_cast<uint8_t*>(buffers));
+
+    if (posix_memalign(&buffers, slot_buffer_alignment, slot_count * slot_buffer_size) != 0)
+    {
+        throw bad_alloc();
+    }
+
+    _slot_output_buffers.reset(static_cast<uint8_t*>(buffers));
+
     init_dma_registers();
 
-    SC_THREAD(dma_thread);
+    // index of the last busy doorbell OR the last
+    // doorbell that was checked.  Setting it to
+    // 63 ensures that we start the first pass looking
+    // at doorbell 0.
+    _dma_input_slot = _slot_count - 1;
+
+    if (use_method)
+    {
+        SC_METHOD(dma_method);
+    }
+    else
+    {
+        SC_THREAD(dma_thread);
+    }
 }
 
 void SlotsEngine::reset()
 {
     _dma_regs.reset();
+    _completions.clear();
+    _slot_active.assign(_slot_count, false);
+    _stats.clear();
+
+    for (unsigned int i = 0; i < _slot_count; i += 1)
+    {
+        update_slot_config(i);
+    }
+}
+
+void SlotsEngine::set_slot_config(unsigned int slot_number, SlotInputConfig* config)
+{
+    if (slot_number >= _slot_count)
+    {
+        throw out_of_range("slot_number is larger than the number of slots");
+    }
+
+    _slot_config[slot_number] = config;
+    update_slot_config(slot_number);
+}
+
+// points a slot's input view at its region of the slot buffers.  The head of
+// a merged group sees the whole group's buffer, the other members of the
+// group see nothing since their doorbells are ignored.
+void SlotsEngine::update_slot_config(unsigned int slot_number)
+{
+    SlotInputConfig* config = _slot_config[slot_number];
+
+    if (config == nullptr)
+    {
+        return;
+    }
+
+    config->clear();
+
+    if (is_slot_group_head(slot_number))
+    {
+        config->buffer = get_slot_buffer(slot_number);
+        config->buffer_size = get_slot_group_buffer_size();
+    }
+    else
+    {
+        config->buffer = nullptr;
+        config->buffer_size = 0;
+    }
 }
 
 void SlotsEngine::init_dma_registers()
@@ -74,10 +165,17 @@ void SlotsEngine::init_dma_registers()
 
     _dma_regs.add(0x1c7f0, "dma.000.magicvalue0",       slots_magic_number );
     _dma_regs.add(0x20000, "dma.000.magicvalue",        slots_magic_number );
-    _dma_regs.add(0x20001, "dma.001.buffer_size",                        0 );
+    _dma_regs.add(0x20001, "dma.001.buffer_size",        _slot_buffer_size, ReadOnlyRegister);
     _dma_regs.add(0x20002, "dma.002.num_buffers",               _slot_count);
     _dma_regs.add(0x20003, "dma.003.num_gp_registers",                 128 );
-    _dma_regs.add(0x20004, "dma.004.merged_slots",                       0 );
+    _dma_regs.add_register(merged_slots_regnum,
+        RegisterT("dma.004.merged_slots",
+                  0,
+                  nullptr,    // readfn
+                  [this](uint64_t, uint64_t new_value, RegisterT* reg)
+                  {
+                      return write_merged_slots_register(reg, new_value);
+                  }));
     _dma_regs.add(0x20005, "dma.005.isr_rate_limit_threshold",           0 );
     _dma_regs.add(0x20006, "dma.006.isr_rate_limit_multiplier",          0 );
     _dma_regs.add(0x20007, "dma.007.unused",                             0 );
@@ -97,6 +195,8 @@ void SlotsEngine::init_dma_registers()
     _dma_regs.add(0x20023, "dma.023.any_avail_slot_ctrl",                0 );
     _dma_regs.add(0x20024, "dma.024.any_avail_slot_test",                0 );
 
+    init_stats_registers();
+
     array<const char*, 3> address_types = {"input", "output", "ctrl"};
     array<const char*, 2> doorbell_types = {"full", "done"};
 
@@ -162,6 +262,49 @@ void SlotsEngine::init_dma_registers()
     }
 }
 
+// Registers exposing the slot statistics.  Bandwidth is in bytes per second
+// of simulated time, and latencies are the doorbell to done time of a slot in
+// simulated nanoseconds.  Writing a non-zero value to stats_control clears
+// the statistics.
+void SlotsEngine::init_stats_registers()
+{
+    _dma_regs.add_register(0x20030,
+        RegisterT("dma.030.stats_control",
+                  0,
+                  nullptr,    // readfn
+                  [this](uint64_t, uint64_t new_value, RegisterT*)
+                  {
+                      if (new_value != 0)
+                      {
+                          cout << "SlotsEngine: clearing slot statistics" << endl;
+                          _stats.clear();
+                      }
+                      return true;
+                  }));
+
+    auto add_stat = [this](uint64_t regnum, const char* name, function<uint64_t ()> fn)
+    {
+        _dma_regs.add(regnum, name,
+            [fn](uint64_t, uint64_t& value, RegisterT*)
+            {
+                value = fn();
+                return true;
+            });
+    };
+
+    const LatencyHistogram& latency = _stats.get_sim_latency(SlotStatistics::total);
+
+    add_stat(0x20031, "dma.031.stats_completed_slots",   [this]() { return _stats.get_completed_slots(); });
+    add_stat(0x20032, "dma.032.stats_input_bytes",       [this]() { return _stats.get_input_bytes(); });
+    add_stat(0x20033, "dma.033.stats_output_bytes",      [this]() { return _stats.get_output_bytes(); });
+    add_stat(0x20034, "dma.034.stats_input_bytes_per_s", [this]() { return uint64_t(_stats.get_sim_bandwidth(_stats.get_input_bytes())); });
+    add_stat(0x20035, "dma.035.stats_output_bytes_per_s",[this]() { return uint64_t(_stats.get_sim_bandwidth(_stats.get_output_bytes())); });
+    add_stat(0x20036, "dma.036.stats_latency_p50_ns",    [&latency]() { return latency.percentile(0.50); });
+    add_stat(0x20037, "dma.037.stats_latency_p99_ns",    [&latency]() { return latency.percentile(0.99); });
+    add_stat(0x20038, "dma.038.stats_latency_p999_ns",   [&latency]() { return latency.percentile(0.999); });
+    add_stat(0x20039, "dma.039.stats_latency_max_ns",    [&latency]() { return latency.max(); });
+}
+
 uint64_t SlotsEngine::read_dma_register(uint32_t index, string& message)
 {
     RegisterMap<uint64_t>::Register* reg = _dma_regs.find_register(index);
@@ -219,6 +362,61 @@ void SlotsEngine::write_dma_register(uint32_t index, uint64_t value, string& mes
     message = m.str();
 }
 
+void SlotsEngine::end_of_simulation()
+{
+    if (_stats.get_input_bytes() != 0)
+    {
+        _stats.report(cout);
+    }
+}
+
+void SlotsEngine::checkpoint_save(checkpoint_writer& ck)
+{
+    string prefix(name());
+    vector<pair<unsigned int, uint64_t>> completions(_completions.begin(), _completions.end());
+
+    ck.add(prefix + ".regs", _dma_regs.get_values());
+    ck.add(prefix + ".input", _slot_buffers.get(), _slot_count * _slot_buffer_size);
+    ck.add(prefix + ".output", _slot_output_buffers.get(), _slot_count * _slot_buffer_size);
+    ck.add(prefix + ".completions", completions);
+}
+
+void SlotsEngine::checkpoint_restore(checkpoint_reader& ck)
+{
+    string prefix(name());
+    vector<pair<uint64_t, uint64_t>> regs;
+    vector<pair<unsigned int, uint64_t>> completions;
+
+    if (ck.get(prefix + ".regs", regs))
+    {
+        _dma_regs.set_values(regs);
+    }
+
+    ck.get(prefix + ".input", _slot_buffers.get(), _slot_count * _slot_buffer_size);
+    ck.get(prefix + ".output", _slot_output_buffers.get(), _slot_count * _slot_buffer_size);
+
+    if (ck.get(prefix + ".completions", completions))
+    {
+        _completions.assign(completions.begin(), completions.end());
+    }
+
+    _slot_active.assign(_slot_count, false);
+    for (auto& completion : _completions)
+    {
+        _slot_active[completion.first] = true;
+    }
+
+    // the merged slot count may have changed.  The DMA thread rescans the
+    // doorbells when it starts, so it picks up any that were full.
+    for (unsigned int i = 0; i < _slot_count; i += 1)
+    {
+        update_slot_config(i);
+    }
+
+    cout << "SlotsEngine: restored " << regs.size() << " registers and "
+         << _completions.size() << " pending completions" << endl;
+}
+
 void SlotsEngine::print()
 {
     _dma_regs.print_register_table(
@@ -245,6 +443,15 @@ bool SlotsEngine::write_doorbell_register(RegisterT* reg,
         return false;
     }
 
+    // with merged slots only the head of each group has a live doorbell.
+    if (type == full && is_slot_group_head(slot_number) == false)
+    {
+        cout << "SlotsEngine: slot " << slot_number
+             << " is merged into slot " << (slot_number - (slot_number % get_merged_slot_count()))
+             << " - dropping full doorbell write" << endl;
+        return false;
+    }
+
     if (reg->value != 0)
     {
         cout << "WARNING: host overwrite pending doorbell for slot " << slot_number
@@ -257,6 +464,11 @@ bool SlotsEngine::write_doorbell_register(RegisterT* reg,
 
     if (new_value != 0)
     {
+        if (type == full)
+        {
+            _stats.mark(slot_number, SlotStatistics::doorbell);
+        }
+
         // write the doorbell event to wake up the DMA thread.
         _dma_doorbell_write.notify(SC_ZERO_TIME);
     }
@@ -264,6 +476,53 @@ bool SlotsEngine::write_doorbell_register(RegisterT* reg,
     return true;
 }
 
+// Sets the number of consecutive slots merged into one buffer.  The value
+// must be 0 or 1 (no merging) or a power of two which divides the number of
+// slots evenly.  Slot n * merged_slots is then the head of a group, and owns
+// the doorbells and address registers for the whole group.
+bool SlotsEngine::write_merged_slots_register(RegisterT* reg, uint64_t new_value)
+{
+    if (new_value > _slot_count ||
+        (new_value & (new_value - 1)) != 0 ||
+        (new_value != 0 && (_slot_count % new_value) != 0))
+    {
+        cout << "SlotsEngine: invalid merged slot count " << new_value
+             << " for " << _slot_count << " slots - dropping write" << endl;
+        return false;
+    }
+
+    // the group layout must not change under a slot which is waiting for
+    // its input, with the role, or waiting for its output to be written.
+    for (unsigned int i = 0; i < _slot_count; i += 1)
+    {
+        if (get_doorbell_register(i, full) != 0 || _slot_active[i])
+        {
+            cout << "SlotsEngine: slot " << i << " is in use"
+                 << " - dropping merged slot count change" << endl;
+            return false;
+        }
+    }
+
+    if (_completions.empty() == false)
+    {
+        cout << "SlotsEngine: " << _completions.size() << " slot(s) waiting for output"
+             << " - dropping merged slot count change" << endl;
+        return false;
+    }
+
+    reg->value = new_value;
+
+    cout << "SlotsEngine: " << get_merged_slot_count() << " slot(s) per buffer, "
+         << get_slot_group_buffer_size() << "B per buffer" << endl;
+
+    for (unsigned int i = 0; i < _slot_count; i += 1)
+    {
+        update_slot_config(i);
+    }
+
+    return true;
+}
+
 // scans each slot's full-doorbell looking for a non-zero one, starting
 // with after db_num, and wrapping back around to hint.
 // set db_num to 0 to restart from the beginning.
@@ -307,90 +566,259 @@ bool SlotsEngine::find_next_full_doorbell(unsigned int &db_num, uint64_t& db_val
     return false;
 }
 
-void SlotsEngine::dma_thread()
+void SlotsEngine::complete_slot(unsigned int slot_number, uint64_t output_length)
 {
-    // index of the last busy doorbell OR the last
-    // doorbell that was checked.  Setting it to
-    // 63 ensures that we start the first pass looking
-    // at doorbell 0.
-    unsigned int slot_number = _slot_count - 1;
+    if (slot_number >= _slot_count)
+    {
+        throw out_of_range("slot_number is larger than the number of slots");
+    }
 
-    while (true)
+    // only group heads own an output buffer, and a group never runs past
+    // the last slot's buffer
+    if (is_slot_group_head(slot_number) == false)
     {
-        uint64_t read_count_blocks = 0;
+        throw out_of_range("slot_number is merged into another slot");
+    }
 
-        // TODO: check done doorbells to start any pending tx from the role
-        // Scan for a non-zero doorbell, starting after the last doorbell
-        // checked
+    uint64_t output_size = min<uint64_t>(get_slot_group_buffer_size(),
+                                         (_slot_count - slot_number) * _slot_buffer_size);
 
-        cout << "SlotsEngine: DMA engine scanning for full doorbell, starting @ " << slot_number << endl;
-        if (find_next_full_doorbell(slot_number, read_count_blocks))
-        {
-            uint64_t read_cb  = read_count_blocks * dma_block_size;
+    if (output_length > output_size)
+    {
+        throw out_of_range("output_length is larger than the slot's output buffer");
+    }
 
-            cout << "SlotsEngine: full db for slot " << slot_number << " detected" << endl;
+    _stats.mark(slot_number, SlotStatistics::role_done);
 
-            if (slot_number < _slot_config.size() && 
-                _slot_config[slot_number] != nullptr)
-            {
-                SlotInputConfig ic = _slot_config[slot_number];
+    _completions.emplace_back(slot_number, output_length);
+    _role_completion.notify(SC_ZERO_TIME);
+}
 
-                // TODO: check if read_cb is < the input buffer size
-                cout >> "SlotsEngine: slot " << slot_number << " reading " << read_cb << "B from host" << endl;
+// copies a completed slot's output to the host.  The output is padded to whole
+// DMA blocks, and the done status written by finish_slot_output() holds the
+// number of blocks written (at least one, so that an empty output still reads
+// as done).
+bool SlotsEngine::start_slot_output(unsigned int slot_number, uint64_t output_length)
+{
+    uint64_t output_blocks = max<uint64_t>(1, (output_length + dma_block_size - 1) / dma_block_size);
+    uint64_t write_cb = output_blocks * dma_block_size;
 
-                uint64_t input_address   = get_address_register(slot_number, AddressType::input);
+    uint64_t output_address  = get_address_register(slot_number, AddressType::output);
+    uint64_t control_address = get_address_register(slot_number, AddressType::control);
 
-                assert(input_address != 0);
+    if (output_address == 0 || control_address == 0)
+    {
+        cout << "SlotsEngine: slot " << slot_number
+             << " has no output or control address - dropping " << output_length << "B of output" << endl;
+        _slot_active[slot_number] = false;
+        return false;
+    }
 
-                uint64_t control_address = get_address_register(slot_number, AddressType::control);
+    uint8_t* output = get_slot_output_buffer(slot_number);
+    memset(output + output_length, 0, write_cb - output_length);
 
-                // start a DMA transaction
-                _shell->dma_read_from_host(input_address,  ic->buffer->data(), read_cb);
-                wait(SC_ZERO_TIME);
+    cout << "SlotsEngine: slot " << slot_number << " writing " << write_cb << "B to host" << endl;
+
+    _dma_output_blocks = output_blocks;
+    _shell->dma_write_to_host(output, output_address, write_cb);
+    return true;
+}
 
-                // clear the doorbell register.
-                cout << "SlotsEngine: clearing slot << " << slot_number << " full db" << endl;
-                get_doorbell_register(slot_number, full) = 0;
+void SlotsEngine::finish_slot_output(unsigned int slot_number)
+{
+    uint64_t control_address = get_address_register(slot_number, AddressType::control);
 
-                // clear the full bit in the control register
-                cout << "SlotsEngine: clearing slot " << slot_number << " full control bit" << endl;
-                uint64_t zero;
-                _shell->dma_write_to_host(&zero,
-                                        get_control_full_status_address(control_address),
-                                        sizeof(zero));
-                wait(SC_ZERO_TIME);
+    cout << "SlotsEngine: setting slot " << slot_number << " done control status" << endl;
+    _shell->dma_write_to_host(&_dma_output_blocks,
+                              get_control_done_status_address(control_address),
+                              sizeof(_dma_output_blocks));
+}
+
+void SlotsEngine::complete_slot_output(unsigned int slot_number)
+{
+    _stats.add_output_bytes(_dma_output_blocks * dma_block_size);
+    _stats.mark(slot_number, SlotStatistics::output_done);
+    _slot_active[slot_number] = false;
+}
+
+bool SlotsEngine::start_slot_input(unsigned int& slot_number, uint64_t& read_cb)
+{
+    uint64_t read_count_blocks = 0;
+
+    // Scan for a non-zero doorbell, starting after the last doorbell
+    // checked
+
+    cout << "SlotsEngine: DMA engine scanning for full doorbell, starting @ " << slot_number << endl;
+    if (find_next_full_doorbell(slot_number, read_count_blocks) == false)
+    {
+        return false;
+    }
+
+    read_cb = read_count_blocks * dma_block_size;
+
+    cout << "SlotsEngine: full db for slot " << slot_number << " detected" << endl;
+
+    uint64_t capacity = get_slot_group_buffer_size();
+
+    if (read_cb > capacity)
+    {
+        cout << "SlotsEngine: slot " << slot_number << " doorbell requests " << read_cb
+             << "B, larger than the " << capacity << "B slot buffer - dropping" << endl;
+
+        // clear the doorbell register.
+        cout << "SlotsEngine: clearing slot << " << slot_number << " full db" << endl;
+        get_doorbell_register(slot_number, full) = 0;
+        read_cb = 0;
+        return true;
+    }
+
+    cout << "SlotsEngine: slot " << slot_number << " reading " << read_cb << "B from host" << endl;
+
+    uint64_t input_address   = get_address_register(slot_number, AddressType::input);
+
+    assert(input_address != 0);
+
+    _stats.mark(slot_number, SlotStatistics::input_start);
+    _slot_active[slot_number] = true;
+
+    // start a DMA transaction.  A merged group's buffers are contiguous
+    // so the whole payload moves in one transfer.
+    _shell->dma_read_from_host(input_address, get_slot_buffer(slot_number), read_cb);
+    return true;
+}
 
-                // Dump the output buffer
-                // const size_t line_dwords = 8;
+void SlotsEngine::clear_slot_input(unsigned int slot_number)
+{
+    uint64_t control_address = get_address_register(slot_number, AddressType::control);
+
+    // clear the doorbell register.
+    cout << "SlotsEngine: clearing slot " << slot_number << " full db" << endl;
+    get_doorbell_register(slot_number, full) = 0;
+
+    // clear the full bit in the control register
+    cout << "SlotsEngine: clearing slot " << slot_number << " full control bit" << endl;
+    uint64_t zero = 0;
+    _shell->dma_write_to_host(&zero,
+                            get_control_full_status_address(control_address),
+                            sizeof(zero));
+}
 
-                // for (size_t dwi = 0; dwi < input_data.size(); dwi += line_dwords)
-                // {
-                //     if (dwi % line_dwords == 0)
-                //     {
-                //         cout << out_hex(dwi * 4, 8) << ": ";
-                //     }
+void SlotsEngine::finish_slot_input(unsigned int slot_number, uint64_t read_cb)
+{
+    // hand the input to the role, if one is attached to the slot.  Without
+    // one nothing completes the slot.
+    if (_slot_config[slot_number] != nullptr)
+    {
+        _slot_config[slot_number]->set_data(read_cb);
+    }
+    else
+    {
+        _slot_active[slot_number] = false;
+    }
 
-                //     for (size_t dwj = dwi; dwj < (dwi + line_dwords) && dwj < input_data.size(); dwj += 1)
-                //     {
-                //         cout << out_hex(input_data[dwj], 8, false) << " ";
-                //     }
+    _stats.add_input_bytes(read_cb);
+    _stats.mark(slot_number, SlotStatistics::input_done);
+}
 
-                //     cout << endl;
-                // }
+void SlotsEngine::dma_thread()
+{
+    while (true)
+    {
+        // write back any output the role has finished before taking on more input
+        if (_completions.empty() == false)
+        {
+            auto completion = _completions.front();
+            _completions.pop_front();
 
-                // cout << endl;
+            if (start_slot_output(completion.first, completion.second))
+            {
+                wait(SC_ZERO_TIME);
+                finish_slot_output(completion.first);
+                wait(SC_ZERO_TIME);
+                complete_slot_output(completion.first);
             }
-            else 
+            continue;
+        }
+
+        if (start_slot_input(_dma_input_slot, _dma_input_cb))
+        {
+            if (_dma_input_cb != 0)
             {
-                // clear the doorbell register.
-                cout << "SlotsEngine: clearing slot << " << slot_number << " full db" << endl;
-                get_doorbell_register(slot_number, full) = 0;
+                wait(SC_ZERO_TIME);
+                clear_slot_input(_dma_input_slot);
+                wait(SC_ZERO_TIME);
+                finish_slot_input(_dma_input_slot, _dma_input_cb);
             }
         }
         else
         {
-            cout << "SlotsEngine: sleeping (next db scan starts with " << slot_number << ")" << endl;
-            wait(_dma_doorbell_write);
+            cout << "SlotsEngine: sleeping (next db scan starts with " << _dma_input_slot << ")" << endl;
+            wait(_dma_doorbell_write | _role_completion);
+        }
+    }
+}
+
+void SlotsEngine::dma_method()
+{
+    // finish the stage we were waiting a delta cycle after
+    switch (_dma_step)
+    {
+    case DmaStep::input_read:
+        clear_slot_input(_dma_input_slot);
+        _dma_step = DmaStep::input_cleared;
+        next_trigger(SC_ZERO_TIME);
+        return;
+
+    case DmaStep::input_cleared:
+        finish_slot_input(_dma_input_slot, _dma_input_cb);
+        break;
+
+    case DmaStep::output_written:
+        finish_slot_output(_dma_output_slot);
+        _dma_step = DmaStep::output_done;
+        next_trigger(SC_ZERO_TIME);
+        return;
+
+    case DmaStep::output_done:
+        complete_slot_output(_dma_output_slot);
+        break;
+
+    case DmaStep::scan:
+        break;
+    }
+
+    _dma_step = DmaStep::scan;
+
+    while (true)
+    {
+        if (_completions.empty() == false)
+        {
+            auto completion = _completions.front();
+            _completions.pop_front();
+
+            if (start_slot_output(completion.first, completion.second))
+            {
+                _dma_output_slot = completion.first;
+                _dma_step = DmaStep::output_written;
+                next_trigger(SC_ZERO_TIME);
+                return;
+            }
+            continue;
         }
+
+        if (start_slot_input(_dma_input_slot, _dma_input_cb))
+        {
+            if (_dma_input_cb != 0)
+            {
+                _dma_step = DmaStep::input_read;
+                next_trigger(SC_ZERO_TIME);
+                return;
+            }
+            continue;
+        }
+
+        cout << "SlotsEngine: sleeping (next db scan starts with " << _dma_input_slot << ")" << endl;
+        next_trigger(_dma_doorbell_write | _role_completion);
+        return;
     }
 }
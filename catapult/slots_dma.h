@@ -28,10 +28,13 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <functional>
 #include <iomanip>
 #include <ostream>
@@ -48,6 +51,9 @@ typedef uint64_t ULONGLONG;
 #define DEFINE_GUID(...)   /* do nothing */
 #include "CatapultShellInterface.h"
 
+#include "slot_stats.h"
+#include "checkpoint.h"
+
 // #include "register_map.hpp"
 
 namespace Catapult
@@ -56,11 +62,16 @@ namespace Catapult
 
     static_assert(sizeof(DMA_ISO_CONTROL_RESULT_COMBINED) == 128, "DMA_ISO_CONTROL_RESULT_COMBINED size incorrect");
 
+    // A role's view of one slot's input buffer.  The buffer itself is owned
+    // by the SlotsEngine; set_slot_config() points buffer at the slot's region
+    // of the engine's contiguous allocation.  When slots are merged the head
+    // slot's view covers the buffers of every slot in its group.
     struct SlotInputConfig
     {
-        vector<uint8_t>* buffer;
+        uint8_t* buffer = nullptr;
+        uint64_t buffer_size = 0;
         uint64_t valid_length = 0;
-        sc_core::sc_event* signal;
+        sc_core::sc_event* signal = nullptr;
 
         void set_data(uint64_t length)
         {
@@ -73,16 +84,11 @@ namespace Catapult
 
         void clear()
         {
-            if (buffer)
-            {
-                buffer.clear();
-            }
-
             valid_length = 0;
         }
     };
 
-    class SlotsEngine : public sc_core::sc_module
+    class SlotsEngine : public sc_core::sc_module, public checkpointable
     {
         SC_HAS_PROCESS(SlotsEngine);
 
@@ -92,6 +98,11 @@ namespace Catapult
 
         static const size_t dma_block_size = (128 / 8);  // DMA is in 128b blocks, or 16B
 
+        // default size of each slot's input buffer, and the alignment of the
+        // allocation backing all of the slot buffers.
+        static const uint64_t default_slot_buffer_size = 64 * 1024;
+        static const size_t   slot_buffer_alignment    = 4096;
+
         typedef RegisterMap<uint64_t>::Register RegisterT;
 
         enum AddressType  { input = 0, output = 1, control = 2 };
@@ -106,7 +117,18 @@ namespace Catapult
         // DMA operations
         CatapultShellInterface* _shell = nullptr;
 
-        // Role input buffers for each slot
+        // The size of a single slot's input buffer, in bytes
+        uint64_t _slot_buffer_size = 0;
+
+        // One contiguous, aligned allocation holding the input buffers of every
+        // slot back to back.  Slot n's buffer starts at n * _slot_buffer_size,
+        // so a group of merged slots is simply a larger window into it.
+        std::unique_ptr<uint8_t, decltype(&free)> _slot_buffers;
+
+        // The role's output buffers, laid out the same way as the input buffers
+        std::unique_ptr<uint8_t, decltype(&free)> _slot_output_buffers;
+
+        // Role input buffer views for each slot
         vector<SlotInputConfig*> _slot_config;
 
         // And a register map for DMA registers
@@ -114,14 +136,48 @@ namespace Catapult
 
         sc_core::sc_event _dma_doorbell_write;
 
+        // slots the role has finished with, and the number of output bytes each
+        // produced, waiting for the DMA thread to write them back to the host.
+        std::deque<std::pair<unsigned int, uint64_t>> _completions;
+        sc_core::sc_event _role_completion;
+
+        // slots whose input has been taken from their doorbell and whose output
+        // isn't done yet.  Their group layout must not change under them.
+        std::vector<bool> _slot_active;
+
+        // per-slot lifecycle timing and byte counts
+        SlotStatistics _stats;
+
         void init_dma_registers(void);
+        void init_stats_registers(void);
 
         bool write_doorbell_register(RegisterT* reg,
                                      unsigned int slot_number,
                                      DoorbellType type,
                                      uint64_t new_value);
 
+        bool write_merged_slots_register(RegisterT* reg, uint64_t new_value);
+
+        // The DMA engine, as a thread or as a method process stepped with
+        // next_trigger().  Both run the stages below and wait a delta cycle
+        // between the stages of a transfer.
         void dma_thread();
+        void dma_method();
+
+        // where dma_method() is between the stages of a transfer.  The thread
+        // keeps this on its stack.
+        enum class DmaStep { scan, input_read, input_cleared, output_written, output_done };
+        DmaStep _dma_step = DmaStep::scan;
+
+        // the slot being read (and the doorbell scan hint), the number of bytes
+        // being read, and the slot being written back
+        unsigned int _dma_input_slot = 0;
+        uint64_t _dma_input_cb = 0;
+        unsigned int _dma_output_slot = 0;
+
+        // the done status of the slot being written back.  The DMA reads it
+        // from here.
+        uint64_t _dma_output_blocks = 0;
 
         static constexpr uint64_t get_doorbell_regnum(int slot, DoorbellType type)
         {
@@ -161,19 +217,97 @@ namespace Catapult
 
         bool find_next_full_doorbell(unsigned int& hint, uint64_t& db_value);
 
+        // scans for a full doorbell, starting after slot_number, and starts
+        // reading the slot's input from the host.  Returns false if no doorbell
+        // is full.  A doorbell asking for more than the slot holds is cleared
+        // and dropped, leaving read_cb at 0.
+        bool start_slot_input(unsigned int& slot_number, uint64_t& read_cb);
+        void clear_slot_input(unsigned int slot_number);
+        void finish_slot_input(unsigned int slot_number, uint64_t read_cb);
+
+        // writes a completed slot's output to the host, then its done status.
+        // start_slot_output() returns false if the output is dropped.
+        bool start_slot_output(unsigned int slot_number, uint64_t output_length);
+        void finish_slot_output(unsigned int slot_number);
+        void complete_slot_output(unsigned int slot_number);
+
+        // The number of consecutive slots which act as a single buffer with a
+        // single doorbell.  Always at least 1.
+        unsigned int get_merged_slot_count()
+        {
+            uint64_t m = _dma_regs[merged_slots_regnum];
+            return (m == 0) ? 1 : static_cast<unsigned int>(m);
+        }
+
+        // true if slot_number is the first slot of a merged slot group (every
+        // slot is a group head when merging is disabled)
+        bool is_slot_group_head(unsigned int slot_number)
+        {
+            return (slot_number % get_merged_slot_count()) == 0;
+        }
+
+        uint8_t* get_slot_buffer(unsigned int slot_number)
+        {
+            return _slot_buffers.get() + (uint64_t(slot_number) * _slot_buffer_size);
+        }
+
+        // the usable buffer size of a slot, taking merging into account.
+        uint64_t get_slot_group_buffer_size()
+        {
+            return _slot_buffer_size * get_merged_slot_count();
+        }
+
+        void update_slot_config(unsigned int slot_number);
+
+        static const uint64_t merged_slots_regnum = 0x20004;
+
     public:
 
-        SlotsEngine(sc_module_name module_name, unsigned int slot_count, CatapultShellInterface* shell);
+        // use_method runs the DMA engine as a method process, which saves the
+        // thread switches around each transfer.  The shell's DMA must then
+        // never wait().
+        SlotsEngine(sc_module_name module_name,
+                    unsigned int slot_count,
+                    CatapultShellInterface* shell,
+                    uint64_t slot_buffer_size = default_slot_buffer_size,
+                    bool use_method = false);
 
         void reset(void);
 
-        // attaches an input buffer and an event to a slot.
+        // attaches an input buffer view and an event to a slot.  The engine fills
+        // in the view's buffer pointer and size.
         void set_slot_config(unsigned int slot_number, SlotInputConfig* config);
 
+        uint64_t get_slot_buffer_size() const { return _slot_buffer_size; }
+
+        // the role's output buffer for a slot.  It is the same size as the
+        // slot's input view (so it covers the group when slots are merged).
+        uint8_t* get_slot_output_buffer(unsigned int slot_number)
+        {
+            return _slot_output_buffers.get() + (uint64_t(slot_number) * _slot_buffer_size);
+        }
+
+        // called by the role when it has finished with a slot's input and has
+        // written output_length bytes into the slot's output buffer.  The DMA
+        // thread copies the output to the slot's output address and sets the
+        // done status in the slot's control buffer.
+        void complete_slot(unsigned int slot_number, uint64_t output_length);
+
         // methods for reading and writing the slot DMA registers, if slots is enabled.
         uint64_t read_dma_register(uint32_t index, string& out_message);
         void write_dma_register(uint32_t index, uint64_t value, std::string& out_message);
 
         void print();
+
+        const SlotStatistics& get_statistics() const { return _stats; }
+
+        // prints the slot statistics report
+        virtual void end_of_simulation() override;
+
+        // saves and restores the DMA registers, slot buffers and pending
+        // completions.  Input already handed to the role isn't saved, so
+        // checkpoint with the slots idle.
+        virtual void checkpoint_save(checkpoint_writer& ck) override;
+        virtual void checkpoint_restore(checkpoint_reader& ck) override;
     };
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "streaming_role.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+using namespace Catapult;
+using namespace Role;
+
+StreamingRole::StreamingRole(sc_module_name name,
+                             CatapultShellInterface* shell,
+                             const StreamingRoleOptions& options) :
+    sc_module(name),
+    _shell(shell),
+    _options(options),
+    _slots_engine("SlotsEngine", options.slot_count, shell, options.slot_buffer_size,
+                  options.dma_method),
+    _inputs(options.slot_count),
+    _busy(options.slot_count, false)
+{
+    if (options.worker_count == 0)
+    {
+        throw logic_error("worker_count must be at least 1");
+    }
+
+    for (unsigned int i = 0; i < options.slot_count; i += 1)
+    {
+        _inputs[i].signal = &_input_ready;
+        _slots_engine.set_slot_config(i, &_inputs[i]);
+    }
+
+    for (unsigned int i = 0; i < options.worker_count; i += 1)
+    {
+        ostringstream worker_name;
+        worker_name << "worker" << i;
+
+        sc_spawn(sc_bind(&StreamingRole::worker_thread, this, i), worker_name.str().c_str());
+    }
+}
+
+void StreamingRole::reset()
+{
+    // the engine reset clears every slot's input view.  Slots claimed by a
+    // worker stay busy until the worker completes them.
+    _slots_engine.reset();
+}
+
+void StreamingRole::print()
+{
+    _slots_engine.print();
+}
+
+// scans for a slot which has input and isn't being processed, starting after
+// hint.  On success marks the slot busy, and sets hint and slot_number to it.
+bool StreamingRole::claim_next_slot(unsigned int& hint, unsigned int& slot_number)
+{
+    unsigned int slot_count = static_cast<unsigned int>(_inputs.size());
+
+    for (unsigned int n = 1; n <= slot_count; n += 1)
+    {
+        unsigned int i = (hint + n) % slot_count;
+
+        if (_inputs[i].valid_length != 0 && _busy[i] == false)
+        {
+            _busy[i] = true;
+            hint = i;
+            slot_number = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void StreamingRole::worker_thread(unsigned int worker_number)
+{
+    unsigned int hint = static_cast<unsigned int>(_inputs.size()) - 1;
+
+    while (true)
+    {
+        unsigned int slot_number;
+
+        if (claim_next_slot(hint, slot_number) == false)
+        {
+            wait(_input_ready);
+            continue;
+        }
+
+        SlotInputConfig& input = _inputs[slot_number];
+
+        SlotBuffers buffers;
+        buffers.slot_number  = slot_number;
+        buffers.input        = input.buffer;
+        buffers.input_length = input.valid_length;
+        buffers.output       = _slots_engine.get_slot_output_buffer(slot_number);
+        buffers.output_size  = input.buffer_size;
+
+        cout << "StreamingRole: worker " << worker_number << " processing slot " << slot_number
+             << " (" << buffers.input_length << "B)" << endl;
+
+        uint64_t output_length = process_slot(buffers);
+
+        // release the input before completing, so the slot can be refilled as
+        // soon as the host sees it done.
+        input.clear();
+        _busy[slot_number] = false;
+
+        _slots_engine.complete_slot(slot_number, output_length);
+    }
+}
+
+bool StreamingRole::read_soft_register(uint64_t address, uint64_t& value)
+{
+    auto reg_type = CatapultDevice::get_address_type(address);
+
+    uint32_t reg_index = static_cast<uint32_t>((address & CatapultDevice::soft_reg_addr_num_mask) >> CatapultDevice::soft_reg_addr_num_shift);
+
+    if (reg_type == CatapultRegisterType::soft)
+    {
+        if (read_role_register(reg_index, value) == false)
+        {
+            cout << "StreamingRole: read of unimplemented soft register " << out_hex(reg_index, 6, false) << endl;
+            value = 0;
+        }
+
+        return true;
+    }
+    else // regtype is DMA
+    {
+        string message;
+        cout << "StreamingRole: r " << out_hex(address, 6, false)
+             << " dma register " << out_hex(reg_index, 6, false)
+             << " => ";
+        value = _slots_engine.read_dma_register(reg_index, message);
+        cout << out_hex(value, 16, true)
+             << " [" << message << "]" << endl;
+
+        return true;
+    }
+}
+
+bool StreamingRole::write_soft_register(uint64_t address, uint64_t value)
+{
+    auto reg_type = CatapultDevice::get_address_type(address);
+    uint32_t reg_index = static_cast<uint32_t>((address & CatapultDevice::soft_reg_addr_num_mask) >> CatapultDevice::soft_reg_addr_num_shift);
+
+    if (reg_type == CatapultRegisterType::soft)
+    {
+        if (write_role_register(reg_index, value) == false)
+        {
+            cout << "StreamingRole: write of unimplemented soft register " << out_hex(reg_index, 6, false) << endl;
+        }
+    }
+    else // regtype is DMA
+    {
+        cout << "StreamingRole: w " << out_hex(address, 6, false)
+             << " dma register " << out_hex(reg_index, 6, false)
+             << " <= " << out_hex(value, 16, true);
+
+        string message;
+        _slots_engine.write_dma_register(reg_index, value, message);
+
+        cout << " [" << message << "]" << endl;
+    }
+
+    return true;
+}
@@ -0,0 +1,116 @@
+/*
+ * Base class for roles which consume slot input and produce slot output
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+
+#include "systemc.h"
+
+#include "catapult_device.h"
+#include "slots_dma.h"
+
+namespace Role
+{
+    // The buffers of one slot, as handed to StreamingRole::process_slot.  The
+    // input holds the data the host DMA'd into the slot.  The output buffer
+    // is the same size as the input buffer, and whatever the role writes to
+    // it is DMA'd back to the slot's output address on completion.
+    struct SlotBuffers
+    {
+        unsigned int   slot_number = 0;
+
+        const uint8_t* input = nullptr;
+        uint64_t       input_length = 0;
+
+        uint8_t*       output = nullptr;
+        uint64_t       output_size = 0;
+    };
+
+    struct StreamingRoleOptions
+    {
+        unsigned int slot_count = Catapult::SlotsEngine::maximum_slot_count;
+        uint64_t slot_buffer_size = Catapult::SlotsEngine::default_slot_buffer_size;
+
+        // the number of SystemC processes calling process_slot.  With more than
+        // one worker, slots are processed in parallel (in simulated time) and
+        // can complete out of order.
+        unsigned int worker_count = 1;
+
+        // runs the slots engine's DMA as a method process instead of a thread.
+        // Only for shells whose DMA targets never wait() in b_transport, so
+        // not over remote-port.
+        bool dma_method = false;
+    };
+
+    // A role which owns a slots engine and processes each full slot as it
+    // arrives.  Derived roles implement process_slot(), and optionally the
+    // role register handlers for their soft registers.  DMA register accesses
+    // are forwarded to the slots engine.
+    class StreamingRole : public sc_core::sc_module, public Catapult::CatapultRoleInterface
+    {
+    protected:
+        Catapult::CatapultShellInterface* _shell;
+        StreamingRoleOptions _options;
+        Catapult::SlotsEngine _slots_engine;
+
+        // processes one slot's input and returns the number of bytes written to
+        // the output buffer.  Runs in a worker thread, so it may wait().
+        virtual uint64_t process_slot(const SlotBuffers& buffers) = 0;
+
+        // handlers for soft registers, by register index.  They return false
+        // if the register isn't implemented.
+        virtual bool  read_role_register(uint32_t index, uint64_t& value) { return false; }
+        virtual bool write_role_register(uint32_t index, uint64_t  value) { return false; }
+
+    private:
+        // the engine's view of each slot's input.  Every view signals
+        // _input_ready, and the workers scan for slots with valid data.
+        std::vector<Catapult::SlotInputConfig> _inputs;
+
+        // slots currently claimed by a worker
+        std::vector<bool> _busy;
+
+        sc_core::sc_event _input_ready;
+
+        bool claim_next_slot(unsigned int& hint, unsigned int& slot_number);
+
+        void worker_thread(unsigned int worker_number);
+
+    public:
+        StreamingRole(sc_core::sc_module_name name,
+                      Catapult::CatapultShellInterface* shell,
+                      const StreamingRoleOptions& options);
+
+        virtual void reset() override;
+        virtual void print() override;
+        virtual bool    read_soft_register(uint64_t address, uint64_t& value) override;
+        virtual bool   write_soft_register(uint64_t address, uint64_t  value) override;
+    };
+}
@@ -0,0 +1,209 @@
+/*
+ * Test of the slots DMA engine's merged slot count guard
+ *
+ * Changes the merged slot count while the role is working on a slot, and
+ * checks that the engine drops the write, then takes it once the slot is
+ * done.  Exits non-zero on failure.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "systemc.h"
+
+#include "streaming_role.h"
+
+using namespace sc_core;
+using namespace std;
+
+using namespace Catapult;
+using namespace Role;
+
+namespace
+{
+    const uint64_t merged_slots_regnum = 0x20004;
+
+    uint64_t address_regnum(unsigned int slot, SlotsEngine::AddressType type)
+    {
+        return 0x20200ull | (uint64_t(slot) << 2) | uint64_t(type);
+    }
+
+    uint64_t full_doorbell_regnum(unsigned int slot)
+    {
+        return 0x30000ull | (uint64_t(slot) << 9);
+    }
+
+    // a shell whose host memory is the test's own memory, so DMA addresses
+    // are plain pointers
+    struct LoopbackShell : public CatapultShellInterface
+    {
+        virtual void dma_read_from_host(uint64_t source_address, void* destination_address, uint64_t transfer_cb) override
+        {
+            memcpy(destination_address, reinterpret_cast<void*>(source_address), transfer_cb);
+        }
+
+        virtual void dma_write_to_host(void* source_address, uint64_t destination_address, uint64_t transfer_cb) override
+        {
+            memcpy(reinterpret_cast<void*>(destination_address), source_address, transfer_cb);
+        }
+    };
+
+    // echoes each slot after a microsecond of work
+    class SlowEchoRole : public StreamingRole
+    {
+    public:
+        bool working = false;
+
+        SlowEchoRole(sc_module_name name, CatapultShellInterface* shell, const StreamingRoleOptions& options) :
+            StreamingRole(name, shell, options)
+        {
+        }
+
+        SlotsEngine& engine() { return _slots_engine; }
+
+    protected:
+        virtual uint64_t process_slot(const SlotBuffers& buffers) override
+        {
+            working = true;
+            wait(1, SC_US);
+            memcpy(buffers.output, buffers.input, buffers.input_length);
+            working = false;
+            return buffers.input_length;
+        }
+    };
+
+    class MergedSlotsTest : public sc_module
+    {
+        SC_HAS_PROCESS(MergedSlotsTest);
+
+    public:
+        unsigned int failures = 0;
+
+        MergedSlotsTest(sc_module_name name, SlowEchoRole& role) :
+            sc_module(name),
+            _role(role),
+            _input(256),
+            _output(256, 0)
+        {
+            for (size_t i = 0; i < _input.size(); i += 1)
+            {
+                _input[i] = static_cast<uint8_t>(i);
+            }
+            memset(&_control, 0, sizeof(_control));
+
+            SC_THREAD(run);
+        }
+
+    private:
+        SlowEchoRole& _role;
+        vector<uint8_t> _input;
+        vector<uint8_t> _output;
+        DMA_ISO_CONTROL_RESULT_COMBINED _control;
+
+        void check(const char* what, bool ok)
+        {
+            cout << "test-slots-dma: " << (ok ? "PASS " : "FAIL ") << what << endl;
+            if (ok == false)
+            {
+                failures += 1;
+            }
+        }
+
+        // writes a DMA register and returns true if the engine took the write
+        bool write(uint64_t regnum, uint64_t value)
+        {
+            string message;
+
+            _role.engine().write_dma_register(regnum, value, message);
+            return message.compare(0, 2, "OK") == 0;
+        }
+
+        uint64_t read(uint64_t regnum)
+        {
+            string message;
+
+            return _role.engine().read_dma_register(regnum, message);
+        }
+
+        void run()
+        {
+            write(address_regnum(0, SlotsEngine::input),   reinterpret_cast<uint64_t>(_input.data()));
+            write(address_regnum(0, SlotsEngine::output),  reinterpret_cast<uint64_t>(_output.data()));
+            write(address_regnum(0, SlotsEngine::control), reinterpret_cast<uint64_t>(&_control));
+            write(full_doorbell_regnum(0), _input.size() / SlotsEngine::dma_block_size);
+
+            for (unsigned int i = 0; i < 100 && _role.working == false; i += 1)
+            {
+                wait(10, SC_NS);
+            }
+            check("role is working on slot 0", _role.working);
+
+            check("merged slot count change dropped during role work", write(merged_slots_regnum, 2) == false);
+            check("merged slot count unchanged", read(merged_slots_regnum) == 0);
+
+            wait(2, SC_US);
+            check("slot 0 done", _control.control_buffer.done_status != 0);
+            check("slot 0 output echoed", _output == _input);
+
+            check("merged slot count change taken when idle", write(merged_slots_regnum, 2));
+            check("merged slot count changed", read(merged_slots_regnum) == 2);
+
+            bool threw = false;
+            try
+            {
+                _role.engine().complete_slot(1, 0);
+            }
+            catch (const out_of_range&)
+            {
+                threw = true;
+            }
+            check("completion of a merged slot rejected", threw);
+
+            sc_stop();
+        }
+    };
+}
+
+int sc_main(int argc, char* argv[])
+{
+    LoopbackShell shell;
+    StreamingRoleOptions options;
+
+    options.slot_count = 8;
+    options.slot_buffer_size = 4096;
+
+    SlowEchoRole role("role", &shell, options);
+    MergedSlotsTest test("test", role);
+
+    sc_start();
+
+    cout << "test-slots-dma: " << (test.failures ? "FAILED" : "PASSED") << endl;
+    return test.failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
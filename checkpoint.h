@@ -0,0 +1,456 @@
+/*
+ * Checkpoint and restore of model state.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "systemc.h"
+#include "tlm.h"
+
+/*
+ * A checkpoint is a file of named sections.  Section data is page aligned
+ * so a restore can mmap the file and hand large sections, e.g. memory
+ * contents, straight to a model without reading them.  The section table
+ * follows the data:
+ *
+ *   data, each section aligned to CHECKPOINT_ALIGN
+ *   table: struct checkpoint_section[nr_sections]
+ *   footer: struct checkpoint_footer
+ *
+ * All values are in host byte order.
+ */
+#define CHECKPOINT_MAGIC	"SCCKPT01"
+#define CHECKPOINT_ALIGN	4096
+
+struct checkpoint_section {
+	char name[112];
+	uint64_t offset;
+	uint64_t length;
+};
+
+struct checkpoint_footer {
+	uint64_t table_offset;
+	uint64_t nr_sections;
+	char magic[16];
+};
+
+class checkpoint_writer
+{
+public:
+	checkpoint_writer(const char *path)
+		: offset(0)
+	{
+		fp = fopen(path, "wb");
+		if (!fp) {
+			perror(path);
+		}
+	}
+
+	~checkpoint_writer()
+	{
+		finish();
+	}
+
+	bool ok(void) { return fp != NULL; }
+
+	void add(const std::string &name, const void *data, uint64_t len)
+	{
+		struct checkpoint_section s = {};
+
+		if (!fp) {
+			return;
+		}
+		if (name.size() >= sizeof s.name) {
+			SC_REPORT_ERROR("checkpoint", "section name too long");
+			return;
+		}
+
+		pad();
+		strcpy(s.name, name.c_str());
+		s.offset = offset;
+		s.length = len;
+		sections.push_back(s);
+
+		fwrite(data, 1, len, fp);
+		offset += len;
+	}
+
+	template<class T>
+	void add(const std::string &name, const T &v)
+	{
+		add(name, &v, sizeof v);
+	}
+
+	template<class T>
+	void add(const std::string &name, const std::vector<T> &v)
+	{
+		add(name, v.data(), v.size() * sizeof(T));
+	}
+
+	/* Writes the section table.  Returns false if anything failed.  */
+	bool finish(void)
+	{
+		struct checkpoint_footer f = {};
+		bool err;
+
+		if (!fp) {
+			return false;
+		}
+
+		pad();
+		f.table_offset = offset;
+		f.nr_sections = sections.size();
+		memcpy(f.magic, CHECKPOINT_MAGIC, 8);
+		fwrite(sections.data(), sizeof sections[0], sections.size(), fp);
+		fwrite(&f, sizeof f, 1, fp);
+
+		err = ferror(fp);
+		fclose(fp);
+		fp = NULL;
+		return !err;
+	}
+
+private:
+	FILE *fp;
+	uint64_t offset;
+	std::vector<struct checkpoint_section> sections;
+
+	void pad(void)
+	{
+		static const char zeros[CHECKPOINT_ALIGN] = {};
+		uint64_t n = -offset & (CHECKPOINT_ALIGN - 1);
+
+		fwrite(zeros, 1, n, fp);
+		offset += n;
+	}
+};
+
+class checkpoint_reader
+{
+public:
+	/*
+	 * Maps the checkpoint privately, so pages handed out by map() are
+	 * copied on write and the file itself is never modified.
+	 */
+	checkpoint_reader(const char *path)
+		: base(NULL), size(0)
+	{
+		struct checkpoint_footer f;
+		struct checkpoint_section *table;
+		struct stat st;
+		uint64_t i;
+		int fd;
+
+		fd = open(path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) < 0 ||
+		    st.st_size < (off_t) sizeof f) {
+			perror(path);
+			if (fd >= 0) {
+				close(fd);
+			}
+			return;
+		}
+
+		size = st.st_size;
+		base = (unsigned char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (base == MAP_FAILED) {
+			perror(path);
+			base = NULL;
+			return;
+		}
+
+		memcpy(&f, base + size - sizeof f, sizeof f);
+		if (memcmp(f.magic, CHECKPOINT_MAGIC, 8) ||
+		    f.table_offset + f.nr_sections * sizeof *table >
+					size - sizeof f) {
+			SC_REPORT_ERROR("checkpoint", "not a checkpoint file");
+			munmap(base, size);
+			base = NULL;
+			return;
+		}
+
+		table = (struct checkpoint_section *) (base + f.table_offset);
+		for (i = 0; i < f.nr_sections; i++) {
+			if (table[i].offset + table[i].length <= f.table_offset) {
+				sections[table[i].name] = table[i];
+			}
+		}
+	}
+
+	~checkpoint_reader()
+	{
+		if (base) {
+			munmap(base, size);
+		}
+	}
+
+	bool ok(void) { return base != NULL; }
+
+	/*
+	 * Returns the section's data, page aligned and writable (copy on
+	 * write), or NULL if the section is missing.  The mapping lives as
+	 * long as the reader, so a model may keep using it as its storage.
+	 */
+	void *map(const std::string &name, uint64_t *len)
+	{
+		std::map<std::string, struct checkpoint_section>::iterator it;
+
+		it = sections.find(name);
+		if (it == sections.end()) {
+			return NULL;
+		}
+		*len = it->second.length;
+		return base + it->second.offset;
+	}
+
+	/* Copies a section of exactly len bytes into data.  */
+	bool get(const std::string &name, void *data, uint64_t len)
+	{
+		uint64_t slen;
+		void *p = map(name, &slen);
+
+		if (!p || slen != len) {
+			printf("checkpoint: section %s missing or resized\n",
+				name.c_str());
+			return false;
+		}
+		memcpy(data, p, len);
+		return true;
+	}
+
+	template<class T>
+	bool get(const std::string &name, T &v)
+	{
+		return get(name, &v, sizeof v);
+	}
+
+	template<class T>
+	bool get(const std::string &name, std::vector<T> &v)
+	{
+		uint64_t len;
+		void *p = map(name, &len);
+
+		if (!p || len % sizeof(T)) {
+			return false;
+		}
+		v.resize(len / sizeof(T));
+		memcpy((void *) v.data(), p, len);
+		return true;
+	}
+
+private:
+	unsigned char *base;
+	uint64_t size;
+	std::map<std::string, struct checkpoint_section> sections;
+};
+
+/*
+ * Models with state implement this.  Constructing the object registers it.
+ *
+ * checkpoint_restore() runs before the simulation starts and should only
+ * restore data.  checkpoint_resume() then runs in a method process at the
+ * start of the simulation, and is where a model drives its outputs and
+ * notifies its threads from the restored state.
+ */
+class checkpointable
+{
+public:
+	checkpointable() { registry().push_back(this); }
+	virtual ~checkpointable()
+	{
+		std::vector<checkpointable *> &r = registry();
+
+		r.erase(std::remove(r.begin(), r.end(), this), r.end());
+	}
+
+	virtual void checkpoint_save(checkpoint_writer &ck) = 0;
+	virtual void checkpoint_restore(checkpoint_reader &ck) = 0;
+	virtual void checkpoint_resume(void) {}
+
+	static std::vector<checkpointable *> &registry(void)
+	{
+		static std::vector<checkpointable *> r;
+		return r;
+	}
+};
+
+/* Saves every registered model.  Call with the simulation stopped.  */
+static inline bool checkpoint_save_all(const char *path)
+{
+	checkpoint_writer ck(path);
+
+	if (!ck.ok()) {
+		return false;
+	}
+	for (checkpointable *c : checkpointable::registry()) {
+		c->checkpoint_save(ck);
+	}
+	return ck.finish();
+}
+
+/*
+ * Restores every registered model.  Call after elaboration and before
+ * sc_start().  The checkpoint stays mapped for the rest of the run.
+ */
+static inline bool checkpoint_restore_all(const char *path)
+{
+	static checkpoint_reader *ck;
+	sc_core::sc_spawn_options opts;
+
+	ck = new checkpoint_reader(path);
+	if (!ck->ok()) {
+		delete ck;
+		ck = NULL;
+		return false;
+	}
+	for (checkpointable *c : checkpointable::registry()) {
+		c->checkpoint_restore(*ck);
+	}
+
+	opts.spawn_method();
+	sc_core::sc_spawn([]() {
+			for (checkpointable *c : checkpointable::registry()) {
+				c->checkpoint_resume();
+			}
+		}, "checkpoint-resume", &opts);
+	return true;
+}
+
+/*
+ * Saves and restores a memory model we can't change, e.g. the one from
+ * libsystemctlm-soc, through its target interface.  Uses DMI when the
+ * target grants it, debug transactions otherwise.
+ */
+class tlm_memory_checkpoint
+: public checkpointable
+{
+public:
+	tlm_memory_checkpoint(const std::string &name,
+			tlm::tlm_fw_transport_if<> &fw, uint64_t size)
+		: name(name), fw(fw), size(size)
+	{
+	}
+
+	void checkpoint_save(checkpoint_writer &ck)
+	{
+		std::vector<unsigned char> buf;
+		unsigned char *p = dmi_ptr();
+
+		if (!p) {
+			buf.resize(size);
+			access(tlm::TLM_READ_COMMAND, buf.data());
+			p = buf.data();
+		}
+		ck.add(name + ".data", p, size);
+	}
+
+	void checkpoint_restore(checkpoint_reader &ck)
+	{
+		unsigned char *p = dmi_ptr();
+		uint64_t len, page, mapped = 0;
+		void *data = ck.map(name + ".data", &len);
+
+		if (!data || len != size) {
+			printf("checkpoint: no contents for %s\n", name.c_str());
+			return;
+		}
+		if (!p) {
+			access(tlm::TLM_WRITE_COMMAND, (unsigned char *) data);
+			return;
+		}
+
+		/*
+		 * As sparse_memory does, move the checkpoint's private mapping
+		 * over the memory, so pages are only read from the file when
+		 * the guest touches them.  That takes whole pages, so storage
+		 * that isn't page aligned and the tail of the last page are
+		 * copied instead.
+		 */
+		page = sysconf(_SC_PAGESIZE);
+		if (((uintptr_t) p | (uintptr_t) data) % page == 0) {
+			mapped = size - size % page;
+		}
+		if (mapped && mremap(data, mapped, mapped,
+					MREMAP_MAYMOVE | MREMAP_FIXED,
+					p) == MAP_FAILED) {
+			mapped = 0;
+		}
+		memcpy(p + mapped, (unsigned char *) data + mapped,
+			size - mapped);
+	}
+
+private:
+	std::string name;
+	tlm::tlm_fw_transport_if<> &fw;
+	uint64_t size;
+
+	unsigned char *dmi_ptr(void)
+	{
+		tlm::tlm_generic_payload gp;
+		tlm::tlm_dmi dmi;
+
+		gp.set_command(tlm::TLM_READ_COMMAND);
+		gp.set_address(0);
+		if (fw.get_direct_mem_ptr(gp, dmi) &&
+		    dmi.get_start_address() == 0 &&
+		    dmi.get_end_address() >= size - 1 &&
+		    dmi.is_read_allowed() && dmi.is_write_allowed()) {
+			return dmi.get_dmi_ptr();
+		}
+		return NULL;
+	}
+
+	void access(tlm::tlm_command cmd, unsigned char *data)
+	{
+		tlm::tlm_generic_payload gp;
+		uint64_t off;
+
+		for (off = 0; off < size; off += CHECKPOINT_ALIGN) {
+			unsigned int len = std::min<uint64_t>(size - off,
+							CHECKPOINT_ALIGN);
+
+			gp.set_command(cmd);
+			gp.set_address(off);
+			gp.set_data_ptr(data + off);
+			gp.set_data_length(len);
+			gp.set_streaming_width(len);
+			fw.transport_dbg(gp);
+		}
+	}
+};
+#endif
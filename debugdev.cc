@@ -38,7 +38,7 @@ using namespace std;
 #include <time.h>
 
 debugdev::debugdev(sc_module_name name)
-	: sc_module(name), socket("socket")
+	: sc_module(name), socket("socket"), restored_irq(false)
 {
 	socket.register_b_transport(this, &debugdev::b_transport);
 	socket.register_transport_dbg(this, &debugdev::transport_dbg);
@@ -135,3 +135,20 @@ unsigned int debugdev::transport_dbg(tlm::tlm_generic_payload& trans)
 	unsigned int len = trans.get_data_length();
 	return len;
 }
+
+void debugdev::checkpoint_save(checkpoint_writer &ck)
+{
+	bool v = irq.read();
+
+	ck.add(string(name()) + ".irq", v);
+}
+
+void debugdev::checkpoint_restore(checkpoint_reader &ck)
+{
+	ck.get(string(name()) + ".irq", restored_irq);
+}
+
+void debugdev::checkpoint_resume(void)
+{
+	irq.write(restored_irq);
+}
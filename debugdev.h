@@ -21,8 +21,10 @@
  * THE SOFTWARE.
  */
 
+#include "checkpoint.h"
+
 class debugdev
-: public sc_core::sc_module
+: public sc_core::sc_module, public checkpointable
 {
 public:
 	tlm_utils::simple_target_socket<debugdev> socket;
@@ -32,4 +34,11 @@ public:
 	virtual void b_transport(tlm::tlm_generic_payload& trans,
 					sc_time& delay);
 	virtual unsigned int transport_dbg(tlm::tlm_generic_payload& trans);
+
+	void checkpoint_save(checkpoint_writer &ck);
+	void checkpoint_restore(checkpoint_reader &ck);
+	void checkpoint_resume(void);
+private:
+	/* The irq level to drive when resuming from a checkpoint.  */
+	bool restored_irq;
 };
@@ -36,22 +36,26 @@ using namespace std;
 #include "demo-dma.h"
 #include <sys/types.h>
 
-demodma::demodma(sc_module_name name)
-	: sc_module(name), tgt_socket("tgt-socket")
+demodma::demodma(sc_module_name name, bool use_method)
+	: sc_module(name), tgt_socket("tgt-socket"), dma_delayed(false)
 {
 	tgt_socket.register_b_transport(this, &demodma::b_transport);
 	memset(&regs, 0, sizeof regs);
 
-	SC_THREAD(do_dma_copy);
+	if (use_method) {
+		SC_METHOD(dma_copy_method);
+	} else {
+		SC_THREAD(do_dma_copy);
+	}
 	dont_initialize();
 	sensitive << ev_dma_copy;
 }
 
 void demodma::do_dma_trans(tlm::tlm_command cmd, unsigned char *buf,
-				sc_dt::uint64 addr, sc_dt::uint64 len)
+				sc_dt::uint64 addr, sc_dt::uint64 len,
+				sc_time &delay)
 {
 	tlm::tlm_generic_payload tr;
-	sc_time delay = SC_ZERO_TIME;
 
 	tr.set_command(cmd);
 	tr.set_address(addr);
@@ -88,38 +92,116 @@ void demodma::update_irqs(void)
 	irq.write(regs.ctrl & DEMODMA_CTRL_DONE);
 }
 
-void demodma::do_dma_copy(void)
+/*
+ * Copies one burst, if running.  Returns true when the transfer has
+ * completed, false if the engine should delay before the next burst.
+ */
+bool demodma::dma_copy_burst(void)
 {
 	unsigned char buf[32];
 
+	if (regs.len > 0 && regs.ctrl & DEMODMA_CTRL_RUN) {
+		unsigned int tlen = regs.len > sizeof buf ? sizeof buf : regs.len;
+		sc_time delay = qk.get_local_time();
+
+		do_dma_trans(tlm::TLM_READ_COMMAND, buf, regs.src_addr, tlen,
+				delay);
+		do_dma_trans(tlm::TLM_WRITE_COMMAND, buf, regs.dst_addr, tlen,
+				delay);
+		qk.set(delay);
+
+		regs.dst_addr += tlen;
+		regs.src_addr += tlen;
+		regs.len -= tlen;
+	}
+
+	if (regs.len == 0 && regs.ctrl & DEMODMA_CTRL_RUN) {
+		regs.ctrl &= ~DEMODMA_CTRL_RUN;
+		/* If the DMA was running, signal done.  */
+		regs.ctrl |= DEMODMA_CTRL_DONE;
+		return true;
+	}
+	return false;
+}
+
+void demodma::do_dma_copy(void)
+{
+	qk.reset();
 	while (true) {
 		if (!(regs.ctrl & DEMODMA_CTRL_RUN)) {
+			qk.sync();
 			wait(ev_dma_copy);
+			qk.reset();
 		}
 
-		if (regs.len > 0 && regs.ctrl & DEMODMA_CTRL_RUN) {
-			unsigned int tlen = regs.len > sizeof buf ? sizeof buf : regs.len;
-
-			do_dma_trans(tlm::TLM_READ_COMMAND, buf, regs.src_addr, tlen);
-			do_dma_trans(tlm::TLM_WRITE_COMMAND, buf, regs.dst_addr, tlen);
+		if (dma_copy_burst()) {
+			/* Signal done at the time the copy finished.  */
+			qk.sync();
+		} else {
+			// Artificial delay between bursts.
+			qk.inc(sc_time(1, SC_US));
+			if (qk.need_sync()) {
+				qk.sync();
+			}
+		}
+		update_irqs();
+	}
+}
 
-			regs.dst_addr += tlen;
-			regs.src_addr += tlen;
-			regs.len -= tlen;
+/*
+ * The same loop as do_dma_copy().  A sync becomes a next_trigger() for
+ * the local time, and dma_delayed says we are returning from one.
+ */
+void demodma::dma_copy_method(void)
+{
+	if (dma_delayed) {
+		dma_delayed = false;
+		update_irqs();
+		if (!(regs.ctrl & DEMODMA_CTRL_RUN)) {
+			next_trigger(ev_dma_copy);
+			return;
 		}
+	} else {
+		qk.reset();
+	}
 
-		if (regs.len == 0 && regs.ctrl & DEMODMA_CTRL_RUN) {
-			regs.ctrl &= ~DEMODMA_CTRL_RUN;
-			/* If the DMA was running, signal done.  */
-			regs.ctrl |= DEMODMA_CTRL_DONE;
-		} else {
+	while (true) {
+		if (!dma_copy_burst()) {
 			// Artificial delay between bursts.
-			wait(sc_time(1, SC_US));
+			qk.inc(sc_time(1, SC_US));
+		}
+
+		if (!(regs.ctrl & DEMODMA_CTRL_RUN) || qk.need_sync()) {
+			sc_time t = qk.get_local_time();
+
+			qk.reset();
+			dma_delayed = true;
+			next_trigger(t);
+			return;
 		}
 		update_irqs();
 	}
 }
 
+void demodma::checkpoint_save(checkpoint_writer &ck)
+{
+	ck.add(string(name()) + ".regs", regs);
+}
+
+void demodma::checkpoint_restore(checkpoint_reader &ck)
+{
+	ck.get(string(name()) + ".regs", regs);
+}
+
+/* The copy loop keeps all its state in regs, so it simply carries on.  */
+void demodma::checkpoint_resume(void)
+{
+	update_irqs();
+	if (regs.ctrl & DEMODMA_CTRL_RUN) {
+		ev_dma_copy.notify(SC_ZERO_TIME);
+	}
+}
+
 void demodma::b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
 {
 	tlm::tlm_command cmd = trans.get_command();
@@ -149,7 +231,8 @@ void demodma::b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
 		switch (addr) {
 			case 3:
 				// speculative read for testing inline path.
-				do_dma_trans(tlm::TLM_READ_COMMAND, buf, regs.src_addr, 4);
+				do_dma_trans(tlm::TLM_READ_COMMAND, buf, regs.src_addr, 4,
+						delay);
 				/* The dma copies after a usec.  */
 				ev_dma_copy.notify(delay + sc_time(1, SC_US));
 				break;
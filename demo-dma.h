@@ -21,6 +21,9 @@
  * THE SOFTWARE.
  */
 
+#include "tlm_utils/tlm_quantumkeeper.h"
+#include "checkpoint.h"
+
 enum {
 	DEMODMA_CTRL_RUN  = 1 << 0,
 	DEMODMA_CTRL_DONE = 1 << 1,
@@ -33,15 +36,26 @@ enum {
 };
 
 class demodma
-: public sc_core::sc_module
+: public sc_core::sc_module, public checkpointable
 {
 public:
 	tlm_utils::simple_initiator_socket<demodma> init_socket;
 	tlm_utils::simple_target_socket<demodma> tgt_socket;
 
 	sc_out<bool> irq;
-	demodma(sc_core::sc_module_name name);
+
+	/*
+	 * With use_method, the copy runs as a method process stepped with
+	 * next_trigger() instead of a thread, which saves a coroutine switch
+	 * per burst.  The targets it copies between must then never wait()
+	 * in b_transport.
+	 */
+	demodma(sc_core::sc_module_name name, bool use_method = false);
 	SC_HAS_PROCESS(demodma);
+
+	void checkpoint_save(checkpoint_writer &ck);
+	void checkpoint_restore(checkpoint_reader &ck);
+	void checkpoint_resume(void);
 private:
 	union {
 		struct {
@@ -56,9 +70,22 @@ private:
 	} regs;
 
 	sc_event ev_dma_copy;
+	/* The method variant is waiting for its local time to pass.  */
+	bool dma_delayed;
+
+	/*
+	 * The copy runs ahead of the kernel by the annotated delays of its
+	 * transactions plus the delay between bursts, and syncs once per
+	 * quantum and before raising the interrupt.
+	 */
+	tlm_utils::tlm_quantumkeeper qk;
+
 	void do_dma_trans(tlm::tlm_command cmd, unsigned char *buf,
-			sc_dt::uint64 addr, sc_dt::uint64 len);
+			sc_dt::uint64 addr, sc_dt::uint64 len,
+			sc_time &delay);
+	bool dma_copy_burst(void);
 	void do_dma_copy(void);
+	void dma_copy_method(void);
 	void update_irqs(void);
 
 	virtual void b_transport(tlm::tlm_generic_payload& trans,
@@ -0,0 +1,195 @@
+/*
+ * Benchmark for the thread and method variants of the demo DMA.
+ *
+ * Copies a buffer between two halves of a memory with a demodma of each
+ * kind, and reports the wall time per MiB copied and the number of bursts.
+ * The thread variant switches into its coroutine and back for every sync,
+ * the method variant runs on the kernel's own stack.  With the default
+ * quantum of 0 both sync after every burst.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include "systemc.h"
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace sc_dt;
+using namespace std;
+
+#include "demo-dma.h"
+
+/* A memory that never waits, so the method variant may call it.  */
+class bench_mem
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<bench_mem> socket;
+	uint64_t reads;
+
+	bench_mem(sc_module_name name, uint64_t size)
+		: sc_module(name), socket("socket"), reads(0), data(size)
+	{
+		socket.register_b_transport(this, &bench_mem::b_transport);
+	}
+
+private:
+	vector<unsigned char> data;
+
+	void b_transport(tlm::tlm_generic_payload &trans, sc_time &delay)
+	{
+		uint64_t addr = trans.get_address();
+		unsigned int len = trans.get_data_length();
+
+		if (addr + len > data.size()) {
+			trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
+			return;
+		}
+		if (trans.is_read()) {
+			memcpy(trans.get_data_ptr(), &data[addr], len);
+			reads++;
+		} else {
+			memcpy(&data[addr], trans.get_data_ptr(), len);
+		}
+		trans.set_response_status(tlm::TLM_OK_RESPONSE);
+	}
+};
+
+SC_MODULE(Top)
+{
+	SC_HAS_PROCESS(Top);
+	tlm_utils::simple_initiator_socket<Top> cpu[2];
+	demodma dma_thread;
+	demodma dma_method;
+	bench_mem mem_thread;
+	bench_mem mem_method;
+	sc_signal<bool> irq[2];
+
+	Top(sc_module_name name, uint64_t size, unsigned int rounds)
+		: sc_module(name),
+		  dma_thread("dma-thread", false),
+		  dma_method("dma-method", true),
+		  mem_thread("mem-thread", 2 * size),
+		  mem_method("mem-method", 2 * size),
+		  size(size),
+		  rounds(rounds)
+	{
+		cpu[0].bind(dma_thread.tgt_socket);
+		cpu[1].bind(dma_method.tgt_socket);
+		dma_thread.init_socket.bind(mem_thread.socket);
+		dma_method.init_socket.bind(mem_method.socket);
+		dma_thread.irq(irq[0]);
+		dma_method.irq(irq[1]);
+
+		SC_THREAD(run);
+	}
+
+private:
+	uint64_t size;
+	unsigned int rounds;
+
+	void write_reg(unsigned int i, uint64_t addr, uint32_t v)
+	{
+		tlm::tlm_generic_payload tr;
+		sc_time delay = SC_ZERO_TIME;
+
+		tr.set_command(tlm::TLM_WRITE_COMMAND);
+		tr.set_address(addr);
+		tr.set_data_ptr((unsigned char *) &v);
+		tr.set_data_length(4);
+		tr.set_streaming_width(4);
+		cpu[i]->b_transport(tr, delay);
+	}
+
+	void bench(unsigned int i, const char *variant, bench_mem &mem)
+	{
+		chrono::steady_clock::time_point start, end;
+		uint64_t reads = mem.reads;
+		uint64_t bursts;
+		double wall, mib;
+		unsigned int r;
+
+		start = chrono::steady_clock::now();
+		for (r = 0; r < rounds; r++) {
+			write_reg(i, 0x0, size);	/* dst */
+			write_reg(i, 0x4, 0);		/* src */
+			write_reg(i, 0x8, size);	/* len */
+			write_reg(i, 0xc, DEMODMA_CTRL_RUN);
+			wait(irq[i].posedge_event());
+
+			write_reg(i, 0xc, 0);
+			wait(irq[i].negedge_event());
+		}
+		end = chrono::steady_clock::now();
+
+		/* Each CTRL write also does a speculative read.  */
+		bursts = mem.reads - reads - 2 * rounds;
+		wall = chrono::duration<double>(end - start).count();
+		mib = (double) size * rounds / (1024 * 1024);
+
+		printf("%-6s: %.1f MiB in %" PRIu64 " bursts, %.3f s wall, "
+			"%.3f ms/MiB, %.0f ns/burst\n", variant, mib, bursts,
+			wall, wall * 1e3 / mib, wall * 1e9 / bursts);
+	}
+
+	void run(void)
+	{
+		bench(0, "thread", mem_thread);
+		bench(1, "method", mem_method);
+		sc_stop();
+	}
+};
+
+int sc_main(int argc, char *argv[])
+{
+	uint64_t size = 1024 * 1024;
+	unsigned int rounds = 4;
+	uint64_t quantum = 0;
+
+	if (argc > 1) {
+		size = strtoull(argv[1], NULL, 0) * 1024 * 1024;
+	}
+	if (argc > 2) {
+		rounds = strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		quantum = strtoull(argv[3], NULL, 0);
+	}
+	if (size == 0 || size > 0x40000000 || rounds == 0) {
+		printf("usage: %s [MiB] [rounds] [quantum-ns]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tlm_utils::tlm_quantumkeeper::set_global_quantum(
+			sc_time((double) quantum, SC_NS));
+
+	new Top("top", size, rounds);
+	sc_start();
+	return 0;
+}
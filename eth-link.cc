@@ -0,0 +1,212 @@
+/*
+ * Links between the Ethernet switch and the demos attached to it.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "eth-link.h"
+#include "rp-shm.h"
+
+#define ETH_LINK_ATTACH_TIMEOUT_MS	10000
+
+static const char eth_link_unix_prefix[] = "unix:";
+
+/* Fills in sun for a "unix:<path>" descriptor.  */
+static bool eth_link_unix_addr(const char *descr, struct sockaddr_un *sun)
+{
+	if (strncmp(descr, eth_link_unix_prefix,
+			sizeof eth_link_unix_prefix - 1) != 0) {
+		return false;
+	}
+	descr += sizeof eth_link_unix_prefix - 1;
+	if (strlen(descr) >= sizeof sun->sun_path) {
+		return false;
+	}
+
+	memset(sun, 0, sizeof *sun);
+	sun->sun_family = AF_UNIX;
+	strcpy(sun->sun_path, descr);
+	return true;
+}
+
+int eth_link_listen(const char *descr)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	if (!eth_link_unix_addr(descr, &sun)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	unlink(sun.sun_path);
+	if (bind(fd, (struct sockaddr *) &sun, sizeof sun) < 0 ||
+	    listen(fd, 16) < 0) {
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+eth_link::eth_link()
+	: fd(-1),
+	  shm(NULL)
+{
+}
+
+eth_link::~eth_link()
+{
+	close();
+}
+
+bool eth_link::connect(const char *descr)
+{
+	struct sockaddr_un sun;
+
+	if (rp_shm_descr_match(descr)) {
+		shm = rp_shm_open(descr, false, ETH_LINK_ATTACH_TIMEOUT_MS);
+		return shm != NULL;
+	}
+
+	if (!eth_link_unix_addr(descr, &sun)) {
+		errno = EINVAL;
+		return false;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return false;
+	}
+	if (::connect(fd, (struct sockaddr *) &sun, sizeof sun) < 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	return true;
+}
+
+bool eth_link::accept(int listen_fd)
+{
+	do {
+		fd = ::accept(listen_fd, NULL, NULL);
+	} while (fd < 0 && errno == EINTR);
+	return fd >= 0;
+}
+
+bool eth_link::create(const char *descr)
+{
+	shm = rp_shm_open(descr, true, 0);
+	return shm != NULL;
+}
+
+bool eth_link::read_full(void *buf, size_t len)
+{
+	unsigned char *p = (unsigned char *) buf;
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		if (shm) {
+			r = rp_shm_read(shm, p + done, len - done);
+		} else {
+			r = read(fd, p + done, len - done);
+		}
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		done += r;
+	}
+	return true;
+}
+
+bool eth_link::write_full(const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		if (shm) {
+			r = rp_shm_write(shm, p + done, len - done);
+		} else {
+			/* A vanished peer is an error, not a SIGPIPE.  */
+			r = ::send(fd, p + done, len - done, MSG_NOSIGNAL);
+		}
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		done += r;
+	}
+	return true;
+}
+
+bool eth_link::send(uint32_t type, uint64_t time_ps,
+			const void *data, uint32_t len)
+{
+	eth_link_msg msg = { type, len, time_ps };
+
+	if (fd < 0 && !shm) {
+		return false;
+	}
+	return write_full(&msg, sizeof msg) &&
+		(len == 0 || write_full(data, len));
+}
+
+bool eth_link::recv(eth_link_msg &msg, std::vector<unsigned char> &data)
+{
+	if (fd < 0 && !shm) {
+		return false;
+	}
+	/* Past a bogus length the stream is out of step, like a short read.  */
+	if (!read_full(&msg, sizeof msg) || msg.len > ETH_LINK_MAX_FRAME) {
+		return false;
+	}
+	data.resize(msg.len);
+	return msg.len == 0 || read_full(data.data(), msg.len);
+}
+
+void eth_link::close(void)
+{
+	if (shm) {
+		rp_shm_close(shm);
+		shm = NULL;
+	}
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+}
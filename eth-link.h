@@ -0,0 +1,94 @@
+/*
+ * Links between the Ethernet switch and the demos attached to it.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ETH_LINK_H__
+#define __ETH_LINK_H__
+
+#include <stdint.h>
+#include <vector>
+
+struct rp_shm;
+
+/*
+ * Messages on a link.  Times are simulated time in ps.  A node sends
+ * FRAME with the time the frame leaves it, and SYNC when it has sent all
+ * its frames before time.  The switch sends FRAME with the time the frame
+ * arrives at the node, and GRANT with the time up to which the node may
+ * run, having sent every frame that arrives before it.  BYE ends the link.
+ */
+enum {
+	ETH_LINK_FRAME = 1,
+	ETH_LINK_SYNC,
+	ETH_LINK_GRANT,
+	ETH_LINK_BYE,
+};
+
+/*
+ * Largest frame a link carries: a 9000 byte jumbo payload, the Ethernet
+ * header, a VLAN tag and the FCS.
+ */
+#define ETH_LINK_MAX_FRAME	(9000 + 14 + 4 + 4)
+
+struct eth_link_msg {
+	uint32_t type;
+	uint32_t len;
+	uint64_t time_ps;
+};
+
+/*
+ * A byte stream to a peer, over a Unix socket ("unix:<path>") or the
+ * shared memory transport of remote-port ("shm:/<name>").
+ */
+class eth_link
+{
+public:
+	eth_link();
+	~eth_link();
+
+	/* Connects to the switch, or attaches to its shm channel.  */
+	bool connect(const char *descr);
+	/* Switch side: takes a connection from a listening socket.  */
+	bool accept(int listen_fd);
+	/* Switch side: creates a shm channel.  */
+	bool create(const char *descr);
+
+	bool send(uint32_t type, uint64_t time_ps,
+			const void *data = NULL, uint32_t len = 0);
+	/*
+	 * Returns false when the peer is gone, or sent a message longer
+	 * than ETH_LINK_MAX_FRAME.  The caller closes the link then.
+	 */
+	bool recv(eth_link_msg &msg, std::vector<unsigned char> &data);
+	void close(void);
+
+private:
+	int fd;
+	struct rp_shm *shm;
+
+	bool read_full(void *buf, size_t len);
+	bool write_full(const void *buf, size_t len);
+};
+
+/* Creates a listening Unix socket for a "unix:<path>" descriptor.  */
+int eth_link_listen(const char *descr);
+#endif
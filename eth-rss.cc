@@ -0,0 +1,323 @@
+/*
+ * Receive side scaling and transmit queue merging for multi-queue DMAs.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "systemc.h"
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "tlm-extensions/genattr.h"
+#include "eth-rss.h"
+
+#define ETH_P_IP	0x0800
+#define ETH_P_IPV6	0x86dd
+#define ETH_P_8021Q	0x8100
+#define ETH_P_8021AD	0x88a8
+
+#define IPPROTO_TCP_NR	6
+#define IPPROTO_UDP_NR	17
+
+static const unsigned char default_key[ETH_RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+	0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+	0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+	0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+	0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+static bool is_eop(tlm::tlm_generic_payload& trans)
+{
+	genattr_extension *genattr;
+
+	trans.get_extension(genattr);
+	return genattr ? genattr->get_eop() : true;
+}
+
+eth_rss_config::eth_rss_config()
+	: queues(1),
+	  udp(true),
+	  l4(true)
+{
+	memcpy(key, default_key, sizeof key);
+}
+
+bool eth_rss_config::parse(const char *spec)
+{
+	string s(spec);
+	size_t pos = 0;
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos);
+		string item = s.substr(pos, end == string::npos ?
+						string::npos : end - pos);
+		size_t eq = item.find('=');
+		string k, val;
+
+		pos = end == string::npos ? s.size() : end + 1;
+		if (item.empty()) {
+			continue;
+		}
+		if (eq == string::npos) {
+			printf("eth-rss: missing value for %s\n",
+				item.c_str());
+			return false;
+		}
+		k = item.substr(0, eq);
+		val = item.substr(eq + 1);
+
+		if (k == "queues") {
+			queues = strtoul(val.c_str(), NULL, 0);
+		} else if (k == "key") {
+			unsigned int i;
+
+			if (val.size() != 2 * ETH_RSS_KEY_LEN ||
+			    val.find_first_not_of("0123456789abcdefABCDEF")
+					!= string::npos) {
+				printf("eth-rss: the key takes %d hex digits\n",
+					2 * ETH_RSS_KEY_LEN);
+				return false;
+			}
+			for (i = 0; i < ETH_RSS_KEY_LEN; i++) {
+				key[i] = strtoul(val.substr(2 * i, 2).c_str(),
+						NULL, 16);
+			}
+		} else if (k == "udp") {
+			udp = strtoul(val.c_str(), NULL, 0);
+		} else if (k == "l4") {
+			l4 = strtoul(val.c_str(), NULL, 0);
+		} else {
+			printf("eth-rss: unknown key %s\n", k.c_str());
+			return false;
+		}
+	}
+
+	if (queues == 0 || queues > ETH_RSS_MAX_QUEUES) {
+		printf("eth-rss: invalid number of queues %u\n", queues);
+		return false;
+	}
+	return true;
+}
+
+uint32_t eth_rss_toeplitz(const unsigned char *key,
+			const unsigned char *data, unsigned int len)
+{
+	uint32_t v = key[0] << 24 | key[1] << 16 | key[2] << 8 | key[3];
+	uint32_t hash = 0;
+	unsigned int i, b;
+
+	assert(len <= ETH_RSS_KEY_LEN - 4);
+	for (i = 0; i < len; i++) {
+		for (b = 0; b < 8; b++) {
+			if (data[i] & (0x80 >> b)) {
+				hash ^= v;
+			}
+			v = v << 1 | ((key[i + 4] >> (7 - b)) & 1);
+		}
+	}
+	return hash;
+}
+
+eth_rss::eth_rss(sc_module_name name, const eth_rss_config &cfg)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  cfg(cfg),
+	  cur(-1),
+	  nr_frames(cfg.queues),
+	  nr_hashed(0)
+{
+	char txt[32];
+	unsigned int i;
+
+	tgt_socket.register_b_transport(this, &eth_rss::b_transport);
+	tgt_socket.register_transport_dbg(this, &eth_rss::transport_dbg);
+
+	for (i = 0; i < cfg.queues; i++) {
+		sprintf(txt, "init-socket-%d", i);
+		init_socket.push_back(new tlm_utils::
+			simple_initiator_socket_tagged<eth_rss>(txt));
+		init_socket[i]->register_invalidate_direct_mem_ptr(this,
+				&eth_rss::invalidate_direct_mem_ptr, i);
+	}
+
+	/* Spread the table evenly, like most drivers do by default.  */
+	for (i = 0; i < ETH_RSS_TABLE_SIZE; i++) {
+		table[i] = i % cfg.queues;
+	}
+}
+
+unsigned int eth_rss::steer(const unsigned char *data, unsigned int len)
+{
+	unsigned char input[ETH_RSS_KEY_LEN - 4];
+	unsigned int in_len = 0;
+	unsigned int off = 12;
+	unsigned int proto, type;
+	bool ports = false;
+
+	if (cfg.queues == 1 || len < 14) {
+		return 0;
+	}
+
+	type = data[off] << 8 | data[off + 1];
+	while ((type == ETH_P_8021Q || type == ETH_P_8021AD) &&
+	       off + 6 <= len) {
+		off += 4;
+		type = data[off] << 8 | data[off + 1];
+	}
+	off += 2;
+
+	if (type == ETH_P_IP && off + 20 <= len) {
+		unsigned int ihl = (data[off] & 0xf) * 4;
+		/* Fragments hash on the addresses only, as with RSS.  */
+		bool frag = (data[off + 6] & 0x3f) || data[off + 7];
+
+		proto = data[off + 9];
+		memcpy(input, data + off + 12, 8);
+		in_len = 8;
+		off += ihl;
+		ports = !frag && ihl >= 20;
+	} else if (type == ETH_P_IPV6 && off + 40 <= len) {
+		/* Extension headers are not walked, they hash as 2-tuple.  */
+		proto = data[off + 6];
+		memcpy(input, data + off + 8, 32);
+		in_len = 32;
+		off += 40;
+		ports = true;
+	} else {
+		return 0;
+	}
+
+	ports = ports && cfg.l4 && off + 4 <= len &&
+		(proto == IPPROTO_TCP_NR ||
+		 (proto == IPPROTO_UDP_NR && cfg.udp));
+	if (ports) {
+		memcpy(input + in_len, data + off, 4);
+		in_len += 4;
+	}
+
+	nr_hashed++;
+	return table[eth_rss_toeplitz(cfg.key, input, in_len) %
+			ETH_RSS_TABLE_SIZE];
+}
+
+void eth_rss::b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
+{
+	int q = cur;
+
+	if (q < 0) {
+		q = steer(trans.get_data_ptr(), trans.get_data_length());
+		nr_frames[q]++;
+	}
+	cur = is_eop(trans) ? -1 : q;
+
+	(*init_socket[q])->b_transport(trans, delay);
+}
+
+unsigned int eth_rss::transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return (*init_socket[0])->transport_dbg(trans);
+}
+
+void eth_rss::invalidate_direct_mem_ptr(int id, sc_dt::uint64 start,
+					sc_dt::uint64 end)
+{
+	tgt_socket->invalidate_direct_mem_ptr(start, end);
+}
+
+void eth_rss::end_of_simulation(void)
+{
+	unsigned int i;
+
+	printf("%s: %" PRIu64 " frames hashed\n", name(), nr_hashed);
+	for (i = 0; i < cfg.queues; i++) {
+		printf("%s: queue %u %" PRIu64 " frames\n", name(), i,
+			nr_frames[i]);
+	}
+}
+
+eth_mux::eth_mux(sc_module_name name, unsigned int nr_queues)
+	: sc_module(name),
+	  init_socket("init-socket"),
+	  busy("busy"),
+	  owner(-1),
+	  nr_frames(nr_queues)
+{
+	char txt[32];
+	unsigned int i;
+
+	for (i = 0; i < nr_queues; i++) {
+		sprintf(txt, "tgt-socket-%d", i);
+		tgt_socket.push_back(new tlm_utils::
+			simple_target_socket_tagged<eth_mux>(txt));
+		tgt_socket[i]->register_b_transport(this,
+				&eth_mux::b_transport, i);
+		tgt_socket[i]->register_transport_dbg(this,
+				&eth_mux::transport_dbg, i);
+	}
+}
+
+void eth_mux::b_transport(int id, tlm::tlm_generic_payload& trans,
+			sc_time& delay)
+{
+	if (owner != id) {
+		/*
+		 * Sync before waiting for the stream so that the queues
+		 * take their turns in time order.
+		 */
+		wait(delay);
+		delay = SC_ZERO_TIME;
+		busy.lock();
+		owner = id;
+		nr_frames[id]++;
+	}
+
+	init_socket->b_transport(trans, delay);
+
+	if (is_eop(trans)) {
+		owner = -1;
+		busy.unlock();
+	}
+}
+
+unsigned int eth_mux::transport_dbg(int id, tlm::tlm_generic_payload& trans)
+{
+	return init_socket->transport_dbg(trans);
+}
+
+void eth_mux::end_of_simulation(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_frames.size(); i++) {
+		printf("%s: queue %u %" PRIu64 " frames\n", name(), i,
+			nr_frames[i]);
+	}
+}
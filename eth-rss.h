@@ -0,0 +1,123 @@
+/*
+ * Receive side scaling and transmit queue merging for multi-queue DMAs.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ETH_RSS_H__
+#define __ETH_RSS_H__
+
+#include <string>
+#include <vector>
+
+#define ETH_RSS_KEY_LEN		40
+#define ETH_RSS_TABLE_SIZE	128
+#define ETH_RSS_MAX_QUEUES	64
+
+/*
+ * Describes the steering.  parse() takes a comma separated list of
+ * key=value pairs, e.g.
+ *   queues=4,udp=0
+ * Keys: queues (receive queues to spread flows over), key (the Toeplitz
+ * key as 80 hex digits, the usual Microsoft key by default), udp (hash
+ * the UDP ports too, not only the TCP ports) and l4 (hash the ports at
+ * all, otherwise only the addresses).
+ */
+struct eth_rss_config {
+	unsigned int queues;
+	unsigned char key[ETH_RSS_KEY_LEN];
+	bool udp;
+	bool l4;
+
+	eth_rss_config();
+	bool parse(const char *spec);
+};
+
+/*
+ * Toeplitz hash of len bytes of input, len at most ETH_RSS_KEY_LEN - 4.
+ */
+uint32_t eth_rss_toeplitz(const unsigned char *key,
+			const unsigned char *data, unsigned int len);
+
+/*
+ * Steers received frames to one of several initiator sockets, the way
+ * RSS capable NICs steer them to receive queues.  The hash covers the
+ * IPv4 or IPv6 addresses and, for unfragmented TCP and UDP, the ports,
+ * and picks a queue through an indirection table.  Frames that are not
+ * IP go to queue 0.  The headers must be in the first transaction of a
+ * frame, what is missing is left out of the hash.  The transactions that
+ * follow, up to EOP, go to the same queue.
+ */
+class eth_rss
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<eth_rss> tgt_socket;
+	std::vector<tlm_utils::simple_initiator_socket_tagged<eth_rss> *>
+		init_socket;
+
+	eth_rss(sc_core::sc_module_name name, const eth_rss_config &cfg);
+
+	/* Returns the queue a frame steers to.  */
+	unsigned int steer(const unsigned char *data, unsigned int len);
+
+private:
+	eth_rss_config cfg;
+	unsigned int table[ETH_RSS_TABLE_SIZE];
+
+	/* Queue of the frame in progress, or -1 between frames.  */
+	int cur;
+
+	std::vector<uint64_t> nr_frames;
+	uint64_t nr_hashed;
+
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload& trans);
+	void invalidate_direct_mem_ptr(int id, sc_dt::uint64 start,
+					sc_dt::uint64 end);
+	void end_of_simulation(void);
+};
+
+/*
+ * Merges the transmit queues onto one stream.  A queue that starts a
+ * frame owns the stream until the transaction with EOP, the others
+ * wait their turn, so frames never interleave.
+ */
+class eth_mux
+: public sc_core::sc_module
+{
+public:
+	std::vector<tlm_utils::simple_target_socket_tagged<eth_mux> *>
+		tgt_socket;
+	tlm_utils::simple_initiator_socket<eth_mux> init_socket;
+
+	eth_mux(sc_core::sc_module_name name, unsigned int nr_queues);
+
+private:
+	sc_core::sc_mutex busy;
+	int owner;
+	std::vector<uint64_t> nr_frames;
+
+	void b_transport(int id, tlm::tlm_generic_payload& trans,
+			sc_time& delay);
+	unsigned int transport_dbg(int id, tlm::tlm_generic_payload& trans);
+	void end_of_simulation(void);
+};
+#endif
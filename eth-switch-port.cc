@@ -0,0 +1,198 @@
+/*
+ * Attaches a MAC demo to the Ethernet switch (eth-switch.cc).
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "eth-switch-port.h"
+#include "tlm-pool.h"
+
+#define TIME_NEVER	UINT64_MAX
+
+static uint64_t to_ps(const sc_time &t)
+{
+	return (uint64_t) (t.to_seconds() * 1e12 + 0.5);
+}
+
+eth_switch_port::eth_switch_port(sc_module_name name, const char *descr)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  init_socket("init-socket"),
+	  connected(false),
+	  last_sent(0),
+	  granted(0),
+	  tx_frames(0),
+	  tx_bytes(0),
+	  rx_frames(0),
+	  rx_bytes(0),
+	  nr_syncs(0),
+	  stalled(0)
+{
+	tgt_socket.register_b_transport(this, &eth_switch_port::b_transport);
+
+	if (!link.connect(descr)) {
+		perror(descr);
+		SC_REPORT_FATAL("eth-switch-port", "unable to reach the switch");
+	}
+	connected = true;
+
+	SC_THREAD(sync);
+	SC_THREAD(deliver);
+}
+
+/* Reads one message from the switch, false once it is gone.  */
+bool eth_switch_port::receive(void)
+{
+	eth_link_msg msg;
+	rx_frame f;
+	uint64_t now;
+
+	if (!link.recv(msg, f.data)) {
+		link.close();
+		connected = false;
+		granted = TIME_NEVER;
+		return false;
+	}
+
+	switch (msg.type) {
+	case ETH_LINK_GRANT:
+		granted = max(granted, msg.time_ps);
+		break;
+	case ETH_LINK_FRAME:
+		/* The switch never sends a frame into our past.  */
+		now = to_ps(sc_time_stamp());
+		f.time = max(msg.time_ps, now);
+		if (rxq.empty()) {
+			ev_rx.notify(sc_time((double) (f.time - now), SC_PS));
+		}
+		rxq.push_back(std::move(f));
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+void eth_switch_port::sync(void)
+{
+	for (;;) {
+		uint64_t now = to_ps(sc_time_stamp());
+
+		if (granted <= now) {
+			chrono::steady_clock::time_point t0 =
+				chrono::steady_clock::now();
+
+			/* Everything before now is sent, wait for the rest.  */
+			link.send(ETH_LINK_SYNC, max(now, last_sent));
+			while (granted <= now && receive()) {
+				continue;
+			}
+			nr_syncs++;
+			stalled += chrono::steady_clock::now() - t0;
+		}
+
+		/* The other nodes are done, or the switch is gone.  */
+		if (granted == TIME_NEVER) {
+			return;
+		}
+		wait(sc_time((double) (granted - now), SC_PS));
+	}
+}
+
+void eth_switch_port::deliver(void)
+{
+	for (;;) {
+		uint64_t now;
+
+		wait(ev_rx);
+
+		now = to_ps(sc_time_stamp());
+		while (!rxq.empty() && rxq.front().time <= now) {
+			tlm::tlm_generic_payload *gp;
+			rx_frame &f = rxq.front();
+			sc_time delay = SC_ZERO_TIME;
+
+			gp = tlm_payload_pool::shared().allocate();
+			gp->set_command(tlm::TLM_WRITE_COMMAND);
+			gp->set_address(0);
+			gp->set_data_ptr(f.data.data());
+			gp->set_data_length(f.data.size());
+			gp->set_streaming_width(f.data.size());
+			gp->set_dmi_allowed(false);
+			gp->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+			init_socket->b_transport(*gp, delay);
+			gp->release();
+
+			rx_frames++;
+			rx_bytes += f.data.size();
+			rxq.pop_front();
+
+			wait(delay);
+			now = to_ps(sc_time_stamp());
+		}
+		if (!rxq.empty()) {
+			ev_rx.notify(sc_time((double) (rxq.front().time - now),
+						SC_PS));
+		}
+	}
+}
+
+void eth_switch_port::b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay)
+{
+	uint64_t t = max(to_ps(sc_time_stamp() + delay), last_sent);
+
+	if (connected) {
+		link.send(ETH_LINK_FRAME, t, trans.get_data_ptr(),
+				trans.get_data_length());
+		last_sent = t;
+		tx_frames++;
+		tx_bytes += trans.get_data_length();
+	}
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+}
+
+void eth_switch_port::end_of_simulation(void)
+{
+	if (connected) {
+		link.send(ETH_LINK_BYE, 0);
+		link.close();
+		connected = false;
+	}
+
+	printf("%s: %" PRIu64 " frames %" PRIu64 " bytes sent, %" PRIu64
+		" frames %" PRIu64 " bytes received, %" PRIu64 " syncs, "
+		"%.3f s stalled\n", name(), tx_frames, tx_bytes, rx_frames,
+		rx_bytes, nr_syncs,
+		chrono::duration<double>(stalled).count());
+}
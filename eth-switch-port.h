@@ -0,0 +1,79 @@
+/*
+ * Attaches a MAC demo to the Ethernet switch (eth-switch.cc).
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ETH_SWITCH_PORT_H__
+#define __ETH_SWITCH_PORT_H__
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "eth-link.h"
+
+/*
+ * Stands in for the link partner on the PHY side of a MAC.  Frames
+ * written to tgt_socket go to the switch stamped with their time, frames
+ * from the switch are written to init_socket at the time they arrive.
+ * The simulation only runs up to the time the switch grants, and stalls
+ * there until the other nodes have caught up.
+ */
+class eth_switch_port
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<eth_switch_port> tgt_socket;
+	tlm_utils::simple_initiator_socket<eth_switch_port> init_socket;
+
+	eth_switch_port(sc_core::sc_module_name name, const char *descr);
+	SC_HAS_PROCESS(eth_switch_port);
+
+private:
+	struct rx_frame {
+		uint64_t time;
+		std::vector<unsigned char> data;
+	};
+
+	eth_link link;
+	bool connected;
+
+	/* Frames go out no earlier than the last one, in ps.  */
+	uint64_t last_sent;
+	uint64_t granted;
+
+	std::deque<rx_frame> rxq;
+	sc_event ev_rx;
+
+	uint64_t tx_frames;
+	uint64_t tx_bytes;
+	uint64_t rx_frames;
+	uint64_t rx_bytes;
+	uint64_t nr_syncs;
+	std::chrono::steady_clock::duration stalled;
+
+	bool receive(void);
+	void sync(void);
+	void deliver(void);
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	void end_of_simulation(void);
+};
+#endif
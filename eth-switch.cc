@@ -0,0 +1,486 @@
+/*
+ * A switch for Ethernet frames between co-simulation processes.
+ *
+ * Each port links to the PHY side of a MAC demo, over a Unix socket or a
+ * shared memory channel.  Frames are forwarded by learned MAC address,
+ * through a per-port egress queue of limited depth, at the port's
+ * bandwidth and with the port's latency on both the way in and out.
+ *
+ * The nodes are kept in step conservatively: a node sends the time of
+ * each frame and, when it has nothing to send, how far it got.  A frame
+ * sent at t by node q reaches the switch at t + latency(q), so once every
+ * node got past t, every frame reaching the switch before t + latency is
+ * known and can be forwarded in time order.  Each node is granted the
+ * time up to which no frame can still arrive for it and runs freely up
+ * to there.  The latencies are the lookahead, larger ones mean fewer
+ * round trips.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eth-link.h"
+#include "rp-shm.h"
+
+using namespace std;
+
+#define TIME_NEVER	UINT64_MAX
+
+/* Preamble, SFD, FCS and the minimum inter-frame gap.  */
+#define ETH_OVERHEAD	24
+
+struct port_config {
+	double bw;		/* Gbit/s.  */
+	uint64_t latency;	/* ps.  */
+	unsigned int depth;	/* Frames queued for egress.  */
+};
+
+struct frame {
+	uint64_t time;		/* Reaches the switch, in ps.  */
+	vector<unsigned char> data;
+};
+
+struct port {
+	eth_link link;
+	port_config cfg;
+	thread reader;
+
+	/* The node has sent every frame it sends before clock.  */
+	uint64_t clock;
+	bool done;
+	uint64_t granted;
+
+	/* Frames from the node not forwarded yet, in time order.  */
+	deque<frame> pending;
+
+	/* The egress link is busy until busy, queued holds departures.  */
+	uint64_t busy;
+	deque<uint64_t> queued;
+
+	uint64_t rx_frames;
+	uint64_t rx_bytes;
+	uint64_t tx_frames;
+	uint64_t tx_bytes;
+	uint64_t drops;
+	uint64_t flooded;
+
+	port()
+		: clock(0), done(false), granted(0), busy(0),
+		  rx_frames(0), rx_bytes(0), tx_frames(0), tx_bytes(0),
+		  drops(0), flooded(0) {}
+};
+
+/* A message from one of the reader threads.  */
+struct inbox_msg {
+	unsigned int port;
+	eth_link_msg msg;
+	vector<unsigned char> data;
+};
+
+static vector<port> ports;
+static map<uint64_t, unsigned int> mac_table;
+
+static mutex inbox_mutex;
+static condition_variable inbox_cond;
+static deque<inbox_msg> inbox;
+
+static volatile sig_atomic_t interrupted;
+
+static void sigint_handler(int)
+{
+	interrupted = 1;
+}
+
+static void reader(unsigned int i)
+{
+	for (;;) {
+		inbox_msg m;
+		bool bye;
+
+		m.port = i;
+		if (!ports[i].link.recv(m.msg, m.data)) {
+			m.msg.type = ETH_LINK_BYE;
+			m.msg.len = 0;
+			m.msg.time_ps = TIME_NEVER;
+			m.data.clear();
+		}
+		bye = m.msg.type == ETH_LINK_BYE;
+
+		{
+			lock_guard<mutex> lock(inbox_mutex);
+			inbox.push_back(std::move(m));
+		}
+		inbox_cond.notify_one();
+
+		if (bye) {
+			return;
+		}
+	}
+}
+
+static uint64_t mac_addr(const unsigned char *p)
+{
+	uint64_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < 6; i++) {
+		v = v << 8 | p[i];
+	}
+	return v;
+}
+
+/* The earliest a frame not forwarded yet from q can reach the switch.  */
+static uint64_t horizon(const port &q)
+{
+	if (!q.pending.empty()) {
+		return q.pending.front().time;
+	}
+	if (q.done || q.clock == TIME_NEVER) {
+		return TIME_NEVER;
+	}
+	return q.clock + q.cfg.latency;
+}
+
+static void egress(unsigned int i, uint64_t t, const vector<unsigned char> &data)
+{
+	port &p = ports[i];
+	uint64_t start;
+
+	if (p.done) {
+		return;
+	}
+
+	while (!p.queued.empty() && p.queued.front() <= t) {
+		p.queued.pop_front();
+	}
+	if (p.queued.size() >= p.cfg.depth) {
+		p.drops++;
+		return;
+	}
+
+	start = max(t, p.busy);
+	p.busy = start + (uint64_t) ((data.size() + ETH_OVERHEAD) * 8 *
+					1000 / p.cfg.bw);
+	p.queued.push_back(p.busy);
+
+	if (!p.link.send(ETH_LINK_FRAME, p.busy + p.cfg.latency,
+			data.data(), data.size())) {
+		p.done = true;
+		return;
+	}
+	p.tx_frames++;
+	p.tx_bytes += data.size();
+}
+
+static void forward(unsigned int src, const frame &f)
+{
+	map<uint64_t, unsigned int>::iterator it;
+	unsigned int i;
+
+	if (f.data.size() < 14) {
+		ports[src].drops++;
+		return;
+	}
+
+	/* Group addresses and unknown stations go to every other port.  */
+	mac_table[mac_addr(&f.data[6])] = src;
+	it = mac_table.find(mac_addr(&f.data[0]));
+	if (!(f.data[0] & 1) && it != mac_table.end()) {
+		if (it->second != src) {
+			egress(it->second, f.time, f.data);
+		}
+		return;
+	}
+
+	ports[src].flooded++;
+	for (i = 0; i < ports.size(); i++) {
+		if (i != src) {
+			egress(i, f.time, f.data);
+		}
+	}
+}
+
+/* Forwards what is safe to forward and hands out new grants.  */
+static void advance(void)
+{
+	unsigned int i, j;
+
+	for (;;) {
+		uint64_t safe = TIME_NEVER;
+		int next = -1;
+
+		for (i = 0; i < ports.size(); i++) {
+			port &q = ports[i];
+
+			if (!q.done && q.clock != TIME_NEVER) {
+				safe = min(safe, q.clock + q.cfg.latency);
+			}
+			if (!q.pending.empty() &&
+			    (next < 0 || q.pending.front().time <
+					ports[next].pending.front().time)) {
+				next = i;
+			}
+		}
+		if (next < 0 || ports[next].pending.front().time > safe) {
+			break;
+		}
+
+		forward(next, ports[next].pending.front());
+		ports[next].pending.pop_front();
+	}
+
+	for (i = 0; i < ports.size(); i++) {
+		port &p = ports[i];
+		uint64_t g = TIME_NEVER;
+
+		if (p.done) {
+			continue;
+		}
+		for (j = 0; j < ports.size(); j++) {
+			if (j != i) {
+				g = min(g, horizon(ports[j]));
+			}
+		}
+		if (g != TIME_NEVER) {
+			g += p.cfg.latency;
+		}
+		if (g > p.granted) {
+			p.granted = g;
+			if (!p.link.send(ETH_LINK_GRANT, g)) {
+				p.done = true;
+			}
+		}
+	}
+}
+
+static void handle(inbox_msg &m)
+{
+	port &p = ports[m.port];
+	frame f;
+
+	switch (m.msg.type) {
+	case ETH_LINK_FRAME:
+		/* Frames never go back in time.  */
+		p.clock = max(p.clock, m.msg.time_ps);
+		p.rx_frames++;
+		p.rx_bytes += m.data.size();
+		f.time = p.clock + p.cfg.latency;
+		f.data.swap(m.data);
+		p.pending.push_back(std::move(f));
+		break;
+	case ETH_LINK_SYNC:
+		p.clock = max(p.clock, m.msg.time_ps);
+		break;
+	case ETH_LINK_BYE:
+	default:
+		/* The reader is gone, so the link is ours to close.  */
+		p.link.close();
+		p.done = true;
+		p.clock = TIME_NEVER;
+		break;
+	}
+}
+
+static void report(void)
+{
+	unsigned int i;
+
+	printf("port  rx-frames      rx-bytes  tx-frames      tx-bytes"
+		"     drops   flooded\n");
+	for (i = 0; i < ports.size(); i++) {
+		port &p = ports[i];
+
+		printf("%4u %10" PRIu64 " %13" PRIu64 " %10" PRIu64
+			" %13" PRIu64 " %9" PRIu64 " %9" PRIu64 "\n",
+			i, p.rx_frames, p.rx_bytes, p.tx_frames, p.tx_bytes,
+			p.drops, p.flooded);
+	}
+}
+
+static bool parse_port_option(port_config &cfg, const string &key,
+				const string &val)
+{
+	if (key == "bw") {
+		cfg.bw = strtod(val.c_str(), NULL);
+	} else if (key == "latency") {
+		cfg.latency = strtoull(val.c_str(), NULL, 0) * 1000;
+	} else if (key == "depth") {
+		cfg.depth = strtoul(val.c_str(), NULL, 0);
+	} else {
+		return false;
+	}
+	return cfg.bw > 0 && cfg.latency > 0 && cfg.depth > 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("%s unix:<path>|shm:/<name> nr-ports [key=value...]\n", prog);
+	printf("  keys: bw (Gbit/s), latency (ns), depth (frames), for all\n"
+	       "  ports or for port n as n.key, e.g. 2.bw=1\n");
+	printf("  with shm:/<name> port n attaches to shm:/<name>-<n>\n");
+}
+
+int main(int argc, char *argv[])
+{
+	port_config def = { 10, 1000000, 64 };
+	vector<pair<string, string> > opts;
+	unsigned int nr_ports, i;
+	int listen_fd = -1;
+	bool use_shm;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	nr_ports = strtoul(argv[2], NULL, 0);
+	if (nr_ports < 2) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	ports = vector<port>(nr_ports);
+
+	/* Defaults first, then the per-port overrides.  */
+	for (i = 3; i < (unsigned int) argc; i++) {
+		const char *eq = strchr(argv[i], '=');
+
+		if (!eq) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		opts.push_back(make_pair(string(argv[i], eq - argv[i]),
+					string(eq + 1)));
+	}
+	for (const pair<string, string> &o : opts) {
+		if (o.first.find('.') == string::npos &&
+		    !parse_port_option(def, o.first, o.second)) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < nr_ports; i++) {
+		ports[i].cfg = def;
+	}
+	for (const pair<string, string> &o : opts) {
+		size_t dot = o.first.find('.');
+
+		if (dot == string::npos) {
+			continue;
+		}
+		i = strtoul(o.first.c_str(), NULL, 0);
+		if (i >= nr_ports ||
+		    !parse_port_option(ports[i].cfg, o.first.substr(dot + 1),
+					o.second)) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	use_shm = rp_shm_descr_match(argv[1]);
+	if (!use_shm) {
+		listen_fd = eth_link_listen(argv[1]);
+		if (listen_fd < 0) {
+			perror(argv[1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < nr_ports; i++) {
+		bool ok;
+
+		if (use_shm) {
+			string name = string(argv[1]) + "-" + to_string(i);
+
+			ok = ports[i].link.create(name.c_str());
+			printf("port %u: %s\n", i, name.c_str());
+		} else {
+			printf("port %u: waiting for %s\n", i, argv[1]);
+			ok = ports[i].link.accept(listen_fd);
+		}
+		if (!ok) {
+			perror(argv[1]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(argv[1] + strlen("unix:"));
+	}
+
+	signal(SIGINT, sigint_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < nr_ports; i++) {
+		ports[i].reader = thread(reader, i);
+	}
+
+	advance();
+	while (!interrupted) {
+		deque<inbox_msg> batch;
+		bool running = false;
+
+		{
+			unique_lock<mutex> lock(inbox_mutex);
+
+			if (inbox.empty()) {
+				inbox_cond.wait_for(lock,
+						chrono::milliseconds(100));
+			}
+			batch.swap(inbox);
+		}
+		for (inbox_msg &m : batch) {
+			handle(m);
+		}
+		advance();
+
+		for (i = 0; i < nr_ports; i++) {
+			running |= !ports[i].done || !ports[i].pending.empty();
+		}
+		if (!running) {
+			break;
+		}
+	}
+
+	report();
+	if (interrupted) {
+		/* Readers may still be blocked on their links.  */
+		fflush(stdout);
+		_exit(EXIT_SUCCESS);
+	}
+	for (i = 0; i < nr_ports; i++) {
+		ports[i].reader.join();
+	}
+	return 0;
+}
@@ -0,0 +1,536 @@
+/*
+ * Ethernet frame generator and sink.
+ *
+ * Stand in for the link partner on the PHY side of a MAC, or for the DMA
+ * on its stream side, so MAC throughput can be measured without a guest
+ * driving the traffic.  The generator replays a pcap file or a synthetic
+ * mix of frame sizes at line rate.  It stamps each frame with a sequence
+ * number and its send time right after the Ethernet header, from which
+ * the sink derives latency and lost frames.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "eth-traffic.h"
+#include "tlm-pool.h"
+
+/* Preamble, SFD and the minimum inter-frame gap.  */
+#define ETH_OVERHEAD	20
+#define ETH_FCS_LEN	4
+
+/* The stamp: magic, sequence number and send time in ps.  */
+#define ETH_TAG_OFFSET	14
+#define ETH_TAG_LEN	20
+static const unsigned char eth_tag_magic[4] = { 'S', 'C', 'E', 'T' };
+
+unsigned int eth_traffic_gen::nr_running;
+
+static void put_le64(unsigned char *p, uint64_t v)
+{
+	unsigned int i;
+
+	for (i = 0; i < 8; i++) {
+		p[i] = v >> (i * 8);
+	}
+}
+
+static uint64_t get_le64(const unsigned char *p)
+{
+	uint64_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++) {
+		v |= (uint64_t) p[i] << (i * 8);
+	}
+	return v;
+}
+
+/* pcap files are in the byte order of the host that wrote them.  */
+static uint32_t pcap_u32(const unsigned char *p, bool swap)
+{
+	if (swap) {
+		return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+	}
+	return (uint32_t) p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+static uint32_t eth_crc32(const unsigned char *p, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+	size_t i;
+	int b;
+
+	for (i = 0; i < len; i++) {
+		crc ^= p[i];
+		for (b = 0; b < 8; b++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+eth_traffic_config::eth_traffic_config()
+	: loop(1),
+	  timed(false),
+	  rate(10),
+	  count(100000),
+	  fcs(false),
+	  tag(-1),
+	  drain(100),
+	  seed(1),
+	  stop(true)
+{
+	eth_frame_size s = { 64, 1 };
+
+	mix.push_back(s);
+}
+
+bool eth_traffic_config::parse(const char *spec)
+{
+	string s(spec);
+	size_t pos = 0;
+	bool count_set = false;
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos);
+		string item = s.substr(pos, end == string::npos ?
+						string::npos : end - pos);
+		size_t eq = item.find('=');
+		string key, val;
+
+		pos = end == string::npos ? s.size() : end + 1;
+		if (item.empty()) {
+			continue;
+		}
+		if (eq == string::npos) {
+			printf("eth-traffic: missing value for %s\n",
+				item.c_str());
+			return false;
+		}
+		key = item.substr(0, eq);
+		val = item.substr(eq + 1);
+
+		if (key == "pcap") {
+			pcap = val;
+		} else if (key == "loop") {
+			loop = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "timed") {
+			timed = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "mix") {
+			const char *p = val.c_str();
+
+			mix.clear();
+			while (*p) {
+				eth_frame_size fs;
+				char *e;
+
+				fs.len = strtoul(p, &e, 0);
+				fs.weight = 1;
+				if (*e == ':') {
+					fs.weight = strtoul(e + 1, &e, 0);
+				}
+				if (e == p || (*e && *e != '/')) {
+					printf("eth-traffic: bad mix %s\n",
+						val.c_str());
+					return false;
+				}
+				mix.push_back(fs);
+				p = *e ? e + 1 : e;
+			}
+		} else if (key == "rate") {
+			rate = strtod(val.c_str(), NULL);
+		} else if (key == "count") {
+			count = strtoull(val.c_str(), NULL, 0);
+			count_set = true;
+		} else if (key == "fcs") {
+			fcs = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "tag") {
+			tag = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "drain") {
+			drain = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "seed") {
+			seed = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "stop") {
+			stop = strtoul(val.c_str(), NULL, 0);
+		} else {
+			printf("eth-traffic: unknown key %s\n", key.c_str());
+			return false;
+		}
+	}
+
+	/* A pcap file is replayed whole unless told otherwise.  */
+	if (!pcap.empty() && !count_set) {
+		count = 0;
+	}
+
+	if (mix.empty() || loop == 0 || rate < 0) {
+		printf("eth-traffic: invalid configuration\n");
+		return false;
+	}
+	for (const eth_frame_size &fs : mix) {
+		if (fs.len < 18 || fs.len > 16384) {
+			printf("eth-traffic: invalid frame size %u\n", fs.len);
+			return false;
+		}
+	}
+	return true;
+}
+
+eth_traffic_gen::eth_traffic_gen(sc_module_name name,
+				const eth_traffic_config &cfg)
+	: sc_module(name),
+	  init_socket("init-socket"),
+	  cfg(cfg),
+	  rng(cfg.seed),
+	  sent(0),
+	  nr_errors(0),
+	  bytes(0)
+{
+	vector<double> weights;
+
+	for (const eth_frame_size &fs : cfg.mix) {
+		weights.push_back(fs.weight);
+	}
+	pick = discrete_distribution<unsigned int>(weights.begin(),
+						weights.end());
+
+	if (!cfg.pcap.empty()) {
+		load_pcap(cfg.pcap.c_str());
+		if (this->cfg.count == 0) {
+			this->cfg.count = frames.size() * cfg.loop;
+		}
+	}
+	if (this->cfg.tag < 0) {
+		this->cfg.tag = cfg.pcap.empty();
+	}
+
+	nr_running++;
+	SC_THREAD(worker);
+}
+
+void eth_traffic_gen::load_pcap(const char *path)
+{
+	unsigned char hdr[24];
+	uint64_t first = 0;
+	bool swap, nsec;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		perror(path);
+		SC_REPORT_FATAL("eth-traffic", "unable to open pcap file");
+	}
+
+	if (fread(hdr, sizeof hdr, 1, fp) != 1) {
+		SC_REPORT_FATAL("eth-traffic", "truncated pcap file");
+	}
+	switch (pcap_u32(hdr, false)) {
+	case 0xa1b2c3d4:
+		swap = false;
+		nsec = false;
+		break;
+	case 0xa1b23c4d:
+		swap = false;
+		nsec = true;
+		break;
+	case 0xd4c3b2a1:
+		swap = true;
+		nsec = false;
+		break;
+	case 0x4d3cb2a1:
+		swap = true;
+		nsec = true;
+		break;
+	default:
+		SC_REPORT_FATAL("eth-traffic", "not a pcap file");
+		return;
+	}
+	if (pcap_u32(hdr + 20, swap) != 1) {
+		printf("%s: %s does not hold Ethernet frames\n", name(), path);
+	}
+
+	while (fread(hdr, 16, 1, fp) == 1) {
+		uint64_t ts = pcap_u32(hdr, swap) * 1000000000000ULL +
+				pcap_u32(hdr + 4, swap) *
+				(nsec ? 1000ULL : 1000000ULL);
+		uint32_t len = pcap_u32(hdr + 8, swap);
+
+		if (len > 256 * 1024) {
+			SC_REPORT_FATAL("eth-traffic", "corrupt pcap file");
+		}
+		frames.push_back(vector<unsigned char>(len));
+		if (len && fread(frames.back().data(), len, 1, fp) != 1) {
+			frames.pop_back();
+			break;
+		}
+
+		if (stamps.empty()) {
+			first = ts;
+		}
+		stamps.push_back(ts > first ? ts - first : 0);
+	}
+	fclose(fp);
+
+	if (frames.empty()) {
+		SC_REPORT_FATAL("eth-traffic", "no frames in pcap file");
+	}
+	printf("%s: %zu frames from %s\n", name(), frames.size(), path);
+}
+
+/* Fills in the n'th frame, without the stamp and FCS.  */
+void eth_traffic_gen::build_frame(vector<unsigned char> &f, uint64_t n)
+{
+	static const unsigned char hdr[14] = {
+		0x02, 0x00, 0x00, 0x00, 0x00, 0x02,	/* Destination.  */
+		0x02, 0x00, 0x00, 0x00, 0x00, 0x01,	/* Source.  */
+		0x88, 0xb5,				/* Local experimental.  */
+	};
+	unsigned int len, i;
+
+	if (!frames.empty()) {
+		f = frames[n % frames.size()];
+		return;
+	}
+
+	len = cfg.mix[pick(rng)].len - ETH_FCS_LEN;
+	f.resize(len);
+	memcpy(f.data(), hdr, sizeof hdr);
+	for (i = sizeof hdr; i < len; i++) {
+		f[i] = n + i;
+	}
+}
+
+void eth_traffic_gen::start_of_simulation(void)
+{
+	start_time = sc_time_stamp();
+	wall_start = chrono::steady_clock::now();
+}
+
+void eth_traffic_gen::worker(void)
+{
+	vector<unsigned char> f;
+	sc_time due = SC_ZERO_TIME;
+	sc_time pass_start = SC_ZERO_TIME;
+	uint64_t n;
+
+	for (n = 0; n < cfg.count; n++) {
+		tlm::tlm_generic_payload *gp;
+		sc_time delay = SC_ZERO_TIME;
+
+		if (cfg.timed && !frames.empty()) {
+			uint64_t i = n % frames.size();
+
+			if (i == 0) {
+				pass_start = max(sc_time_stamp(), due);
+			}
+			due = pass_start + sc_time((double) stamps[i], SC_PS);
+		}
+		if (due > sc_time_stamp()) {
+			wait(due - sc_time_stamp());
+		}
+
+		build_frame(f, n);
+		if (cfg.tag && f.size() >= ETH_TAG_OFFSET + ETH_TAG_LEN) {
+			unsigned char *t = f.data() + ETH_TAG_OFFSET;
+
+			memcpy(t, eth_tag_magic, sizeof eth_tag_magic);
+			put_le64(t + 4, n);
+			put_le64(t + 12, (uint64_t)
+				(sc_time_stamp().to_seconds() * 1e12));
+		}
+		if (cfg.fcs) {
+			uint32_t crc = eth_crc32(f.data(), f.size());
+			unsigned int i;
+
+			for (i = 0; i < ETH_FCS_LEN; i++) {
+				f.push_back(crc >> (i * 8));
+			}
+		}
+
+		/* The next frame can start once this one is on the wire.  */
+		if (!cfg.timed && cfg.rate > 0) {
+			size_t wire = f.size() + ETH_OVERHEAD +
+					(cfg.fcs ? 0 : ETH_FCS_LEN);
+
+			due = sc_time_stamp() +
+				sc_time(wire * 8 / cfg.rate, SC_NS);
+		}
+
+		gp = tlm_payload_pool::shared().allocate();
+		gp->set_command(tlm::TLM_WRITE_COMMAND);
+		gp->set_address(0);
+		gp->set_data_ptr(f.data());
+		gp->set_data_length(f.size());
+		gp->set_streaming_width(f.size());
+		gp->set_dmi_allowed(false);
+		gp->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+		init_socket->b_transport(*gp, delay);
+
+		if (gp->get_response_status() != tlm::TLM_OK_RESPONSE) {
+			nr_errors++;
+		}
+		gp->release();
+
+		sent++;
+		bytes += f.size();
+
+		wait(delay);
+	}
+
+	end_time = sc_time_stamp();
+	wall_end = chrono::steady_clock::now();
+
+	if (--nr_running == 0 && cfg.stop) {
+		/* Give the last frames time to make it through the MAC.  */
+		wait(cfg.drain, SC_US);
+		sc_stop();
+	}
+}
+
+void eth_traffic_gen::end_of_simulation(void)
+{
+	double sim, wall;
+
+	if (sent < cfg.count) {
+		end_time = sc_time_stamp();
+		wall_end = chrono::steady_clock::now();
+	}
+	sim = (end_time - start_time).to_seconds();
+	wall = chrono::duration<double>(wall_end - wall_start).count();
+
+	printf("%s: %" PRIu64 " frames, %" PRIu64 " bytes, %" PRIu64
+		" rejected\n", name(), sent, bytes, nr_errors);
+	printf("%s: %.6f s simulated, %.3f s wall, %.0f frames/s "
+		"%.1f Mbit/s simulated, %.0f frames/s wall\n", name(),
+		sim, wall,
+		sim > 0 ? sent / sim : 0.0,
+		sim > 0 ? bytes * 8 / sim / 1e6 : 0.0,
+		wall > 0 ? sent / wall : 0.0);
+}
+
+eth_traffic_sink::eth_traffic_sink(sc_module_name name,
+				const eth_traffic_gen *src)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  src(src),
+	  frames(0),
+	  bytes(0),
+	  nr_tagged(0),
+	  nr_lost(0),
+	  nr_reordered(0),
+	  next_seq(0)
+{
+	tgt_socket.register_b_transport(this, &eth_traffic_sink::b_transport);
+}
+
+void eth_traffic_sink::b_transport(tlm::tlm_generic_payload &trans,
+				sc_time &delay)
+{
+	const unsigned char *p = trans.get_data_ptr();
+	unsigned int len = trans.get_data_length();
+	sc_time now = sc_time_stamp() + delay;
+
+	if (trans.get_command() != tlm::TLM_WRITE_COMMAND) {
+		trans.set_response_status(tlm::TLM_COMMAND_ERROR_RESPONSE);
+		return;
+	}
+
+	if (frames == 0) {
+		first_time = now;
+		wall_first = chrono::steady_clock::now();
+	}
+	last_time = now;
+	wall_last = chrono::steady_clock::now();
+	frames++;
+	bytes += len;
+
+	if (len >= ETH_TAG_OFFSET + ETH_TAG_LEN &&
+	    memcmp(p + ETH_TAG_OFFSET, eth_tag_magic,
+			sizeof eth_tag_magic) == 0) {
+		uint64_t seq = get_le64(p + ETH_TAG_OFFSET + 4);
+		uint64_t sent = get_le64(p + ETH_TAG_OFFSET + 12);
+		uint64_t at = (uint64_t) (now.to_seconds() * 1e12);
+
+		if (seq >= next_seq) {
+			nr_lost += seq - next_seq;
+			next_seq = seq + 1;
+		} else {
+			nr_reordered++;
+		}
+		latency.push_back(at > sent ? at - sent : 0);
+		nr_tagged++;
+	}
+
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+}
+
+void eth_traffic_sink::end_of_simulation(void)
+{
+	double sim = (last_time - first_time).to_seconds();
+	double wall = chrono::duration<double>(wall_last - wall_first).count();
+	vector<uint64_t> lat(latency);
+	uint64_t drops = nr_lost;
+	uint64_t sum = 0;
+
+	/* Frames missing at the end leave no gap in the sequence.  */
+	if (src && src->frames_sent() > frames) {
+		drops = max(drops, src->frames_sent() - frames);
+	}
+
+	printf("%s: %" PRIu64 " frames, %" PRIu64 " bytes, %" PRIu64
+		" drops, %" PRIu64 " reordered\n", name(), frames, bytes,
+		drops, nr_reordered);
+	printf("%s: %.0f frames/s %.1f Mbit/s simulated, "
+		"%.0f frames/s wall\n", name(),
+		sim > 0 ? (frames - 1) / sim : 0.0,
+		sim > 0 ? bytes * 8 / sim / 1e6 : 0.0,
+		wall > 0 ? (frames - 1) / wall : 0.0);
+
+	if (lat.empty()) {
+		return;
+	}
+
+	sort(lat.begin(), lat.end());
+	for (uint64_t l : lat) {
+		sum += l;
+	}
+	printf("%s: latency ns min %.3f mean %.3f p50 %.3f p99 %.3f "
+		"p999 %.3f max %.3f\n", name(),
+		lat.front() / 1e3, (double) sum / lat.size() / 1e3,
+		lat[lat.size() / 2] / 1e3,
+		lat[(lat.size() * 99) / 100] / 1e3,
+		lat[(lat.size() * 999) / 1000] / 1e3,
+		lat.back() / 1e3);
+}
@@ -0,0 +1,149 @@
+/*
+ * Ethernet frame generator and sink.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ETH_TRAFFIC_H__
+#define __ETH_TRAFFIC_H__
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+struct eth_frame_size {
+	unsigned int len;
+	unsigned int weight;
+};
+
+/*
+ * Describes the generated frames.  parse() takes a comma separated list
+ * of key=value pairs, e.g.
+ *   mix=64:7/594:4/1518:1,rate=10,count=100000
+ * Keys: pcap (file to replay instead of synthetic frames), loop (passes
+ * over the pcap file), timed (keep the gaps recorded in the pcap file
+ * instead of using rate), mix (frame sizes including the FCS and their
+ * weights, size:weight separated by /), rate (line rate in Gbit/s, 0 for
+ * back to back), count (frames, 0 for every frame of the pcap file), fcs
+ * (send the FCS with the frame), tag (stamp the frames for the sink, on
+ * by default for synthetic frames), drain (us to wait for the last frames
+ * before stopping), seed and stop (end the simulation when done).
+ */
+struct eth_traffic_config {
+	std::string pcap;
+	unsigned int loop;
+	bool timed;
+	std::vector<eth_frame_size> mix;
+	double rate;
+	uint64_t count;
+	bool fcs;
+	int tag;
+	unsigned int drain;
+	unsigned int seed;
+	bool stop;
+
+	eth_traffic_config();
+	bool parse(const char *spec);
+};
+
+/*
+ * Sends frames as TLM write transactions, one frame per transaction, the
+ * way the MAC and PHY models pass them around.  Frames are paced to the
+ * configured line rate, including preamble and inter-frame gap, and
+ * never faster than the target accepts them.
+ */
+class eth_traffic_gen
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_initiator_socket<eth_traffic_gen> init_socket;
+
+	eth_traffic_gen(sc_core::sc_module_name name,
+			const eth_traffic_config &cfg);
+	SC_HAS_PROCESS(eth_traffic_gen);
+
+	uint64_t frames_sent(void) const { return sent; }
+
+private:
+	eth_traffic_config cfg;
+	std::mt19937_64 rng;
+	std::discrete_distribution<unsigned int> pick;
+
+	/* Frames loaded from the pcap file and their offsets in ps.  */
+	std::vector<std::vector<unsigned char> > frames;
+	std::vector<uint64_t> stamps;
+
+	uint64_t sent;
+	uint64_t nr_errors;
+	uint64_t bytes;
+
+	sc_time start_time;
+	sc_time end_time;
+	std::chrono::steady_clock::time_point wall_start;
+	std::chrono::steady_clock::time_point wall_end;
+
+	/* Generators still sending, the last one stops the simulation.  */
+	static unsigned int nr_running;
+
+	void load_pcap(const char *path);
+	void build_frame(std::vector<unsigned char> &f, uint64_t n);
+	void start_of_simulation(void);
+	void end_of_simulation(void);
+	void worker(void);
+};
+
+/*
+ * Receives frames, counts them and, for frames an eth_traffic_gen
+ * stamped, measures their latency and spots lost and reordered frames.
+ * Accepts everything, so it never back-pressures the sender.
+ */
+class eth_traffic_sink
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<eth_traffic_sink> tgt_socket;
+
+	/* src, if given, lets the sink count the frames that never came.  */
+	eth_traffic_sink(sc_core::sc_module_name name,
+			const eth_traffic_gen *src = NULL);
+
+private:
+	const eth_traffic_gen *src;
+
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t nr_tagged;
+	uint64_t nr_lost;
+	uint64_t nr_reordered;
+	uint64_t next_seq;
+
+	sc_time first_time;
+	sc_time last_time;
+	std::chrono::steady_clock::time_point wall_first;
+	std::chrono::steady_clock::time_point wall_last;
+
+	/* Latency of each stamped frame in ps.  */
+	std::vector<uint64_t> latency;
+
+	void b_transport(tlm::tlm_generic_payload &trans, sc_time &delay);
+	void end_of_simulation(void);
+};
+#endif
@@ -0,0 +1,186 @@
+/*
+ * A clock that stops while the logic it drives is idle.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "gated-clock.h"
+
+gated_clock::gated_clock(const char *name, sc_time period,
+			unsigned int linger)
+	: sc_signal<bool>(name),
+	  clk_period(period),
+	  linger(linger),
+	  idle_edges(0),
+	  inflight(0),
+	  stopped(false),
+	  edges(0),
+	  stops(0)
+{
+	if (period == SC_ZERO_TIME) {
+		SC_REPORT_FATAL("gated-clock", "period must be non-zero");
+	}
+	wake_events |= ev_wake;
+}
+
+void gated_clock::add_busy(sc_signal_in_if<bool> &sig)
+{
+	busy_signals.push_back(&sig);
+	wake_events |= sig.value_changed_event();
+}
+
+void gated_clock::add_busy(std::function<bool(void)> busy)
+{
+	busy_funcs.push_back(busy);
+}
+
+void gated_clock::wake(void)
+{
+	idle_edges = 0;
+	if (stopped) {
+		ev_wake.notify(SC_ZERO_TIME);
+	}
+}
+
+bool gated_clock::busy(void)
+{
+	unsigned int i;
+
+	if (inflight) {
+		return true;
+	}
+	for (i = 0; i < busy_signals.size(); i++) {
+		if (busy_signals[i]->read()) {
+			return true;
+		}
+	}
+	for (i = 0; i < busy_funcs.size(); i++) {
+		if (busy_funcs[i]()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Runs once per clock edge while the clock runs.  The decision to stop
+ * is taken where the rising edge would be, so the clock always stops low
+ * after a full cycle.
+ */
+void gated_clock::tick(void)
+{
+	if (stopped) {
+		sc_time phase = sc_time::from_value(sc_time_stamp().value() %
+						clk_period.value());
+
+		stopped = false;
+		idle_edges = 0;
+		next_trigger(phase == SC_ZERO_TIME ?
+				SC_ZERO_TIME : clk_period - phase);
+		return;
+	}
+
+	if (read()) {
+		write(false);
+		next_trigger(clk_period - clk_period / 2);
+		return;
+	}
+
+	if (busy()) {
+		idle_edges = 0;
+	} else if (idle_edges >= linger) {
+		stopped = true;
+		stops++;
+		next_trigger(wake_events);
+		return;
+	} else {
+		idle_edges++;
+	}
+
+	write(true);
+	edges++;
+	next_trigger(clk_period / 2);
+}
+
+void gated_clock::before_end_of_elaboration(void)
+{
+	sc_spawn_options opts;
+
+	opts.spawn_method();
+	sc_spawn(sc_bind(&gated_clock::tick, this),
+		sc_gen_unique_name((string(basename()) + "_tick").c_str()),
+		&opts);
+}
+
+void gated_clock::end_of_simulation(void)
+{
+	double total = sc_time_stamp() / clk_period;
+
+	printf("%s: %" PRIu64 " of %.0f cycles clocked, stopped %" PRIu64
+		" times\n", name(), edges, total, stops);
+}
+
+clock_wake_probe::clock_wake_probe(sc_module_name name, gated_clock *clk)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  init_socket("init-socket"),
+	  clk(clk)
+{
+	tgt_socket.register_b_transport(this, &clock_wake_probe::b_transport);
+	tgt_socket.register_transport_dbg(this,
+				&clock_wake_probe::transport_dbg);
+}
+
+void clock_wake_probe::add_hook(
+		std::function<void(tlm::tlm_generic_payload &)> hook)
+{
+	hooks.push_back(hook);
+}
+
+void clock_wake_probe::b_transport(tlm::tlm_generic_payload& trans,
+					sc_time& delay)
+{
+	unsigned int i;
+
+	clk->begin();
+	init_socket->b_transport(trans, delay);
+	clk->end();
+
+	for (i = 0; i < hooks.size(); i++) {
+		hooks[i](trans);
+	}
+}
+
+/* Debug accesses take no time, so they don't need the clock.  */
+unsigned int clock_wake_probe::transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return init_socket->transport_dbg(trans);
+}
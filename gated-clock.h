@@ -0,0 +1,110 @@
+/*
+ * A clock that stops while the logic it drives is idle.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __GATED_CLOCK_H__
+#define __GATED_CLOCK_H__
+
+#include <functional>
+#include <vector>
+
+/*
+ * A drop-in for sc_clock, for RTL models that sit idle most of the time.
+ *
+ * The clock toggles with the given period while something keeps it busy,
+ * and stops low once nothing has for linger rising edges.  It is busy
+ * while a transaction is in flight through a clock_wake_probe, while a
+ * signal added with add_busy() is high, or while a function added with
+ * add_busy() returns true.  A stopped clock restarts on the next probe
+ * transaction or busy signal change, in phase with a free-running clock
+ * of the same period.
+ *
+ * linger must cover the RTL's latency from its last input to the outputs
+ * the busy signals and functions watch.  Logic that counts cycles, like a
+ * free-running counter, only counts while the clock runs, so RTL whose
+ * counters software can read belongs on an ungated clock.
+ */
+class gated_clock
+: public sc_core::sc_signal<bool>
+{
+public:
+	gated_clock(const char *name, sc_time period,
+			unsigned int linger = 64);
+
+	void add_busy(sc_core::sc_signal_in_if<bool> &sig);
+	void add_busy(std::function<bool(void)> busy);
+
+	/* Restart the clock, or keep it running for linger more edges.  */
+	void wake(void);
+
+	/* Bracket an access that needs the clock until it completes.  */
+	void begin(void) { inflight++; wake(); }
+	void end(void) { inflight--; }
+
+	const sc_time &period(void) const { return clk_period; }
+	virtual const char *kind() const { return "gated_clock"; }
+
+private:
+	sc_time clk_period;
+	unsigned int linger;
+	unsigned int idle_edges;
+	unsigned int inflight;
+	bool stopped;
+	sc_event ev_wake;
+	sc_event_or_list wake_events;
+	std::vector<sc_core::sc_signal_in_if<bool> *> busy_signals;
+	std::vector<std::function<bool(void)> > busy_funcs;
+
+	/* Statistics for the end of simulation report.  */
+	uint64_t edges;
+	uint64_t stops;
+
+	bool busy(void);
+	void tick(void);
+	void before_end_of_elaboration(void);
+	void end_of_simulation(void);
+};
+
+/*
+ * Pass-through that keeps a gated_clock running while a transaction is
+ * in flight, for the target sockets of the bridges into clocked RTL.
+ * Hooks see each transaction once it completes.
+ */
+class clock_wake_probe
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<clock_wake_probe> tgt_socket;
+	tlm_utils::simple_initiator_socket<clock_wake_probe> init_socket;
+
+	clock_wake_probe(sc_core::sc_module_name name, gated_clock *clk);
+
+	void add_hook(std::function<void(tlm::tlm_generic_payload &)> hook);
+
+private:
+	gated_clock *clk;
+	std::vector<std::function<void(tlm::tlm_generic_payload &)> > hooks;
+
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload& trans);
+};
+#endif
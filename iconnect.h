@@ -22,6 +22,12 @@
  * THE SOFTWARE.
  */
 
+#include <deque>
+#include <vector>
+
+#include "tlm-extensions/genattr.h"
+#include "tlm-pool.h"
+
 /*
  * To differentiate between targets that want to be passed absolute
  * addresses with every transaction. Most targets or slaves will use
@@ -38,6 +44,7 @@ struct memmap_entry {
 	uint64_t size;
 	enum addrmode addrmode;
 	int sk_idx;
+	bool posted;
 };
 
 template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
@@ -74,12 +81,46 @@ public:
 	 * to our target socket that gets all of it's accesses offset by
          * a base before entering the interconnect.  */
 	void set_target_offset(unsigned int id, sc_dt::uint64 offset);
+
+	/*
+	 * memmap()
+	 *
+	 * Maps [addr, addr + size] onto target socket s.  Writes to a
+	 * region mapped with posted = true are acknowledged immediately
+	 * and forwarded to the target later, in order, by a drain thread.
+	 * Any other access to the same target first waits for the posted
+	 * writes ahead of it to drain, so reads always observe them.
+	 * Targets in posted regions should never fail writes, as an error
+	 * can no longer be reported to the initiator.  That wait needs a
+	 * thread, so initiators running as method processes must not
+	 * reach targets mapped with posted = true.
+	 */
 	int memmap(sc_dt::uint64 addr, sc_dt::uint64 size,
-		enum addrmode addrmode, int idx, tlm::tlm_target_socket<> &s);
+		enum addrmode addrmode, int idx, tlm::tlm_target_socket<> &s,
+		bool posted = false);
 private:
 	sc_dt::int64 target_offset[N_INITIATORS];
 
-	unsigned int map_address(sc_dt::uint64 addr, sc_dt::uint64& offset);
+	/* A posted write waiting to be forwarded to its target.  */
+	struct posted_write {
+		tlm::tlm_generic_payload *gp;
+		std::vector<unsigned char> data;
+		std::vector<unsigned char> be;
+	};
+
+	/* Posted writes queued for each target socket.  */
+	std::deque<posted_write *> posted_queue[N_TARGETS];
+	sc_event posted_ev[N_TARGETS];
+	sc_event drained_ev[N_TARGETS];
+	bool drain_spawned[N_TARGETS];
+	std::vector<posted_write *> posted_free;
+
+	void post_write(unsigned int target_nr, tlm::tlm_generic_payload& trans);
+	void drain_posted(unsigned int target_nr);
+	void wait_posted(unsigned int target_nr);
+
+	unsigned int map_address(sc_dt::uint64 addr, sc_dt::uint64& offset,
+				bool *posted = NULL);
 	void unmap_offset(unsigned int target_nr,
 				sc_dt::uint64 offset, sc_dt::uint64& addr);
 
@@ -112,6 +153,7 @@ iconnect<N_INITIATORS, N_TARGETS>::iconnect (sc_module_name name)
 		i_sk[i]->register_invalidate_direct_mem_ptr(this,
 				&iconnect::invalidate_direct_mem_ptr, i);
 		map[i].size = 0;
+		drain_spawned[i] = false;
 	}
 }
 
@@ -127,7 +169,7 @@ template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
 int iconnect<N_INITIATORS, N_TARGETS>::memmap(
 		sc_dt::uint64 addr, sc_dt::uint64 size,
 		enum addrmode addrmode, int idx,
-		tlm::tlm_target_socket<> &s)
+		tlm::tlm_target_socket<> &s, bool posted)
 {
 	unsigned int i;
 
@@ -138,10 +180,17 @@ int iconnect<N_INITIATORS, N_TARGETS>::memmap(
 			map[i].size = size;
 			map[i].addrmode = addrmode;
 			map[i].sk_idx = i;
+			map[i].posted = posted;
 			if (idx == -1)
 				i_sk[i]->bind(s);
 			else
 				map[i].sk_idx = idx;
+
+			if (posted && !drain_spawned[map[i].sk_idx]) {
+				drain_spawned[map[i].sk_idx] = true;
+				sc_spawn(sc_bind(&iconnect::drain_posted, this,
+						 map[i].sk_idx));
+			}
 			return i;
 		}
 	}
@@ -153,7 +202,8 @@ int iconnect<N_INITIATORS, N_TARGETS>::memmap(
 template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
 unsigned int iconnect<N_INITIATORS, N_TARGETS>::map_address(
 			sc_dt::uint64 addr,
-			sc_dt::uint64& offset)
+			sc_dt::uint64& offset,
+			bool *posted)
 {
 	unsigned int i;
 
@@ -166,6 +216,9 @@ unsigned int iconnect<N_INITIATORS, N_TARGETS>::map_address(
 			} else {
 				offset = addr;
 			}
+			if (posted) {
+				*posted = map[i].posted;
+			}
 			return map[i].sk_idx;
 		}
 	}
@@ -205,6 +258,7 @@ void iconnect<N_INITIATORS, N_TARGETS>::b_transport(int id,
 	sc_dt::uint64 addr;
 	sc_dt::uint64 offset;
 	unsigned int target_nr;
+	bool posted = false;
 
 	if (id >= (int) N_INITIATORS) {
 		SC_REPORT_FATAL("TLM-2", "Invalid socket tag in iconnect\n");
@@ -212,15 +266,116 @@ void iconnect<N_INITIATORS, N_TARGETS>::b_transport(int id,
 
 	addr = trans.get_address();
 	addr += target_offset[id];
-	target_nr = map_address(addr, offset);
+	target_nr = map_address(addr, offset, &posted);
 
 	trans.set_address(offset);
-	/* Forward the transaction.  */
-	(*i_sk[target_nr])->b_transport(trans, delay);
+	if (posted && trans.get_command() == tlm::TLM_WRITE_COMMAND) {
+		post_write(target_nr, trans);
+	} else {
+		/* Let earlier posted writes land first.  */
+		wait_posted(target_nr);
+
+		/* Forward the transaction.  */
+		(*i_sk[target_nr])->b_transport(trans, delay);
+	}
 	/* Restore the addresss.  */
 	trans.set_address(addr);
 }
 
+/*
+ * Queues a copy of a write for the drain thread and acknowledges it.  The
+ * copy carries the data, byte enables and the genattr extension (master
+ * id etc), which is all the demo targets look at.
+ */
+template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
+void iconnect<N_INITIATORS, N_TARGETS>::post_write(unsigned int target_nr,
+			tlm::tlm_generic_payload& trans)
+{
+	unsigned int len = trans.get_data_length();
+	unsigned int be_len = trans.get_byte_enable_length();
+	genattr_extension *genattr;
+	posted_write *pw;
+
+	if (posted_free.empty()) {
+		pw = new posted_write;
+	} else {
+		pw = posted_free.back();
+		posted_free.pop_back();
+	}
+
+	pw->gp = tlm_payload_pool::shared().allocate();
+	pw->data.assign(trans.get_data_ptr(), trans.get_data_ptr() + len);
+	pw->gp->set_command(tlm::TLM_WRITE_COMMAND);
+	pw->gp->set_address(trans.get_address());
+	pw->gp->set_data_ptr(pw->data.data());
+	pw->gp->set_data_length(len);
+	pw->gp->set_streaming_width(trans.get_streaming_width());
+	pw->gp->set_dmi_allowed(false);
+	pw->gp->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+	if (trans.get_byte_enable_ptr() && be_len) {
+		pw->be.assign(trans.get_byte_enable_ptr(),
+			      trans.get_byte_enable_ptr() + be_len);
+		pw->gp->set_byte_enable_ptr(pw->be.data());
+		pw->gp->set_byte_enable_length(be_len);
+	} else {
+		pw->gp->set_byte_enable_ptr(NULL);
+		pw->gp->set_byte_enable_length(0);
+	}
+
+	trans.get_extension(genattr);
+	if (genattr) {
+		tlm_payload_pool::get_extension<genattr_extension>(pw->gp)
+			->copy_from(*genattr);
+	}
+
+	posted_queue[target_nr].push_back(pw);
+	posted_ev[target_nr].notify();
+
+	trans.set_dmi_allowed(false);
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+}
+
+/* Forwards posted writes to a target in the order they were posted.  */
+template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
+void iconnect<N_INITIATORS, N_TARGETS>::drain_posted(unsigned int target_nr)
+{
+	while (true) {
+		while (posted_queue[target_nr].empty()) {
+			drained_ev[target_nr].notify();
+			wait(posted_ev[target_nr]);
+		}
+
+		posted_write *pw = posted_queue[target_nr].front();
+		sc_time delay(SC_ZERO_TIME);
+
+		(*i_sk[target_nr])->b_transport(*pw->gp, delay);
+		if (pw->gp->get_response_status() != tlm::TLM_OK_RESPONSE) {
+			printf("%s: posted write to %lx failed\n", name(),
+				(unsigned long) pw->gp->get_address());
+		}
+		wait(delay);
+
+		posted_queue[target_nr].pop_front();
+		pw->gp->release();
+		posted_free.push_back(pw);
+	}
+}
+
+template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
+void iconnect<N_INITIATORS, N_TARGETS>::wait_posted(unsigned int target_nr)
+{
+	if (!posted_queue[target_nr].empty() &&
+	    sc_get_current_process_handle().proc_kind() == SC_METHOD_PROC_) {
+		SC_REPORT_FATAL("iconnect", "a method process can not wait "
+				"for posted writes, map the target without "
+				"posted or run the initiator as a thread");
+	}
+	while (!posted_queue[target_nr].empty()) {
+		wait(drained_ev[target_nr]);
+	}
+}
+
 template<unsigned int N_INITIATORS, unsigned int N_TARGETS>
 bool iconnect<N_INITIATORS, N_TARGETS>::get_direct_mem_ptr(int id,
 					tlm::tlm_generic_payload& trans,
@@ -229,6 +384,7 @@ bool iconnect<N_INITIATORS, N_TARGETS>::get_direct_mem_ptr(int id,
 	sc_dt::uint64 addr;
 	sc_dt::uint64 offset;
 	unsigned int target_nr;
+	bool posted = false;
 	bool r;
 
 	if (id >= (int) N_INITIATORS) {
@@ -237,7 +393,12 @@ bool iconnect<N_INITIATORS, N_TARGETS>::get_direct_mem_ptr(int id,
 
 	addr = trans.get_address();
 	addr += target_offset[id];
-	target_nr = map_address(addr, offset);
+	target_nr = map_address(addr, offset, &posted);
+
+	/* Direct accesses would overtake queued posted writes.  */
+	if (posted) {
+		return false;
+	}
 
 	trans.set_address(offset);
 	/* Forward the transaction.  */
@@ -0,0 +1,266 @@
+/*
+ * The LMAC RTL on a host thread of its own.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __LMAC_RTL_THREAD_H__
+#define __LMAC_RTL_THREAD_H__
+
+#include <type_traits>
+#include "rtl-thread.h"
+
+/* The LMAC's input pins, for one cycle.  */
+template<int DATA_WIDTH>
+struct lmac_rtl_in {
+	bool rst_n;
+	uint64_t xgmii_rxd;
+	uint8_t xgmii_rxc;
+	uint32_t tx_tdata[DATA_WIDTH / 32];
+	uint32_t tx_tstrb;
+	bool tx_tvalid;
+	bool tx_tlast;
+	bool tx_tuser;
+	bool rx_tready;
+	uint16_t host_addr_reg;
+	bool reg_rd_start;
+};
+
+/* The LMAC's output pins, after one cycle.  */
+template<int DATA_WIDTH>
+struct lmac_rtl_out {
+	uint64_t xgmii_txd;
+	uint8_t xgmii_txc;
+	bool tx_tready;
+	uint32_t rx_tdata[DATA_WIDTH / 32];
+	uint32_t rx_tstrb;
+	bool rx_tvalid;
+	bool rx_tlast;
+	bool rx_tuser;
+	bool reg_rd_done_out;
+	uint32_t regdout;
+};
+
+/*
+ * Takes the place of the Verilated SystemC LMAC wrapper (Vlmac_wrapper_top
+ * or Vlmac3_wrapper_top), with the same pins, when the model is Verilated
+ * with --cc instead of --sc.  The model is created and evaluated on the
+ * host thread, see rtl_thread.
+ */
+template<class MODEL, int DATA_WIDTH>
+class lmac_rtl_thread
+: public rtl_thread<lmac_rtl_in<DATA_WIDTH>, lmac_rtl_out<DATA_WIDTH> >
+{
+public:
+	typedef lmac_rtl_in<DATA_WIDTH> in_t;
+	typedef lmac_rtl_out<DATA_WIDTH> out_t;
+
+	sc_in<bool> rst_n;
+
+	sc_in<sc_bv<64> > xgmii_rxd;
+	sc_in<sc_bv<8> > xgmii_rxc;
+	sc_out<sc_bv<64> > xgmii_txd;
+	sc_out<sc_bv<8> > xgmii_txc;
+
+	sc_in<sc_bv<DATA_WIDTH> > tx_axis_mac_tdata;
+	sc_in<bool> tx_axis_mac_tvalid;
+	sc_in<bool> tx_axis_mac_tlast;
+	sc_in<bool> tx_axis_mac_tuser;
+	sc_in<sc_bv<DATA_WIDTH / 8> > tx_axis_mac_tstrb;
+	sc_out<bool> tx_axis_mac_tready;
+
+	sc_out<sc_bv<DATA_WIDTH> > rx_axis_mac_tdata;
+	sc_out<bool> rx_axis_mac_tvalid;
+	sc_out<bool> rx_axis_mac_tlast;
+	sc_out<bool> rx_axis_mac_tuser;
+	sc_out<sc_bv<DATA_WIDTH / 8> > rx_axis_mac_tstrb;
+	sc_in<bool> rx_axis_mac_tready;
+
+	sc_in<sc_bv<16> > host_addr_reg;
+	sc_in<bool> reg_rd_start;
+	sc_out<bool> reg_rd_done_out;
+	sc_out<sc_bv<32> > FMAC_REGDOUT;
+
+	lmac_rtl_thread(sc_core::sc_module_name name, unsigned int lag = 1)
+		: rtl_thread<in_t, out_t>(name, lag),
+		  rst_n("rst_n"),
+		  xgmii_rxd("xgmii_rxd"),
+		  xgmii_rxc("xgmii_rxc"),
+		  xgmii_txd("xgmii_txd"),
+		  xgmii_txc("xgmii_txc"),
+		  tx_axis_mac_tdata("tx_axis_mac_tdata"),
+		  tx_axis_mac_tvalid("tx_axis_mac_tvalid"),
+		  tx_axis_mac_tlast("tx_axis_mac_tlast"),
+		  tx_axis_mac_tuser("tx_axis_mac_tuser"),
+		  tx_axis_mac_tstrb("tx_axis_mac_tstrb"),
+		  tx_axis_mac_tready("tx_axis_mac_tready"),
+		  rx_axis_mac_tdata("rx_axis_mac_tdata"),
+		  rx_axis_mac_tvalid("rx_axis_mac_tvalid"),
+		  rx_axis_mac_tlast("rx_axis_mac_tlast"),
+		  rx_axis_mac_tuser("rx_axis_mac_tuser"),
+		  rx_axis_mac_tstrb("rx_axis_mac_tstrb"),
+		  rx_axis_mac_tready("rx_axis_mac_tready"),
+		  host_addr_reg("host_addr_reg"),
+		  reg_rd_start("reg_rd_start"),
+		  reg_rd_done_out("reg_rd_done_out"),
+		  FMAC_REGDOUT("FMAC_REGDOUT"),
+		  model(NULL)
+	{
+	}
+
+	~lmac_rtl_thread()
+	{
+		/* Joins the host thread before the model goes away.  */
+		this->stop_rtl();
+		if (model) {
+			model->final();
+			delete model;
+		}
+	}
+
+private:
+	/* Only touched by the host thread.  */
+	MODEL *model;
+
+	/* Verilator keeps up to 64 bits in an integer, wider in words.  */
+	template<class P>
+	static typename std::enable_if<std::is_integral<P>::value>::type
+	to_pin(P &p, const uint32_t *w)
+	{
+		p = DATA_WIDTH > 32 ? w[0] | (uint64_t) w[1] << 32 : w[0];
+	}
+
+	template<class P>
+	static typename std::enable_if<!std::is_integral<P>::value>::type
+	to_pin(P &p, const uint32_t *w)
+	{
+		int i;
+
+		for (i = 0; i < DATA_WIDTH / 32; i++) {
+			p[i] = w[i];
+		}
+	}
+
+	template<class P>
+	static typename std::enable_if<std::is_integral<P>::value>::type
+	from_pin(const P &p, uint32_t *w)
+	{
+		w[0] = p;
+		if (DATA_WIDTH > 32) {
+			w[1] = (uint64_t) p >> 32;
+		}
+	}
+
+	template<class P>
+	static typename std::enable_if<!std::is_integral<P>::value>::type
+	from_pin(const P &p, uint32_t *w)
+	{
+		int i;
+
+		for (i = 0; i < DATA_WIDTH / 32; i++) {
+			w[i] = p[i];
+		}
+	}
+
+	void rtl_sample(in_t &in)
+	{
+		const sc_bv<DATA_WIDTH> &tdata = tx_axis_mac_tdata.read();
+		int i;
+
+		in.rst_n = rst_n.read();
+		in.xgmii_rxd = xgmii_rxd.read().to_uint64();
+		in.xgmii_rxc = xgmii_rxc.read().to_uint();
+		for (i = 0; i < DATA_WIDTH / 32; i++) {
+			in.tx_tdata[i] = tdata.get_word(i);
+		}
+		in.tx_tstrb = tx_axis_mac_tstrb.read().to_uint();
+		in.tx_tvalid = tx_axis_mac_tvalid.read();
+		in.tx_tlast = tx_axis_mac_tlast.read();
+		in.tx_tuser = tx_axis_mac_tuser.read();
+		in.rx_tready = rx_axis_mac_tready.read();
+		in.host_addr_reg = host_addr_reg.read().to_uint();
+		in.reg_rd_start = reg_rd_start.read();
+	}
+
+	void rtl_apply(const out_t &out)
+	{
+		sc_bv<DATA_WIDTH> tdata;
+		int i;
+
+		for (i = 0; i < DATA_WIDTH / 32; i++) {
+			tdata.set_word(i, out.rx_tdata[i]);
+		}
+
+		xgmii_txd.write(sc_bv<64>(out.xgmii_txd));
+		xgmii_txc.write(sc_bv<8>(out.xgmii_txc));
+		tx_axis_mac_tready.write(out.tx_tready);
+		rx_axis_mac_tdata.write(tdata);
+		rx_axis_mac_tvalid.write(out.rx_tvalid);
+		rx_axis_mac_tlast.write(out.rx_tlast);
+		rx_axis_mac_tuser.write(out.rx_tuser);
+		rx_axis_mac_tstrb.write(sc_bv<DATA_WIDTH / 8>(out.rx_tstrb));
+		reg_rd_done_out.write(out.reg_rd_done_out);
+		FMAC_REGDOUT.write(sc_bv<32>(out.regdout));
+	}
+
+	void read_outputs(out_t &out)
+	{
+		out.xgmii_txd = model->xgmii_txd;
+		out.xgmii_txc = model->xgmii_txc;
+		out.tx_tready = model->tx_axis_mac_tready;
+		from_pin(model->rx_axis_mac_tdata, out.rx_tdata);
+		out.rx_tstrb = model->rx_axis_mac_tstrb;
+		out.rx_tvalid = model->rx_axis_mac_tvalid;
+		out.rx_tlast = model->rx_axis_mac_tlast;
+		out.rx_tuser = model->rx_axis_mac_tuser;
+		out.reg_rd_done_out = model->reg_rd_done_out;
+		out.regdout = model->FMAC_REGDOUT;
+	}
+
+	void rtl_settle(out_t &out)
+	{
+		model = new MODEL(this->name());
+		model->clk = 0;
+		model->eval();
+		read_outputs(out);
+	}
+
+	void rtl_cycle(const in_t &in, out_t &out)
+	{
+		model->clk = 0;
+		model->rst_n = in.rst_n;
+		model->xgmii_rxd = in.xgmii_rxd;
+		model->xgmii_rxc = in.xgmii_rxc;
+		to_pin(model->tx_axis_mac_tdata, in.tx_tdata);
+		model->tx_axis_mac_tstrb = in.tx_tstrb;
+		model->tx_axis_mac_tvalid = in.tx_tvalid;
+		model->tx_axis_mac_tlast = in.tx_tlast;
+		model->tx_axis_mac_tuser = in.tx_tuser;
+		model->rx_axis_mac_tready = in.rx_tready;
+		model->host_addr_reg = in.host_addr_reg;
+		model->reg_rd_start = in.reg_rd_start;
+		model->eval();
+
+		model->clk = 1;
+		model->eval();
+		read_outputs(out);
+	}
+};
+#endif
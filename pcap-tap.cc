@@ -0,0 +1,422 @@
+/*
+ * Pass-through TLM tap that captures frames to a pcapng file.
+ *
+ * The tap copies each frame, cut to the snaplen, into a ring and goes
+ * on.  A writer thread drains the ring into Enhanced Packet Blocks with
+ * the simulated time of the first byte as timestamp, in ns.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "tlm-extensions/genattr.h"
+#include "pcap-tap.h"
+
+#define PCAPNG_SHB		0x0a0d0d0a
+#define PCAPNG_IDB		0x00000001
+#define PCAPNG_EPB		0x00000006
+#define PCAPNG_BOM		0x1a2b3c4d
+#define PCAPNG_LINKTYPE_ETHERNET	1
+
+#define PCAPNG_OPT_END		0
+#define PCAPNG_OPT_IF_NAME	2
+#define PCAPNG_OPT_IF_TSRESOL	9
+
+static size_t pad4(size_t len)
+{
+	return (len + 3) & ~(size_t) 3;
+}
+
+pcap_tap_config::pcap_tap_config()
+	: snaplen(65535),
+	  ethertype(-1),
+	  min_len(0),
+	  max_len(~0U),
+	  every(1),
+	  ring_kb(8192)
+{
+}
+
+bool pcap_tap_config::parse(const char *spec)
+{
+	string s(spec);
+	size_t pos = s.find(',');
+
+	path = s.substr(0, pos);
+	pos = pos == string::npos ? s.size() : pos + 1;
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos);
+		string item = s.substr(pos, end == string::npos ?
+						string::npos : end - pos);
+		size_t eq = item.find('=');
+		string key, val;
+
+		pos = end == string::npos ? s.size() : end + 1;
+		if (item.empty()) {
+			continue;
+		}
+		if (eq == string::npos) {
+			printf("pcap-tap: missing value for %s\n",
+				item.c_str());
+			return false;
+		}
+		key = item.substr(0, eq);
+		val = item.substr(eq + 1);
+
+		if (key == "snaplen") {
+			snaplen = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "ethertype") {
+			ethertype = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "min") {
+			min_len = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "max") {
+			max_len = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "every") {
+			every = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "ring") {
+			ring_kb = strtoul(val.c_str(), NULL, 0);
+		} else {
+			printf("pcap-tap: unknown key %s\n", key.c_str());
+			return false;
+		}
+	}
+
+	if (path.empty() || path.find('=') != string::npos ||
+	    snaplen == 0 || every == 0 || ring_kb == 0 ||
+	    ethertype > 0xffff) {
+		printf("pcap-tap: invalid configuration\n");
+		return false;
+	}
+	return true;
+}
+
+pcap_writer::pcap_writer(sc_module_name name, const pcap_tap_config &cfg)
+	: sc_module(name),
+	  cfg(cfg),
+	  nr_ifaces(0),
+	  head(0),
+	  tail(0),
+	  quit(false),
+	  nr_frames(0),
+	  nr_bytes(0),
+	  nr_dropped(0)
+{
+	struct {
+		uint32_t bom;
+		uint16_t major;
+		uint16_t minor;
+		int64_t section_len;
+	} shb = { PCAPNG_BOM, 1, 0, -1 };
+	size_t size = 4096;
+
+	/* A power of two, so positions wrap with a mask.  */
+	while (size < (size_t) cfg.ring_kb * 1024) {
+		size <<= 1;
+	}
+	ring.resize(size);
+
+	fp = fopen(cfg.path.c_str(), "wb");
+	if (!fp) {
+		perror(cfg.path.c_str());
+		SC_REPORT_FATAL("pcap-tap", "unable to create capture file");
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+	write_block(PCAPNG_SHB, &shb, sizeof shb);
+
+	writer = thread(&pcap_writer::run, this);
+}
+
+pcap_writer::~pcap_writer()
+{
+	close();
+}
+
+size_t pcap_writer::record_size(unsigned int len) const
+{
+	return sizeof(record) + ((len + 7) & ~7U);
+}
+
+void pcap_writer::put(uint64_t at, const void *p, size_t len)
+{
+	size_t off = at & (ring.size() - 1);
+	size_t n = min(len, ring.size() - off);
+
+	memcpy(&ring[off], p, n);
+	memcpy(&ring[0], (const unsigned char *) p + n, len - n);
+}
+
+void pcap_writer::get(uint64_t at, void *p, size_t len)
+{
+	size_t off = at & (ring.size() - 1);
+	size_t n = min(len, ring.size() - off);
+
+	memcpy(p, &ring[off], n);
+	memcpy((unsigned char *) p + n, &ring[0], len - n);
+}
+
+unsigned int pcap_writer::add_interface(const char *ifname)
+{
+	record r = { REC_IFACE, nr_ifaces, (uint32_t) strlen(ifname),
+			cfg.snaplen, 0 };
+	uint64_t t = tail.load(memory_order_relaxed);
+
+	/* Only added at elaboration, so there is room.  */
+	put(t, &r, sizeof r);
+	put(t + sizeof r, ifname, r.len);
+	tail.store(t + record_size(r.len), memory_order_release);
+	return nr_ifaces++;
+}
+
+void pcap_writer::capture(unsigned int iface, uint64_t ts_ps,
+			const unsigned char *data, unsigned int len,
+			unsigned int orig_len)
+{
+	record r = { REC_FRAME, iface, len, orig_len, ts_ps };
+	uint64_t t = tail.load(memory_order_relaxed);
+	size_t need = record_size(len);
+
+	if (need > ring.size() - (t - head.load(memory_order_acquire))) {
+		nr_dropped++;
+		return;
+	}
+	put(t, &r, sizeof r);
+	put(t + sizeof r, data, len);
+	tail.store(t + need, memory_order_release);
+
+	nr_frames++;
+	nr_bytes += len;
+}
+
+/* Writes a pcapng block in host byte order, which the BOM tells.  */
+void pcap_writer::write_block(uint32_t type, const void *body, size_t len)
+{
+	static const unsigned char zero[4] = { 0 };
+	uint32_t total = 12 + pad4(len);
+
+	fwrite(&type, 4, 1, fp);
+	fwrite(&total, 4, 1, fp);
+	fwrite(body, len, 1, fp);
+	fwrite(zero, pad4(len) - len, 1, fp);
+	fwrite(&total, 4, 1, fp);
+}
+
+void pcap_writer::run(void)
+{
+	vector<unsigned char> buf;
+	vector<unsigned char> body;
+
+	for (;;) {
+		bool done = quit.load(memory_order_acquire);
+		uint64_t h = head.load(memory_order_relaxed);
+		uint64_t ts;
+		record r;
+
+		if (h == tail.load(memory_order_acquire)) {
+			if (done) {
+				break;
+			}
+			/* Polls, so the simulation never has to wake us.  */
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait_for(lock, chrono::milliseconds(1));
+			continue;
+		}
+
+		get(h, &r, sizeof r);
+		buf.resize(r.len);
+		get(h + sizeof r, buf.data(), r.len);
+		head.store(h + record_size(r.len), memory_order_release);
+
+		body.clear();
+		if (r.kind == REC_IFACE) {
+			uint16_t opt[2];
+			uint32_t snaplen = r.orig_len;
+			uint16_t hdr[2] = { PCAPNG_LINKTYPE_ETHERNET, 0 };
+			unsigned char tsresol[4] = { 9, 0, 0, 0 };
+
+			body.insert(body.end(), (unsigned char *) hdr,
+					(unsigned char *) (hdr + 2));
+			body.insert(body.end(), (unsigned char *) &snaplen,
+					(unsigned char *) (&snaplen + 1));
+
+			opt[0] = PCAPNG_OPT_IF_NAME;
+			opt[1] = r.len;
+			body.insert(body.end(), (unsigned char *) opt,
+					(unsigned char *) (opt + 2));
+			body.insert(body.end(), buf.begin(), buf.end());
+			body.resize(pad4(body.size()));
+
+			opt[0] = PCAPNG_OPT_IF_TSRESOL;
+			opt[1] = 1;
+			body.insert(body.end(), (unsigned char *) opt,
+					(unsigned char *) (opt + 2));
+			body.insert(body.end(), tsresol, tsresol + 4);
+
+			opt[0] = PCAPNG_OPT_END;
+			opt[1] = 0;
+			body.insert(body.end(), (unsigned char *) opt,
+					(unsigned char *) (opt + 2));
+			write_block(PCAPNG_IDB, body.data(), body.size());
+			continue;
+		}
+
+		ts = r.ts_ps / 1000;
+		uint32_t epb[5] = { r.iface, (uint32_t) (ts >> 32),
+					(uint32_t) ts, r.len, r.orig_len };
+
+		body.insert(body.end(), (unsigned char *) epb,
+				(unsigned char *) (epb + 5));
+		body.insert(body.end(), buf.begin(), buf.end());
+		write_block(PCAPNG_EPB, body.data(), body.size());
+	}
+}
+
+void pcap_writer::close(void)
+{
+	if (!writer.joinable()) {
+		return;
+	}
+
+	quit.store(true, memory_order_release);
+	cond.notify_one();
+	writer.join();
+	fclose(fp);
+	fp = NULL;
+}
+
+void pcap_writer::end_of_simulation(void)
+{
+	close();
+	printf("%s: %" PRIu64 " frames, %" PRIu64 " bytes captured to %s, "
+		"%" PRIu64 " dropped\n", name(), nr_frames, nr_bytes,
+		cfg.path.c_str(), nr_dropped);
+}
+
+pcap_tap::pcap_tap(sc_module_name name, pcap_writer *w)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  init_socket("init-socket"),
+	  w(w),
+	  iface(0),
+	  frame_len(0),
+	  frame_ts(0),
+	  nr_matched(0)
+{
+	tgt_socket.register_b_transport(this, &pcap_tap::b_transport);
+	tgt_socket.register_transport_dbg(this, &pcap_tap::transport_dbg);
+	tgt_socket.register_get_direct_mem_ptr(this,
+				&pcap_tap::get_direct_mem_ptr);
+	init_socket.register_invalidate_direct_mem_ptr(this,
+				&pcap_tap::invalidate_direct_mem_ptr);
+
+	if (w) {
+		iface = w->add_interface(this->name());
+		frame.reserve(max(w->config().snaplen, 14U));
+	}
+}
+
+/* Applies the filters to the frame just completed.  */
+bool pcap_tap::match(void)
+{
+	const pcap_tap_config &cfg = w->config();
+
+	if (frame_len < cfg.min_len || frame_len > cfg.max_len) {
+		return false;
+	}
+	if (cfg.ethertype >= 0 &&
+	    (frame.size() < 14 ||
+	     (frame[12] << 8 | frame[13]) != cfg.ethertype)) {
+		return false;
+	}
+	return nr_matched++ % cfg.every == 0;
+}
+
+void pcap_tap::b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
+{
+	unsigned int len = trans.get_data_length();
+	genattr_extension *genattr;
+	bool eop = true;
+
+	if (w && trans.is_write()) {
+		unsigned int keep = max(w->config().snaplen, 14U);
+
+		trans.get_extension(genattr);
+		if (genattr) {
+			eop = genattr->get_eop();
+		}
+
+		if (frame_len == 0) {
+			frame_ts = (uint64_t)
+				((sc_time_stamp() + delay).to_seconds() * 1e12);
+		}
+		if (frame.size() < keep) {
+			unsigned int n = min(len, keep - (unsigned int)
+							frame.size());
+
+			frame.insert(frame.end(), trans.get_data_ptr(),
+					trans.get_data_ptr() + n);
+		}
+		frame_len += len;
+
+		if (eop) {
+			if (match()) {
+				w->capture(iface, frame_ts, frame.data(),
+					min((unsigned int) frame.size(),
+						w->config().snaplen),
+					frame_len);
+			}
+			frame.clear();
+			frame_len = 0;
+		}
+	}
+
+	init_socket->b_transport(trans, delay);
+}
+
+unsigned int pcap_tap::transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return init_socket->transport_dbg(trans);
+}
+
+/* Frames never go through DMI, so let the target hand it out.  */
+bool pcap_tap::get_direct_mem_ptr(tlm::tlm_generic_payload& trans,
+				tlm::tlm_dmi& dmi_data)
+{
+	return init_socket->get_direct_mem_ptr(trans, dmi_data);
+}
+
+void pcap_tap::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+					sc_dt::uint64 end)
+{
+	tgt_socket->invalidate_direct_mem_ptr(start, end);
+}
@@ -0,0 +1,151 @@
+/*
+ * Pass-through TLM tap that captures frames to a pcapng file.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __PCAP_TAP_H__
+#define __PCAP_TAP_H__
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Describes a capture.  parse() takes the file name followed by comma
+ * separated key=value pairs, e.g.
+ *   mac.pcapng,snaplen=128,ethertype=0x0800,every=10
+ * Keys: snaplen (bytes kept of each frame), ethertype (only frames of
+ * this type), min and max (only frames of these lengths), every (only
+ * every n'th frame that passes the other filters) and ring (KiB buffered
+ * between the simulation and the writer thread).
+ */
+struct pcap_tap_config {
+	std::string path;
+	unsigned int snaplen;
+	int ethertype;
+	unsigned int min_len;
+	unsigned int max_len;
+	unsigned int every;
+	unsigned int ring_kb;
+
+	pcap_tap_config();
+	bool parse(const char *spec);
+};
+
+/*
+ * Writes the pcapng file on a host thread of its own.  The simulation
+ * thread copies frames into a lock-free ring and never waits for the
+ * file, frames that find the ring full are dropped and counted.  Taps
+ * share a writer and show up as the interfaces of its file.
+ */
+class pcap_writer
+: public sc_core::sc_module
+{
+public:
+	pcap_writer(sc_core::sc_module_name name, const pcap_tap_config &cfg);
+	~pcap_writer();
+
+	const pcap_tap_config &config(void) const { return cfg; }
+
+	/* Adds an interface, before any frame is captured on it.  */
+	unsigned int add_interface(const char *ifname);
+
+	/* Queues a frame, only ever called from the simulation thread.  */
+	void capture(unsigned int iface, uint64_t ts_ps,
+			const unsigned char *data, unsigned int len,
+			unsigned int orig_len);
+
+	/* Drains the ring and closes the file.  */
+	void close(void);
+
+private:
+	enum { REC_FRAME, REC_IFACE };
+
+	struct record {
+		uint32_t kind;
+		uint32_t iface;
+		uint32_t len;
+		uint32_t orig_len;
+		uint64_t ts_ps;
+	};
+
+	pcap_tap_config cfg;
+	FILE *fp;
+	unsigned int nr_ifaces;
+
+	std::vector<unsigned char> ring;
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> tail;
+	std::atomic<bool> quit;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread writer;
+
+	uint64_t nr_frames;
+	uint64_t nr_bytes;
+	uint64_t nr_dropped;
+
+	size_t record_size(unsigned int len) const;
+	void put(uint64_t at, const void *p, size_t len);
+	void get(uint64_t at, void *p, size_t len);
+	void write_block(uint32_t type, const void *body, size_t len);
+	void run(void);
+	void end_of_simulation(void);
+};
+
+/*
+ * Passes transactions through unchanged and captures the frames written
+ * through it.  A frame split over several transactions is put back
+ * together, up to the transaction with EOP set in its genattr extension.
+ * Without a writer the tap only passes transactions through, so demos
+ * can keep it in place whether or not they capture.
+ */
+class pcap_tap
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<pcap_tap> tgt_socket;
+	tlm_utils::simple_initiator_socket<pcap_tap> init_socket;
+
+	pcap_tap(sc_core::sc_module_name name, pcap_writer *w);
+
+private:
+	pcap_writer *w;
+	unsigned int iface;
+
+	/* The frame being put together.  */
+	std::vector<unsigned char> frame;
+	unsigned int frame_len;
+	uint64_t frame_ts;
+	uint64_t nr_matched;
+
+	bool match(void);
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload& trans);
+	bool get_direct_mem_ptr(tlm::tlm_generic_payload& trans,
+				tlm::tlm_dmi& dmi_data);
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
+};
+#endif
@@ -29,14 +29,17 @@
 #define __PCI_ACC_H__
 
 #include "tlm.h"
+#include "tlm_utils/tlm_quantumkeeper.h"
 #include "soc/pci/core/pci-device-base.h"
 #include "tlm-extensions/atsattr.h"
+#include "tlm-pool.h"
+#include "checkpoint.h"
 #include <openssl/md5.h>
 
 #define NR_MMIO_BAR  1
 #define NR_IRQ  0
 
-class pcie_acc : public pci_device_base
+class pcie_acc : public pci_device_base, public checkpointable
 {
 private:
 	//
@@ -93,8 +96,10 @@ private:
 		//
 		// virt_addr: region start address
 		// length: region length
+		// qk: the calling thread's quantum keeper
 		//
-		void do_ats_req(uint64_t virt_addr, uint64_t length)
+		void do_ats_req(uint64_t virt_addr, uint64_t length,
+				tlm_utils::tlm_quantumkeeper &qk)
 		{
 			//
 			// Make sure to have the translations naturally
@@ -104,29 +109,34 @@ private:
 			virt_addr &= ~(SZ_4K-1);
 
                         while (length) {
-				atsattr_extension *atsattr = new atsattr_extension();
+				tlm::tlm_generic_payload *gp = tlm_payload_pool::shared().allocate();
+				atsattr_extension *atsattr;
 				sc_time delay(SC_ZERO_TIME);
-				tlm::tlm_generic_payload gp;
 				uint64_t attr = atsattr_extension::ATTR_WRITE |
 						atsattr_extension::ATTR_READ |
 						atsattr_extension::ATTR_EXEC;
 
-				gp.set_extension(atsattr);
-				gp.set_command(tlm::TLM_IGNORE_COMMAND);
+				atsattr = tlm_payload_pool::get_extension<atsattr_extension>(gp);
+				gp->set_command(tlm::TLM_IGNORE_COMMAND);
+				delay = qk.get_local_time();
 
 				//
 				// Set the ATS translation request's region start
 				// address and attributes
 				//
-				gp.set_address(virt_addr);
+				gp->set_address(virt_addr);
 				atsattr->set_attributes(attr);
 
 				//
 				// Transmit the ATS request
 				//
-				m_ats_req->b_transport(gp, delay);
+				m_ats_req->b_transport(*gp, delay);
+				qk.set(delay);
+				if (qk.need_sync()) {
+					qk.sync();
+				}
 
-				if (gp.get_response_status() == tlm::TLM_OK_RESPONSE &&
+				if (gp->get_response_status() == tlm::TLM_OK_RESPONSE &&
 					atsattr->get_result() == atsattr_extension::RESULT_OK) {
 
 					//
@@ -138,7 +148,7 @@ private:
 					//
 					// Translation succeded, add into the ATC cache
 					//
-					m_regions.push_back(MemoryRegion(virt_addr, gp.get_address(),
+					m_regions.push_back(MemoryRegion(virt_addr, gp->get_address(),
 									atsattr->get_length(),
 									atsattr->get_attributes()));
 
@@ -146,12 +156,15 @@ private:
 						//
 						// Last translations has been received
 						//
+						gp->release();
 						break;
 					}
 
 					length -= atsattr->get_length();
 					virt_addr += atsattr->get_length();
 				}
+
+				gp->release();
 			}
 		}
 
@@ -245,6 +258,34 @@ private:
 			}
 		}
 
+		//
+		// Checkpoint support. Each region is saved as four words:
+		// virtual address, physical address, length and attributes.
+		//
+		std::vector<uint64_t> get_state()
+		{
+			std::vector<uint64_t> v;
+
+			for (MemoryRegion &r : m_regions) {
+				v.push_back(r.get_virt_addr());
+				v.push_back(r.get_phys_addr());
+				v.push_back(r.get_length());
+				v.push_back(r.get_attributes());
+			}
+			return v;
+		}
+
+		void set_state(const std::vector<uint64_t> &v)
+		{
+			size_t i;
+
+			m_regions.clear();
+			for (i = 0; i + 4 <= v.size(); i += 4) {
+				m_regions.push_back(MemoryRegion(v[i], v[i + 1],
+							v[i + 2], v[i + 3]));
+			}
+		}
+
 	private:
 		bool in_range(uint64_t addr, uint64_t start, uint64_t len)
 		{
@@ -419,25 +460,32 @@ err:
 	// phys_addr: The physical address to read from
 	// data: The data buffer where the read data will be placed
 	// len: The amount of data to read
+	// qk: the calling thread's quantum keeper
 	//
-	void phys_read(uint64_t phys_addr, uint8_t *data, unsigned long len)
+	void phys_read(uint64_t phys_addr, uint8_t *data, unsigned long len,
+			tlm_utils::tlm_quantumkeeper &qk)
 	{
-		atsattr_extension *atsattr = new atsattr_extension();
-		sc_time delay(SC_ZERO_TIME);
-		tlm::tlm_generic_payload gp;
+		tlm::tlm_generic_payload *gp = tlm_payload_pool::shared().allocate();
+		atsattr_extension *atsattr;
+		sc_time delay(qk.get_local_time());
 
-		gp.set_extension(atsattr);
-		gp.set_command(tlm::TLM_READ_COMMAND);
-		gp.set_address(phys_addr);
-		gp.set_data_ptr(data);
-		gp.set_data_length(len);
-		gp.set_streaming_width(len);
+		atsattr = tlm_payload_pool::get_extension<atsattr_extension>(gp);
+		gp->set_command(tlm::TLM_READ_COMMAND);
+		gp->set_address(phys_addr);
+		gp->set_data_ptr(data);
+		gp->set_data_length(len);
+		gp->set_streaming_width(len);
 
 		atsattr->set_attributes(atsattr_extension::ATTR_PHYS_ADDR);
 
-		dma->b_transport(gp, delay);
+		dma->b_transport(*gp, delay);
+		qk.set(delay);
+		if (qk.need_sync()) {
+			qk.sync();
+		}
 
-		assert(gp.get_response_status() == tlm::TLM_OK_RESPONSE);
+		assert(gp->get_response_status() == tlm::TLM_OK_RESPONSE);
+		gp->release();
 	}
 
 
@@ -447,12 +495,12 @@ err:
 	//
 	// phys_addr: The physical address to read from
 	//
-	void phys_read32(uint64_t phys_addr)
+	void phys_read32(uint64_t phys_addr, tlm_utils::tlm_quantumkeeper &qk)
 	{
 		uint32_t data;
 
 		phys_read(phys_addr, reinterpret_cast<uint8_t*>(&data),
-				sizeof(data));
+				sizeof(data), qk);
 
 		regs.value = data;
 	}
@@ -463,30 +511,41 @@ err:
 	//
 	// phys_addr: The physical address to write to
 	//
-	void phys_write32(uint64_t phys_addr)
+	void phys_write32(uint64_t phys_addr, tlm_utils::tlm_quantumkeeper &qk)
 	{
-		atsattr_extension *atsattr = new atsattr_extension();
-		sc_time delay(SC_ZERO_TIME);
-		tlm::tlm_generic_payload gp;
+		tlm::tlm_generic_payload *gp = tlm_payload_pool::shared().allocate();
+		atsattr_extension *atsattr;
+		sc_time delay(qk.get_local_time());
 		uint32_t data = regs.value;
 		uint8_t *d = reinterpret_cast<uint8_t*>(&data);
 
-		gp.set_extension(atsattr);
-		gp.set_command(tlm::TLM_WRITE_COMMAND);
-		gp.set_address(phys_addr);
-		gp.set_data_ptr(d);
-		gp.set_data_length(4);
-		gp.set_streaming_width(4);
+		atsattr = tlm_payload_pool::get_extension<atsattr_extension>(gp);
+		gp->set_command(tlm::TLM_WRITE_COMMAND);
+		gp->set_address(phys_addr);
+		gp->set_data_ptr(d);
+		gp->set_data_length(4);
+		gp->set_streaming_width(4);
 
 		atsattr->set_attributes(atsattr_extension::ATTR_PHYS_ADDR);
 
-		dma->b_transport(gp, delay);
+		dma->b_transport(*gp, delay);
+		qk.set(delay);
+		if (qk.need_sync()) {
+			qk.sync();
+		}
 
-		assert(gp.get_response_status() == tlm::TLM_OK_RESPONSE);
+		assert(gp->get_response_status() == tlm::TLM_OK_RESPONSE);
+		gp->release();
 	}
 
 	enum { SZ_4K = 4096 };
 
+	//
+	// Each worker thread below keeps its own quantum keeper and runs
+	// ahead of the kernel by up to a quantum. It syncs before updating
+	// R_STATUS, so the driver never sees a result ahead of its time.
+	//
+
 	//
 	// This thread waits for an 'm_ats_req_event' which is notified when
 	// the R_CTRL register is written with the value R_CTRL_TRANSLATE.
@@ -500,11 +559,14 @@ err:
 	//
 	void ats_req_thread()
 	{
+		tlm_utils::tlm_quantumkeeper qk;
+
 		while (true) {
 			uint64_t addr;
 			uint64_t length;
 
 			wait(m_ats_req_event);
+			qk.reset();
 
 			addr = static_cast<uint64_t>(regs.addr_msb) << 32 |
 				regs.addr_lsb;
@@ -515,7 +577,7 @@ err:
 				uint64_t len = length;
 
 				if (!m_atc.contains(addr)) {
-					m_atc.do_ats_req(addr, SZ_4K);
+					m_atc.do_ats_req(addr, SZ_4K, qk);
 				}
 
 				if (len < SZ_4K) {
@@ -524,6 +586,7 @@ err:
 				}
 			}
 
+			qk.sync();
 			regs.status = R_STATUS_DONE;
 		}
 	}
@@ -542,16 +605,19 @@ err:
 	//
 	void read_thread()
 	{
+		tlm_utils::tlm_quantumkeeper qk;
+
 		while (true) {
 			uint64_t virt_addr;
 
 			wait(m_read_event);
+			qk.reset();
 
 			virt_addr = static_cast<uint64_t>(regs.addr_msb) << 32 |
 					regs.addr_lsb;
 
 			if (!m_atc.contains(virt_addr)) {
-				m_atc.do_ats_req(virt_addr, SZ_4K);
+				m_atc.do_ats_req(virt_addr, SZ_4K, qk);
 			}
 
 			if (m_atc.test_attr(virt_addr,
@@ -559,9 +625,10 @@ err:
 				uint64_t phys_addr =
 					m_atc.virt_to_phys(virt_addr);
 
-				phys_read32(phys_addr);
+				phys_read32(phys_addr, qk);
 			}
 
+			qk.sync();
 			regs.status = R_STATUS_DONE;
 		}
 	}
@@ -580,16 +647,19 @@ err:
 	//
 	void write_thread()
 	{
+		tlm_utils::tlm_quantumkeeper qk;
+
 		while (true) {
 			uint64_t virt_addr;
 
 			wait(m_write_event);
+			qk.reset();
 
 			virt_addr = static_cast<uint64_t>(regs.addr_msb) << 32 |
 					regs.addr_lsb;
 
 			if (!m_atc.contains(virt_addr)) {
-				m_atc.do_ats_req(virt_addr, SZ_4K);
+				m_atc.do_ats_req(virt_addr, SZ_4K, qk);
 			}
 
 			if (m_atc.test_attr(virt_addr,
@@ -597,9 +667,10 @@ err:
 				uint64_t phys_addr =
 					m_atc.virt_to_phys(virt_addr);
 
-				phys_write32(phys_addr);
+				phys_write32(phys_addr, qk);
 			}
 
+			qk.sync();
 			regs.status = R_STATUS_DONE;
 		}
 	}
@@ -618,6 +689,8 @@ err:
 	//
 	void md5_thread()
 	{
+		tlm_utils::tlm_quantumkeeper qk;
+
 		while (true) {
 			unsigned char res[MD5_DIGEST_LENGTH];
 			uint8_t data[SZ_4K];
@@ -626,12 +699,14 @@ err:
 			MD5_CTX ctx;
 
 			wait(m_md5_event);
+			qk.reset();
 
 			virt_addr = static_cast<uint64_t>(regs.addr_msb) << 32 |
 					regs.addr_lsb;
 			len = regs.length;
 
 			if (MD5_Init(&ctx) == 0) {
+				qk.sync();
 				regs.status = R_STATUS_ERR | R_STATUS_DONE;
 				continue;
 			}
@@ -642,7 +717,7 @@ err:
 				uint64_t mask = (SZ_4K - 1);
 
 				if (!m_atc.contains(virt_addr)) {
-					m_atc.do_ats_req(virt_addr, len);
+					m_atc.do_ats_req(virt_addr, len, qk);
 				}
 
 				if (!m_atc.test_attr(virt_addr,
@@ -659,7 +734,7 @@ err:
 				md5_len = (len <= SZ_4K) ? len : SZ_4K;
 				md5_len -= (phys_addr & mask);
 
-				phys_read(phys_addr, data, md5_len);
+				phys_read(phys_addr, data, md5_len, qk);
 
 				MD5_Update(&ctx, reinterpret_cast<void*>(data), md5_len);
 
@@ -668,6 +743,7 @@ err:
 			}
 
 			if (len != 0) {
+				qk.sync();
 				regs.status = R_STATUS_ERR | R_STATUS_DONE;
 				continue;
 			}
@@ -683,6 +759,7 @@ err:
 			regs.md5_result3 = (res[12] << 0) | (res[13] << 8) |
 						(res[14] << 16) | (res[15] << 24);
 
+			qk.sync();
 			regs.status = R_STATUS_DONE;
 		}
 	}
@@ -743,6 +820,22 @@ public:
 		SC_THREAD(write_thread);
 		SC_THREAD(md5_thread);
 	}
+
+	void checkpoint_save(checkpoint_writer &ck)
+	{
+		ck.add(std::string(name()) + ".regs", regs);
+		ck.add(std::string(name()) + ".atc", m_atc.get_state());
+	}
+
+	void checkpoint_restore(checkpoint_reader &ck)
+	{
+		std::vector<uint64_t> atc;
+
+		ck.get(std::string(name()) + ".regs", regs);
+		if (ck.get(std::string(name()) + ".atc", atc)) {
+			m_atc.set_state(atc);
+		}
+	}
 };
 
 #endif /* __PCI_ACC_H__ */
@@ -89,7 +89,8 @@ private:
 
 void usage(void)
 {
-	cout << "tlm socket-path sync-quantum-ns" << endl;
+	cout << "tlm socket-path sync-quantum-ns "
+		"[checkpoint=<file>] [restore=<file>]" << endl;
 }
 
 int sc_main(int argc, char* argv[])
@@ -97,6 +98,8 @@ int sc_main(int argc, char* argv[])
 	Top *top;
 	uint64_t sync_quantum;
 	sc_trace_file *trace_fp = NULL;
+	const char *checkpoint = NULL, *restore = NULL;
+	int i;
 
 #if HAVE_VERILOG_VERILATOR
 	Verilated::commandArgs(argc, argv);
@@ -108,10 +111,25 @@ int sc_main(int argc, char* argv[])
 		sync_quantum = strtoull(argv[2], NULL, 10);
 	}
 
+	for (i = 3; i < argc; i++) {
+		if (strncmp(argv[i], "checkpoint=", 11) == 0) {
+			checkpoint = argv[i] + 11;
+		} else if (strncmp(argv[i], "restore=", 8) == 0) {
+			restore = argv[i] + 8;
+		} else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	sc_set_time_resolution(1, SC_PS);
 
 	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS));
 
+	if (restore && !checkpoint_restore_all(restore)) {
+		exit(EXIT_FAILURE);
+	}
+
 	if (argc < 3) {
 		sc_start(1, SC_PS);
 		sc_stop();
@@ -125,6 +143,9 @@ int sc_main(int argc, char* argv[])
 	}
 
 	sc_start();
+	if (checkpoint && !checkpoint_save_all(checkpoint)) {
+		printf("failed to save checkpoint %s\n", checkpoint);
+	}
 	if (trace_fp) {
 		sc_close_vcd_trace_file(trace_fp);
 	}
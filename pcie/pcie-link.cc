@@ -0,0 +1,381 @@
+/*
+ * Timing model of a PCIe link.
+ *
+ * Copyright (C) 2022, Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "pcie-link.h"
+
+/* Framing, sequence number and LCRC around each TLP.  */
+#define TLP_OVERHEAD	8
+/* A DLLP with its framing.  */
+#define DLLP_SIZE	8
+
+#define TLP_TYPE_CPL	0x0a
+#define TLP_TYPE_CPLLK	0x0b
+
+static const double gen_gts[] = { 2.5, 5, 8, 16, 32 };
+
+static bool is_pow2_in(unsigned int v, unsigned int lo, unsigned int hi)
+{
+	return v >= lo && v <= hi && (v & (v - 1)) == 0;
+}
+
+pcie_link_config::pcie_link_config()
+	: gen(1),
+	  width(1),
+	  mps(128),
+	  mrrs(512),
+	  latency_ns(100),
+	  ack_factor(4),
+	  fc_factor(4)
+{
+	hdr_credits[PCIE_FC_P] = 32;
+	data_credits[PCIE_FC_P] = 512;
+	hdr_credits[PCIE_FC_NP] = 32;
+	data_credits[PCIE_FC_NP] = 32;
+	/* Root ports and endpoints advertise infinite completion credits.  */
+	hdr_credits[PCIE_FC_CPL] = 0;
+	data_credits[PCIE_FC_CPL] = 0;
+}
+
+bool pcie_link_config::parse(const char *spec)
+{
+	string s(spec);
+	size_t pos = 0;
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos);
+		string item = s.substr(pos, end == string::npos ?
+						string::npos : end - pos);
+		size_t eq = item.find('=');
+		string key;
+		unsigned int v;
+
+		pos = end == string::npos ? s.size() : end + 1;
+		if (item.empty()) {
+			continue;
+		}
+		if (eq == string::npos) {
+			printf("pcie-link: missing value for %s\n",
+				item.c_str());
+			return false;
+		}
+		key = item.substr(0, eq);
+		v = strtoul(item.c_str() + eq + 1, NULL, 0);
+
+		if (key == "gen") {
+			gen = v;
+		} else if (key == "width") {
+			width = v;
+		} else if (key == "mps") {
+			mps = v;
+		} else if (key == "mrrs") {
+			mrrs = v;
+		} else if (key == "latency") {
+			latency_ns = v;
+		} else if (key == "ph") {
+			hdr_credits[PCIE_FC_P] = v;
+		} else if (key == "pd") {
+			data_credits[PCIE_FC_P] = v;
+		} else if (key == "nph") {
+			hdr_credits[PCIE_FC_NP] = v;
+		} else if (key == "npd") {
+			data_credits[PCIE_FC_NP] = v;
+		} else if (key == "cplh") {
+			hdr_credits[PCIE_FC_CPL] = v;
+		} else if (key == "cpld") {
+			data_credits[PCIE_FC_CPL] = v;
+		} else if (key == "ack") {
+			ack_factor = v;
+		} else if (key == "fc") {
+			fc_factor = v;
+		} else {
+			printf("pcie-link: unknown key %s\n", key.c_str());
+			return false;
+		}
+	}
+
+	if (gen < 1 || gen > sizeof gen_gts / sizeof gen_gts[0] ||
+	    !is_pow2_in(width, 1, 32) ||
+	    !is_pow2_in(mps, 128, 4096) || !is_pow2_in(mrrs, 128, 4096) ||
+	    ack_factor == 0 || fc_factor == 0) {
+		printf("pcie-link: invalid configuration\n");
+		return false;
+	}
+	return true;
+}
+
+/* The link supports and trains to the configured speed and width.  */
+uint32_t pcie_link_config::lnkcap(void) const
+{
+	return gen | width << 4;
+}
+
+uint16_t pcie_link_config::lnksta(void) const
+{
+	return gen | width << 4;
+}
+
+uint32_t pcie_link_config::devcap_payload(void) const
+{
+	uint32_t code = 0;
+
+	while ((128U << code) < mps) {
+		code++;
+	}
+	return code;
+}
+
+pcie_link::pcie_link(sc_module_name name, const pcie_link_config &cfg)
+	: sc_module(name),
+	  down_tgt_socket("down-tgt-socket"),
+	  down_init_socket("down-init-socket"),
+	  up_tgt_socket("up-tgt-socket"),
+	  up_init_socket("up-init-socket"),
+	  cfg(cfg),
+	  latency(cfg.latency_ns, SC_NS)
+{
+	double enc = cfg.gen <= 2 ? 8.0 / 10 : 128.0 / 130;
+	unsigned int d, fc;
+
+	down_tgt_socket.register_b_transport(this,
+				&pcie_link::down_b_transport);
+	down_tgt_socket.register_transport_dbg(this,
+				&pcie_link::down_transport_dbg);
+	up_tgt_socket.register_b_transport(this, &pcie_link::up_b_transport);
+	up_tgt_socket.register_transport_dbg(this,
+				&pcie_link::up_transport_dbg);
+
+	bytes_per_ns = gen_gts[cfg.gen - 1] * enc * cfg.width / 8;
+
+	for (d = 0; d < 2; d++) {
+		direction &t = dir[d];
+
+		t.name = d == 0 ? "downstream" : "upstream";
+		t.busy_until = SC_ZERO_TIME;
+		t.dllp_pending = SC_ZERO_TIME;
+		t.busy = SC_ZERO_TIME;
+		t.stalled = SC_ZERO_TIME;
+		for (fc = 0; fc < PCIE_FC_NR; fc++) {
+			t.hdr_used[fc] = 0;
+			t.data_used[fc] = 0;
+			t.tlps[fc] = 0;
+		}
+		t.unacked = 0;
+		t.unreturned = 0;
+		t.payload = 0;
+		t.wire = 0;
+		t.dllp = 0;
+		t.split = 0;
+	}
+}
+
+sc_time pcie_link::wire_time(double bytes)
+{
+	return sc_time(bytes / bytes_per_ns, SC_NS);
+}
+
+/* Takes back the credits of class fc returned by at.  */
+void pcie_link::return_credits(direction &t, unsigned int fc, sc_time at)
+{
+	while (!t.returns[fc].empty() && t.returns[fc].front().at <= at) {
+		t.hdr_used[fc] -= t.returns[fc].front().hdr;
+		t.data_used[fc] -= t.returns[fc].front().data;
+		t.returns[fc].pop_front();
+	}
+}
+
+void pcie_link::transmit(unsigned int d, tlm::tlm_generic_payload& trans,
+			sc_time& delay)
+{
+	direction &t = dir[d];
+	direction &r = dir[!d];
+	const unsigned char *tlp = trans.get_data_ptr();
+	unsigned int len = trans.get_data_length();
+	unsigned int fc = PCIE_FC_P;
+	unsigned int hdr_len = len;
+	unsigned int payload = 0;
+	unsigned int nr = 1;
+	unsigned int hdr, data, dllps;
+	unsigned int hdr_max, data_max;
+	sc_time now = sc_time_stamp() + delay;
+	sc_time start, end, arrival;
+	uint64_t wire;
+
+	/* TLPs with prefixes are rare, they go by as headers.  */
+	if (len >= 4 && !(tlp[0] & 0x80)) {
+		unsigned int fmt = tlp[0] >> 5;
+		unsigned int type = tlp[0] & 0x1f;
+		unsigned int dw = (tlp[2] & 3) << 8 | tlp[3];
+
+		dw = dw ? dw : 1024;
+		hdr_len = min(len, fmt & 1 ? 16U : 12U);
+		if (fmt & 2) {
+			payload = min(len - hdr_len, dw * 4);
+		}
+
+		if (type == TLP_TYPE_CPL || type == TLP_TYPE_CPLLK) {
+			fc = PCIE_FC_CPL;
+		} else if ((type & 0x18) == 0x10 || (type == 0 && (fmt & 2))) {
+			/* Messages and memory writes.  */
+			fc = PCIE_FC_P;
+		} else {
+			fc = PCIE_FC_NP;
+		}
+
+		if (payload > cfg.mps) {
+			nr = (payload + cfg.mps - 1) / cfg.mps;
+		} else if (fc == PCIE_FC_NP && type <= 1 && !(fmt & 2)) {
+			/* Memory read requests.  */
+			nr = (dw * 4 + cfg.mrrs - 1) / cfg.mrrs;
+		}
+	}
+	if (nr > 1) {
+		t.split++;
+	}
+
+	wire = len + (uint64_t) (nr - 1) * hdr_len + nr * TLP_OVERHEAD;
+	hdr = nr;
+	data = (payload + 15) / 16;
+	hdr_max = cfg.hdr_credits[fc];
+	data_max = cfg.data_credits[fc];
+
+	/*
+	 * Wait for the wire and the DLLPs owed on it, then for the
+	 * receiver's credits.
+	 */
+	start = max(now, t.busy_until + t.dllp_pending);
+	t.dllp_pending = SC_ZERO_TIME;
+	return_credits(t, fc, start);
+	while (!t.returns[fc].empty() &&
+	       ((hdr_max && t.hdr_used[fc] + hdr > hdr_max) ||
+		(data_max && t.data_used[fc] + data > data_max))) {
+		sc_time at = t.returns[fc].front().at;
+
+		t.stalled += at - start;
+		start = at;
+		return_credits(t, fc, start);
+	}
+
+	end = start + wire_time(wire);
+	arrival = end + latency;
+	t.busy += end - start;
+	t.busy_until = end;
+
+	if (hdr_max || data_max) {
+		credit_return cr = { arrival + latency, hdr, data };
+
+		t.hdr_used[fc] += hdr;
+		t.data_used[fc] += data;
+		t.returns[fc].push_back(cr);
+	}
+
+	/* The receiver acks and returns credits on the other direction.  */
+	t.unacked += nr;
+	t.unreturned += nr;
+	dllps = t.unacked / cfg.ack_factor + t.unreturned / cfg.fc_factor;
+	t.unacked %= cfg.ack_factor;
+	t.unreturned %= cfg.fc_factor;
+	if (dllps) {
+		sc_time dllp_time = wire_time(dllps * DLLP_SIZE);
+
+		/*
+		 * Reverse TLPs may already be timed before arrival, so only
+		 * account the bandwidth here.  The next reverse TLP sends
+		 * the DLLPs first if its gap is too short for them.
+		 */
+		r.dllp_pending += dllp_time;
+		r.busy += dllp_time;
+		r.dllp += dllps * DLLP_SIZE;
+	}
+
+	t.tlps[fc]++;
+	t.payload += payload;
+	t.wire += wire;
+
+	delay = arrival - sc_time_stamp();
+}
+
+void pcie_link::down_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay)
+{
+	transmit(0, trans, delay);
+	down_init_socket->b_transport(trans, delay);
+}
+
+void pcie_link::up_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay)
+{
+	transmit(1, trans, delay);
+	up_init_socket->b_transport(trans, delay);
+}
+
+unsigned int pcie_link::down_transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return down_init_socket->transport_dbg(trans);
+}
+
+unsigned int pcie_link::up_transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return up_init_socket->transport_dbg(trans);
+}
+
+void pcie_link::end_of_simulation(void)
+{
+	double sim = sc_time_stamp().to_seconds();
+	unsigned int d;
+
+	printf("%s: gen%u x%u, %.2f Gbit/s per direction, mps %u, "
+		"mrrs %u\n", name(), cfg.gen, cfg.width, bytes_per_ns * 8,
+		cfg.mps, cfg.mrrs);
+
+	for (d = 0; d < 2; d++) {
+		const direction &t = dir[d];
+
+		printf("%s: %s %" PRIu64 " posted, %" PRIu64 " non-posted, %"
+			PRIu64 " completion TLPs, %" PRIu64 " split\n",
+			name(), t.name, t.tlps[PCIE_FC_P],
+			t.tlps[PCIE_FC_NP], t.tlps[PCIE_FC_CPL], t.split);
+		printf("%s: %s %" PRIu64 " payload bytes, %" PRIu64
+			" TLP bytes, %" PRIu64 " DLLP bytes on the wire\n",
+			name(), t.name, t.payload, t.wire, t.dllp);
+		printf("%s: %s %.1f%% utilized, %.3f Gbit/s payload, "
+			"%.3f us stalled on credits\n", name(), t.name,
+			sim > 0 ? t.busy.to_seconds() / sim * 100 : 0.0,
+			sim > 0 ? t.payload * 8 / sim / 1e9 : 0.0,
+			t.stalled.to_seconds() * 1e6);
+	}
+}
@@ -0,0 +1,139 @@
+/*
+ * Timing model of a PCIe link.
+ *
+ * Copyright (C) 2022, Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __PCIE_LINK_H__
+#define __PCIE_LINK_H__
+
+#include <deque>
+
+/* Flow control classes.  */
+enum {
+	PCIE_FC_P,
+	PCIE_FC_NP,
+	PCIE_FC_CPL,
+	PCIE_FC_NR,
+};
+
+/*
+ * Describes the link.  parse() takes a comma separated list of key=value
+ * pairs, e.g.
+ *   gen=3,width=8,mps=256,mrrs=512
+ * Keys: gen (1 to 5), width (lanes), mps and mrrs (max payload and max
+ * read request size in bytes), latency (ns from the transmitter to the
+ * receiver, PHY pipelines included), ph, pd, nph, npd, cplh and cpld
+ * (receive buffer credits for posted, non-posted and completion headers
+ * and data, data in units of 16 bytes, 0 for infinite), ack and fc
+ * (TLPs acked and credits returned per Ack and UpdateFC DLLP).
+ */
+struct pcie_link_config {
+	unsigned int gen;
+	unsigned int width;
+	unsigned int mps;
+	unsigned int mrrs;
+	unsigned int latency_ns;
+	unsigned int hdr_credits[PCIE_FC_NR];
+	unsigned int data_credits[PCIE_FC_NR];
+	unsigned int ack_factor;
+	unsigned int fc_factor;
+
+	pcie_link_config();
+	bool parse(const char *spec);
+
+	/* Link capability and status register fields for this link.  */
+	uint32_t lnkcap(void) const;
+	uint16_t lnksta(void) const;
+	/* Max payload size supported, for the device capabilities.  */
+	uint32_t devcap_payload(void) const;
+};
+
+/*
+ * Sits on the TLP sockets between a root port and a PCIe controller and
+ * delays each TLP by the time it takes on the link.  Each direction
+ * serializes the TLPs at the line rate of the generation and width,
+ * after the encoding, with the framing, sequence number and LCRC of
+ * each TLP.  The Ack and UpdateFC DLLPs take their share of the other
+ * direction: they go out right after its last TLP and only delay its
+ * next TLP as far as the gap before it is too short for them.  TLPs
+ * larger than mps, and read requests larger than mrrs, are timed as the
+ * TLPs they would be split into.  A TLP is only sent when the receiver
+ * has credits for it, they come back with an UpdateFC one latency after
+ * the TLP has been received.
+ */
+class pcie_link
+: public sc_core::sc_module
+{
+public:
+	/* Downstream, from the root port towards the endpoint.  */
+	tlm_utils::simple_target_socket<pcie_link> down_tgt_socket;
+	tlm_utils::simple_initiator_socket<pcie_link> down_init_socket;
+
+	/* Upstream, from the endpoint towards the root port.  */
+	tlm_utils::simple_target_socket<pcie_link> up_tgt_socket;
+	tlm_utils::simple_initiator_socket<pcie_link> up_init_socket;
+
+	pcie_link(sc_core::sc_module_name name, const pcie_link_config &cfg);
+
+private:
+	struct credit_return {
+		sc_time at;
+		unsigned int hdr;
+		unsigned int data;
+	};
+
+	struct direction {
+		const char *name;
+		sc_time busy_until;
+		/* Wire time of the DLLPs owed since the last TLP.  */
+		sc_time dllp_pending;
+		sc_time busy;
+		sc_time stalled;
+		unsigned int hdr_used[PCIE_FC_NR];
+		unsigned int data_used[PCIE_FC_NR];
+		std::deque<credit_return> returns[PCIE_FC_NR];
+		unsigned int unacked;
+		unsigned int unreturned;
+		uint64_t tlps[PCIE_FC_NR];
+		uint64_t payload;
+		uint64_t wire;
+		uint64_t dllp;
+		uint64_t split;
+	};
+
+	pcie_link_config cfg;
+	double bytes_per_ns;
+	sc_time latency;
+	direction dir[2];
+
+	sc_time wire_time(double bytes);
+	void return_credits(direction &t, unsigned int fc, sc_time at);
+	void transmit(unsigned int d, tlm::tlm_generic_payload& trans,
+			sc_time& delay);
+
+	void down_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay);
+	void up_b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	unsigned int down_transport_dbg(tlm::tlm_generic_payload& trans);
+	unsigned int up_transport_dbg(tlm::tlm_generic_payload& trans);
+	void end_of_simulation(void);
+};
+#endif
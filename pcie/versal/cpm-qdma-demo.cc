@@ -23,8 +23,10 @@
 
 #define SC_INCLUDE_DYNAMIC_PROCESSES
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 
@@ -45,6 +47,8 @@ using namespace std;
 #include "trace.h"
 #include "iconnect.h"
 #include "debugdev.h"
+#include "qdma-card.h"
+#include "pcie/pcie-link.h"
 
 #include "remote-port-tlm.h"
 #include "remote-port-tlm-pci-ep.h"
@@ -80,20 +84,25 @@ private:
 	// BARs towards the QDMA
 	tlm_utils::simple_initiator_socket<pcie_versal> user_bar_init_socket;
 	tlm_utils::simple_initiator_socket<pcie_versal> cfg_init_socket;
+	tlm_utils::simple_initiator_socket<pcie_versal> card_reg_init_socket;
 
 	// QDMA towards PCIe interface (host)
 	tlm_utils::simple_target_socket<pcie_versal> brdg_dma_tgt_socket;
 
 	// MSI-X propagation
 	sc_vector<sc_signal<bool> > signals_irq;
+	uint64_t irq_raised[NR_IRQ];
+	sc_time irq_first[NR_IRQ];
+	sc_time irq_last[NR_IRQ];
+	uint64_t irq_wakeups;
 
 	//
-	// Nothing to attach to the QDMA yet, just add a dummy memory.
-	// With that the testcase will be able to check what has been
-	// written in the memory..  Add an interconnect, so we can map
-	// it anywhere.
+	// The card: memory, stream sinks and sources and their counters
+	// (see qdma-card.h), plus a dummy memory for the SBI.  The
+	// interconnect maps them into the QDMA's card address space.
 	//
-	iconnect<1, 1> bus;
+	iconnect<1, 3> bus;
+	qdma_card card;
 	memory sbi_dummy;
 
 	void bar_b_transport(int bar_nr, tlm::tlm_generic_payload &trans,
@@ -101,7 +110,7 @@ private:
 	{
 		switch (bar_nr) {
 			case QDMA_USER_BAR_ID:
-				user_bar_init_socket->b_transport(trans, delay);
+				user_bar_b_transport(trans, delay);
 				break;
 			case 0:
 				cfg_init_socket->b_transport(trans, delay);
@@ -115,6 +124,25 @@ private:
 		}
 	}
 
+	//
+	// The card registers take the last 4 KiB of the 256 KiB user BAR,
+	// the QDMA gets the rest.
+	//
+	void user_bar_b_transport(tlm::tlm_generic_payload &trans,
+				sc_time &delay)
+	{
+		uint64_t addr = trans.get_address();
+
+		if (addr >= QDMA_CARD_REG_OFFSET &&
+		    addr < QDMA_CARD_REG_OFFSET + QDMA_CARD_REG_SIZE) {
+			trans.set_address(addr - QDMA_CARD_REG_OFFSET);
+			card_reg_init_socket->b_transport(trans, delay);
+			trans.set_address(addr);
+		} else {
+			user_bar_init_socket->b_transport(trans, delay);
+		}
+	}
+
 	//
 	// Forward DMA requests received from the CPM5 QDMA
 	//
@@ -125,20 +153,60 @@ private:
 	}
 
 	//
-	// MSI-X propagation
+	// MSI-X propagation.  One method covers all vectors, it runs once
+	// per delta cycle in which any of them changed and forwards those
+	// that did.  A vector that toggles more than once within a delta
+	// cycle only forwards its final value.
 	//
-	void irq_thread(unsigned int i)
+	void irq_method(void)
 	{
-		while (true) {
-			wait(signals_irq[i].value_changed_event());
-			irq[i].write(signals_irq[i].read());
+		unsigned int i;
+
+		irq_wakeups++;
+		for (i = 0; i < NR_IRQ; i++) {
+			bool v;
+
+			if (!signals_irq[i].event()) {
+				continue;
+			}
+			v = signals_irq[i].read();
+			irq[i].write(v);
+			if (v) {
+				if (irq_raised[i]++ == 0) {
+					irq_first[i] = sc_time_stamp();
+				}
+				irq_last[i] = sc_time_stamp();
+			}
 		}
 	}
 
+	void end_of_simulation(void)
+	{
+		uint64_t total = 0;
+		unsigned int i;
+
+		for (i = 0; i < NR_IRQ; i++) {
+			double span;
+
+			if (!irq_raised[i]) {
+				continue;
+			}
+			span = (irq_last[i] - irq_first[i]).to_seconds();
+			printf("%s: vector %u raised %" PRIu64 " times, "
+				"%.0f/s simulated\n", name(), i,
+				irq_raised[i],
+				span > 0 ? (irq_raised[i] - 1) / span : 0.0);
+			total += irq_raised[i];
+		}
+		printf("%s: %" PRIu64 " interrupts in %" PRIu64
+			" wakeups\n", name(), total, irq_wakeups);
+	}
+
 public:
 	SC_HAS_PROCESS(pcie_versal);
 
-	pcie_versal(sc_core::sc_module_name name) :
+	pcie_versal(sc_core::sc_module_name name,
+			const qdma_card_config &card_cfg) :
 
 		pci_device_base(name, NR_MMIO_BAR, NR_IRQ),
 
@@ -146,11 +214,14 @@ public:
 
 		user_bar_init_socket("user_bar_init_socket"),
 		cfg_init_socket("cfg_init_socket"),
+		card_reg_init_socket("card_reg_init_socket"),
 		brdg_dma_tgt_socket("brdg-dma-tgt-socket"),
 
 		signals_irq("signals_irq", NR_IRQ),
+		irq_wakeups(0),
 
 		bus("bus"),
+		card("card", card_cfg),
 		sbi_dummy("sbi_dummy", sc_time(0, SC_NS), RAM_SIZE)
 	{
 		//
@@ -158,21 +229,30 @@ public:
 		//
 		user_bar_init_socket.bind(qdma.user_bar);
 		cfg_init_socket.bind(qdma.config_bar);
+		card_reg_init_socket.bind(card.reg_socket);
 
 		// Setup DMA forwarding path (qdma.dma -> upstream to host)
 		qdma.dma.bind(brdg_dma_tgt_socket);
 		brdg_dma_tgt_socket.register_b_transport(
 			this, &pcie_versal::fwd_dma_b_transport);
 
-		// Connect the SBI dummy RAM
+		// Connect the card and the SBI dummy RAM
+		bus.memmap(QDMA_CARD_MEM_BASE, card_cfg.mem_size - 1,
+			   ADDRMODE_RELATIVE, -1, card.mem_socket);
+		bus.memmap(QDMA_CARD_STREAM_BASE,
+			   card_cfg.queues * QDMA_CARD_STREAM_SPAN - 1,
+			   ADDRMODE_RELATIVE, -1, card.stream_socket);
 		bus.memmap(0x102100000ULL, 0x1000 - 1,
 			   ADDRMODE_RELATIVE, -1, sbi_dummy.socket);
 		qdma.card_bus.bind((*bus.t_sk[0]));
 
 		// Setup MSI-X propagation
+		SC_METHOD(irq_method);
+		dont_initialize();
 		for (unsigned int i = 0; i < NR_IRQ; i++) {
 			qdma.irq[i](signals_irq[i]);
-			sc_spawn(sc_bind(&pcie_versal::irq_thread, this, i));
+			sensitive << signals_irq[i];
+			irq_raised[i] = 0;
 		}
 	}
 
@@ -182,7 +262,7 @@ public:
 	}
 };
 
-PhysFuncConfig getPhysFuncConfig()
+PhysFuncConfig getPhysFuncConfig(const pcie_link_config &link)
 {
 	PhysFuncConfig cfg;
 	PMCapability pmCap;
@@ -192,7 +272,6 @@ PhysFuncConfig getPhysFuncConfig()
 	uint32_t msixTableSz = NR_IRQ;
 	uint32_t tableOffset = 0x100 | 4; // Table offset: 0, BIR: 4
 	uint32_t pba = 0x140000 | 4; // BIR: 4
-	uint32_t maxLinkWidth;
 
 	cfg.SetPCIVendorID(PCI_VENDOR_ID_XILINX);
 	// QDMA
@@ -212,11 +291,11 @@ PhysFuncConfig getPhysFuncConfig()
 
 	cfg.AddPCICapability(pmCap);
 
-	maxLinkWidth = 1 << 4;
-	pcieCap.SetDeviceCapabilities(PCI_EXP_DEVCAP_RBER);
-	pcieCap.SetLinkCapabilities(PCI_EXP_LNKCAP_SLS_2_5GB | maxLinkWidth
-				    | PCI_EXP_LNKCAP_ASPM_L0S);
-	pcieCap.SetLinkStatus(PCI_EXP_LNKSTA_CLS_2_5GB | PCI_EXP_LNKSTA_NLW_X1);
+	// Advertise the link the timing model runs
+	pcieCap.SetDeviceCapabilities(PCI_EXP_DEVCAP_RBER |
+				      link.devcap_payload());
+	pcieCap.SetLinkCapabilities(link.lnkcap() | PCI_EXP_LNKCAP_ASPM_L0S);
+	pcieCap.SetLinkStatus(link.lnksta());
 	cfg.AddPCICapability(pcieCap);
 
 	msixCap.SetMessageControl(msixTableSz-1);
@@ -263,23 +342,37 @@ public:
 	PCIeController pcie_ctlr;
 	pcie_versal<QDMA_TYPE> qdma;
 
+	// Link timing between the root port and the controller, if asked for
+	pcie_link *link;
+
 	//
 	// Reset signal.
 	//
 	sc_signal<bool> rst;
 
-	Top(sc_module_name name, const char *sk_descr, sc_time quantum) :
+	Top(sc_module_name name, const char *sk_descr, sc_time quantum,
+		const qdma_card_config &card_cfg,
+		const pcie_link_config &link_cfg, bool link_timing) :
 		sc_module(name),
 		host("host", sk_descr),
-		pcie_ctlr("pcie-ctlr", getPhysFuncConfig()),
-		qdma("pcie-qdma"),
+		pcie_ctlr("pcie-ctlr", getPhysFuncConfig(link_cfg)),
+		qdma("pcie-qdma", card_cfg),
+		link(NULL),
 		rst("rst")
 	{
 		m_qk.set_global_quantum(quantum);
 
 		// Setup TLP sockets (host.rootport <-> pcie-ctlr)
-		host.rootport.init_socket.bind(pcie_ctlr.tgt_socket);
-		pcie_ctlr.init_socket.bind(host.rootport.tgt_socket);
+		if (link_timing) {
+			link = new pcie_link("link", link_cfg);
+			host.rootport.init_socket.bind(link->down_tgt_socket);
+			link->down_init_socket.bind(pcie_ctlr.tgt_socket);
+			pcie_ctlr.init_socket.bind(link->up_tgt_socket);
+			link->up_init_socket.bind(host.rootport.tgt_socket);
+		} else {
+			host.rootport.init_socket.bind(pcie_ctlr.tgt_socket);
+			pcie_ctlr.init_socket.bind(host.rootport.tgt_socket);
+		}
 
 		//
 		// PCIeController <-> QDMA connections
@@ -306,7 +399,14 @@ private:
 
 void usage(void)
 {
-	cout << "tlm socket-path sync-quantum-ns" << endl;
+	cout << "tlm socket-path sync-quantum-ns [card=<spec>] "
+		"[link=<spec>]" << endl;
+	cout << "  card= configures the card side, keys mem (MiB), latency, "
+		"queues, pattern, h2c-pattern, c2h-pattern, h2c-rate, "
+		"c2h-rate, n.<key> for queue n" << endl;
+	cout << "  link= times the TLPs on the PCIe link, keys gen, width, "
+		"mps, mrrs, latency, ph, pd, nph, npd, cplh, cpld, ack, fc"
+		<< endl;
 }
 
 int sc_main(int argc, char* argv[])
@@ -314,6 +414,10 @@ int sc_main(int argc, char* argv[])
 	Top *top;
 	uint64_t sync_quantum;
 	sc_trace_file *trace_fp = NULL;
+	qdma_card_config card_cfg;
+	pcie_link_config link_cfg;
+	bool link_timing = false;
+	int i;
 
 	if (argc < 3) {
 		sync_quantum = 10000;
@@ -321,9 +425,28 @@ int sc_main(int argc, char* argv[])
 		sync_quantum = strtoull(argv[2], NULL, 10);
 	}
 
+	for (i = 3; i < argc; i++) {
+		if (strncmp(argv[i], "card=", 5) == 0) {
+			if (!card_cfg.parse(argv[i] + 5)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (strncmp(argv[i], "link=", 5) == 0) {
+			if (!link_cfg.parse(argv[i] + 5)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			link_timing = true;
+		} else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	sc_set_time_resolution(1, SC_PS);
 
-	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS));
+	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS),
+			card_cfg, link_cfg, link_timing);
 
 	if (argc < 3) {
 		sc_start(1, SC_PS);
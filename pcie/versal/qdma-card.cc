@@ -0,0 +1,489 @@
+/*
+ * Card side endpoint for the CPM QDMA demos.
+ *
+ * Copyright (C) 2022, Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "qdma-card.h"
+
+static bool parse_pattern(const string &s, enum qdma_card_pattern &p)
+{
+	if (s == "none") {
+		p = QDMA_CARD_PAT_NONE;
+	} else if (s == "zero") {
+		p = QDMA_CARD_PAT_ZERO;
+	} else if (s == "incr") {
+		p = QDMA_CARD_PAT_INCR;
+	} else if (s == "word") {
+		p = QDMA_CARD_PAT_WORD;
+	} else {
+		printf("qdma-card: unknown pattern %s\n", s.c_str());
+		return false;
+	}
+	return true;
+}
+
+static const char *pattern_name(enum qdma_card_pattern p)
+{
+	static const char *names[] = { "none", "zero", "incr", "word" };
+
+	return p < sizeof names / sizeof names[0] ? names[p] : "?";
+}
+
+/* Byte off of a stream.  */
+static unsigned char pattern_byte(enum qdma_card_pattern p, uint64_t off)
+{
+	switch (p) {
+	case QDMA_CARD_PAT_INCR:
+		return off;
+	case QDMA_CARD_PAT_WORD:
+		return (off / 4) >> ((off % 4) * 8);
+	default:
+		return 0;
+	}
+}
+
+qdma_card_config::qdma_card_config()
+	: mem_size(1024 * 1024 * 1024),
+	  latency_ns(0),
+	  queues(4)
+{
+	unsigned int i;
+
+	for (i = 0; i < QDMA_CARD_MAX_QUEUES; i++) {
+		q[i].h2c_pattern = QDMA_CARD_PAT_INCR;
+		q[i].c2h_pattern = QDMA_CARD_PAT_INCR;
+		q[i].h2c_rate = 0;
+		q[i].c2h_rate = 0;
+	}
+}
+
+bool qdma_card_config::parse(const char *spec)
+{
+	string s(spec);
+	size_t pos = 0;
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos);
+		string item = s.substr(pos, end == string::npos ?
+						string::npos : end - pos);
+		size_t eq = item.find('=');
+		unsigned int first = 0, last = QDMA_CARD_MAX_QUEUES;
+		unsigned int i;
+		string key, val;
+
+		pos = end == string::npos ? s.size() : end + 1;
+		if (item.empty()) {
+			continue;
+		}
+		if (eq == string::npos) {
+			printf("qdma-card: missing value for %s\n",
+				item.c_str());
+			return false;
+		}
+		key = item.substr(0, eq);
+		val = item.substr(eq + 1);
+
+		/* n.key only applies to queue n.  */
+		if (isdigit(key[0])) {
+			char *e;
+
+			first = strtoul(key.c_str(), &e, 10);
+			if (*e != '.' || first >= QDMA_CARD_MAX_QUEUES) {
+				printf("qdma-card: bad key %s\n", key.c_str());
+				return false;
+			}
+			last = first + 1;
+			key = e + 1;
+		}
+
+		if (key == "mem" && last - first > 1) {
+			mem_size = strtoull(val.c_str(), NULL, 0) << 20;
+		} else if (key == "latency" && last - first > 1) {
+			latency_ns = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "queues" && last - first > 1) {
+			queues = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "pattern" || key == "h2c-pattern" ||
+			   key == "c2h-pattern") {
+			enum qdma_card_pattern p;
+
+			if (!parse_pattern(val, p)) {
+				return false;
+			}
+			for (i = first; i < last; i++) {
+				if (key != "c2h-pattern") {
+					q[i].h2c_pattern = p;
+				}
+				if (key != "h2c-pattern") {
+					q[i].c2h_pattern = p;
+				}
+			}
+		} else if (key == "h2c-rate" || key == "c2h-rate") {
+			double rate = strtod(val.c_str(), NULL);
+
+			for (i = first; i < last; i++) {
+				if (key == "h2c-rate") {
+					q[i].h2c_rate = rate;
+				} else {
+					q[i].c2h_rate = rate;
+				}
+			}
+		} else {
+			printf("qdma-card: unknown key %s\n", key.c_str());
+			return false;
+		}
+	}
+
+	if (mem_size == 0 || mem_size > QDMA_CARD_MEM_MAX ||
+	    queues == 0 || queues > QDMA_CARD_MAX_QUEUES) {
+		printf("qdma-card: invalid configuration\n");
+		return false;
+	}
+	return true;
+}
+
+qdma_card::qdma_card(sc_module_name name, const qdma_card_config &cfg)
+	: sc_module(name),
+	  mem("mem", sc_time(cfg.latency_ns, SC_NS), cfg.mem_size),
+	  mem_socket("mem-socket"),
+	  stream_socket("stream-socket"),
+	  reg_socket("reg-socket"),
+	  cfg(cfg),
+	  mem_init_socket("mem-init-socket"),
+	  mem_wr(0),
+	  mem_rd(0),
+	  latched_hi(0)
+{
+	unsigned int i;
+
+	mem_socket.register_b_transport(this, &qdma_card::mem_b_transport);
+	mem_socket.register_transport_dbg(this,
+				&qdma_card::mem_transport_dbg);
+	stream_socket.register_b_transport(this,
+				&qdma_card::stream_b_transport);
+	reg_socket.register_b_transport(this, &qdma_card::reg_b_transport);
+
+	mem_init_socket.bind(mem.socket);
+
+	for (i = 0; i < QDMA_CARD_MAX_QUEUES; i++) {
+		reset_engine(h2c[i], cfg.q[i].h2c_pattern, cfg.q[i].h2c_rate);
+		reset_engine(c2h[i], cfg.q[i].c2h_pattern, cfg.q[i].c2h_rate);
+	}
+}
+
+void qdma_card::reset_engine(engine &e, enum qdma_card_pattern pattern,
+				double rate)
+{
+	e.pattern = pattern;
+	e.rate = rate;
+	e.offset = 0;
+	e.bytes = 0;
+	e.errors = 0;
+	e.err_at = 0;
+	e.first = SC_ZERO_TIME;
+	e.last = SC_ZERO_TIME;
+	e.busy_until = SC_ZERO_TIME;
+}
+
+/*
+ * An engine moves len bytes at its rate, after the ones before.  The
+ * transfer completes when the last byte has gone through.
+ */
+void qdma_card::pace(engine &e, unsigned int len, sc_time &delay)
+{
+	sc_time now = sc_time_stamp() + delay;
+	sc_time start = max(now, e.busy_until);
+
+	if (e.bytes == 0) {
+		e.first = start;
+	}
+	if (e.rate > 0) {
+		e.busy_until = start + sc_time(len * 8 / e.rate, SC_NS);
+	} else {
+		e.busy_until = start;
+	}
+	e.last = e.busy_until;
+	e.bytes += len;
+	delay = e.busy_until - sc_time_stamp();
+}
+
+void qdma_card::mem_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay)
+{
+	mem_init_socket->b_transport(trans, delay);
+
+	if (trans.get_response_status() == tlm::TLM_OK_RESPONSE) {
+		if (trans.is_write()) {
+			mem_wr += trans.get_data_length();
+		} else {
+			mem_rd += trans.get_data_length();
+		}
+	}
+}
+
+unsigned int qdma_card::mem_transport_dbg(tlm::tlm_generic_payload& trans)
+{
+	return mem_init_socket->transport_dbg(trans);
+}
+
+void qdma_card::stream_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay)
+{
+	uint64_t addr = trans.get_address();
+	unsigned char *data = trans.get_data_ptr();
+	unsigned int len = trans.get_data_length();
+	unsigned int q = addr / QDMA_CARD_STREAM_SPAN;
+	unsigned int i;
+
+	if (trans.get_byte_enable_ptr()) {
+		trans.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
+		return;
+	}
+	if (q >= cfg.queues) {
+		trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		return;
+	}
+
+	if (trans.is_write()) {
+		engine &e = h2c[q];
+
+		if (e.pattern != QDMA_CARD_PAT_NONE) {
+			for (i = 0; i < len; i++) {
+				if (data[i] != pattern_byte(e.pattern,
+							e.offset + i)) {
+					break;
+				}
+			}
+			if (i < len) {
+				if (e.errors++ == 0) {
+					e.err_at = e.offset + i;
+				}
+			}
+		}
+		e.offset += len;
+		pace(e, len, delay);
+	} else if (trans.is_read()) {
+		engine &e = c2h[q];
+
+		for (i = 0; i < len; i++) {
+			data[i] = pattern_byte(e.pattern, e.offset + i);
+		}
+		e.offset += len;
+		pace(e, len, delay);
+	}
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+}
+
+/* Returns the 64 bit counter at addr, if there is one.  */
+bool qdma_card::counter(uint64_t addr, uint64_t &v)
+{
+	unsigned int q;
+
+	switch (addr) {
+	case QDMA_CARD_R_TIME:
+		v = sc_time_stamp().value() / sc_time(1, SC_NS).value();
+		return true;
+	case QDMA_CARD_R_MEM_WR:
+		v = mem_wr;
+		return true;
+	case QDMA_CARD_R_MEM_RD:
+		v = mem_rd;
+		return true;
+	}
+
+	if (addr < QDMA_CARD_R_Q(0) || addr >= QDMA_CARD_R_Q(cfg.queues)) {
+		return false;
+	}
+	q = (addr - QDMA_CARD_R_Q(0)) / 0x40;
+
+	switch (addr - QDMA_CARD_R_Q(q)) {
+	case QDMA_CARD_Q_H2C_BYTES:
+		v = h2c[q].bytes;
+		return true;
+	case QDMA_CARD_Q_H2C_NS:
+		v = (h2c[q].last - h2c[q].first).value() /
+			sc_time(1, SC_NS).value();
+		return true;
+	case QDMA_CARD_Q_C2H_BYTES:
+		v = c2h[q].bytes;
+		return true;
+	case QDMA_CARD_Q_C2H_NS:
+		v = (c2h[q].last - c2h[q].first).value() /
+			sc_time(1, SC_NS).value();
+		return true;
+	}
+	return false;
+}
+
+uint64_t qdma_card::reg_read(uint64_t addr, unsigned int len)
+{
+	uint64_t v;
+	unsigned int q;
+
+	if (counter(addr, v)) {
+		latched_hi = v >> 32;
+		return len == 8 ? v : (uint32_t) v;
+	}
+	if (counter(addr - 4, v)) {
+		return latched_hi;
+	}
+
+	switch (addr) {
+	case QDMA_CARD_R_ID:
+		return QDMA_CARD_ID;
+	case QDMA_CARD_R_QUEUES:
+		return cfg.queues;
+	}
+
+	if (addr < QDMA_CARD_R_Q(0) || addr >= QDMA_CARD_R_Q(cfg.queues)) {
+		return 0;
+	}
+	q = (addr - QDMA_CARD_R_Q(0)) / 0x40;
+
+	switch (addr - QDMA_CARD_R_Q(q)) {
+	case QDMA_CARD_Q_H2C_ERRORS:
+		return h2c[q].errors;
+	case QDMA_CARD_Q_H2C_PATTERN:
+		return h2c[q].pattern;
+	case QDMA_CARD_Q_H2C_ERR_AT:
+		return h2c[q].err_at;
+	case QDMA_CARD_Q_C2H_PATTERN:
+		return c2h[q].pattern;
+	}
+	return 0;
+}
+
+void qdma_card::reg_write(uint64_t addr, uint32_t v)
+{
+	unsigned int q;
+
+	if (addr == QDMA_CARD_R_CTRL) {
+		if (v & 1) {
+			for (q = 0; q < QDMA_CARD_MAX_QUEUES; q++) {
+				reset_engine(h2c[q], h2c[q].pattern,
+						h2c[q].rate);
+				reset_engine(c2h[q], c2h[q].pattern,
+						c2h[q].rate);
+			}
+			mem_wr = 0;
+			mem_rd = 0;
+		}
+		return;
+	}
+
+	if (addr < QDMA_CARD_R_Q(0) || addr >= QDMA_CARD_R_Q(cfg.queues)) {
+		return;
+	}
+	q = (addr - QDMA_CARD_R_Q(0)) / 0x40;
+
+	switch (addr - QDMA_CARD_R_Q(q)) {
+	case QDMA_CARD_Q_H2C_PATTERN:
+		if (v <= QDMA_CARD_PAT_WORD) {
+			h2c[q].pattern = (enum qdma_card_pattern) v;
+		}
+		break;
+	case QDMA_CARD_Q_C2H_PATTERN:
+		if (v <= QDMA_CARD_PAT_WORD) {
+			c2h[q].pattern = (enum qdma_card_pattern) v;
+		}
+		break;
+	case QDMA_CARD_Q_CTRL:
+		if (v & 1) {
+			reset_engine(h2c[q], h2c[q].pattern, h2c[q].rate);
+			reset_engine(c2h[q], c2h[q].pattern, c2h[q].rate);
+		}
+		break;
+	}
+}
+
+void qdma_card::reg_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay)
+{
+	uint64_t addr = trans.get_address();
+	unsigned char *data = trans.get_data_ptr();
+	unsigned int len = trans.get_data_length();
+	uint64_t v = 0;
+
+	if ((len != 4 && len != 8) || addr % len ||
+	    trans.get_byte_enable_ptr()) {
+		trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
+		return;
+	}
+
+	if (trans.is_read()) {
+		v = reg_read(addr, len);
+		memcpy(data, &v, len);
+	} else if (trans.is_write()) {
+		memcpy(&v, data, len);
+		reg_write(addr, v);
+		if (len == 8) {
+			reg_write(addr + 4, v >> 32);
+		}
+	}
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+}
+
+static void print_engine(const char *name, unsigned int q, const char *dir,
+			uint64_t bytes, sc_time span, const char *pattern)
+{
+	double s = span.to_seconds();
+
+	printf("%s: queue %u %s %" PRIu64 " bytes, %.3f Gbit/s simulated, "
+		"pattern %s", name, q, dir, bytes,
+		s > 0 ? bytes * 8 / s / 1e9 : 0.0, pattern);
+}
+
+void qdma_card::end_of_simulation(void)
+{
+	unsigned int q;
+
+	printf("%s: card memory %" PRIu64 " bytes written, %" PRIu64
+		" bytes read, %" PRIu64 " MiB populated\n", name(),
+		mem_wr, mem_rd, mem.populated() >> 20);
+
+	for (q = 0; q < cfg.queues; q++) {
+		if (h2c[q].bytes) {
+			print_engine(name(), q, "h2c", h2c[q].bytes,
+				h2c[q].last - h2c[q].first,
+				pattern_name(h2c[q].pattern));
+			printf(", %" PRIu64 " errors\n", h2c[q].errors);
+		}
+		if (c2h[q].bytes) {
+			print_engine(name(), q, "c2h", c2h[q].bytes,
+				c2h[q].last - c2h[q].first,
+				pattern_name(c2h[q].pattern));
+			printf("\n");
+		}
+	}
+}
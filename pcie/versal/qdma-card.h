@@ -0,0 +1,163 @@
+/*
+ * Card side endpoint for the CPM QDMA demos.
+ *
+ * Copyright (C) 2022, Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __QDMA_CARD_H__
+#define __QDMA_CARD_H__
+
+#include <string>
+#include "sparse-memory.h"
+
+#define QDMA_CARD_MAX_QUEUES	16
+
+/* Card addresses.  */
+#define QDMA_CARD_MEM_BASE	0x0ULL
+#define QDMA_CARD_MEM_MAX	0x100000000ULL
+#define QDMA_CARD_STREAM_BASE	0x800000000ULL
+#define QDMA_CARD_STREAM_SPAN	0x40000000ULL
+
+/* Where the registers show up: the last 4 KiB of the 256 KiB user BAR.  */
+#define QDMA_CARD_REG_OFFSET	0x3f000
+#define QDMA_CARD_REG_SIZE	0x1000
+
+/*
+ * Registers, all 32 bits wide.  64 bit counters are split in a low and a
+ * high word, reading the low word latches the high word.
+ */
+#define QDMA_CARD_R_ID		0x00	/* "QCRD" */
+#define QDMA_CARD_R_QUEUES	0x04
+#define QDMA_CARD_R_CTRL	0x08	/* Write 1 to clear all counters.  */
+#define QDMA_CARD_R_TIME	0x10	/* Simulated time in ns, 64 bits.  */
+#define QDMA_CARD_R_MEM_WR	0x20	/* Bytes written to card memory.  */
+#define QDMA_CARD_R_MEM_RD	0x28	/* Bytes read from card memory.  */
+
+#define QDMA_CARD_R_Q(q)	(0x100 + (q) * 0x40)
+#define QDMA_CARD_Q_H2C_BYTES	0x00	/* 64 bits */
+#define QDMA_CARD_Q_H2C_NS	0x08	/* First to last H2C byte, 64 bits.  */
+#define QDMA_CARD_Q_H2C_ERRORS	0x10	/* Transfers that failed the check.  */
+#define QDMA_CARD_Q_H2C_PATTERN	0x14
+#define QDMA_CARD_Q_H2C_ERR_AT	0x18	/* Stream offset of the first error.  */
+#define QDMA_CARD_Q_C2H_BYTES	0x20	/* 64 bits */
+#define QDMA_CARD_Q_C2H_NS	0x28	/* First to last C2H byte, 64 bits.  */
+#define QDMA_CARD_Q_C2H_PATTERN	0x34
+#define QDMA_CARD_Q_CTRL	0x38	/* Write 1 to clear this queue.  */
+
+#define QDMA_CARD_ID		0x51435244
+
+/*
+ * Data patterns of the streams.  Byte n of a stream is, for incr n mod
+ * 256, for word the 32 bit little endian word n / 4 and for zero 0.
+ * none generates zeroes and checks nothing.
+ */
+enum qdma_card_pattern {
+	QDMA_CARD_PAT_NONE,
+	QDMA_CARD_PAT_ZERO,
+	QDMA_CARD_PAT_INCR,
+	QDMA_CARD_PAT_WORD,
+};
+
+struct qdma_card_queue_config {
+	enum qdma_card_pattern h2c_pattern;
+	enum qdma_card_pattern c2h_pattern;
+	double h2c_rate;
+	double c2h_rate;
+};
+
+/*
+ * Describes the endpoint.  parse() takes a comma separated list of
+ * key=value pairs, e.g.
+ *   mem=1024,queues=4,pattern=word,c2h-rate=50,2.pattern=none
+ * Keys: mem (MiB of card memory, at most 4096), latency (ns per card
+ * memory access), queues (stream queues), pattern (zero, incr, word or
+ * none), h2c-pattern, c2h-pattern, h2c-rate and c2h-rate (Gbit/s the
+ * streams accept or produce, 0 for no limit).  Stream keys prefixed
+ * with n. only apply to queue n.
+ */
+struct qdma_card_config {
+	uint64_t mem_size;
+	unsigned int latency_ns;
+	unsigned int queues;
+	qdma_card_queue_config q[QDMA_CARD_MAX_QUEUES];
+
+	qdma_card_config();
+	bool parse(const char *spec);
+};
+
+/*
+ * What sits behind the QDMA on the card.  The QDMA reaches the card
+ * through one memory mapped master, so the streams are windows in the
+ * card address space: queue q's H2C stream sink takes the writes to
+ * QDMA_CARD_STREAM_BASE + q * QDMA_CARD_STREAM_SPAN and its C2H source
+ * serves the reads from the same window.  The address within a window
+ * does not matter, the data of successive transfers follows on.  Point
+ * a memory mapped queue at a window to move stream data.  Card memory
+ * at QDMA_CARD_MEM_BASE is sparse, so it can be large.  It is not
+ * handed out for DMI, so that every access is counted.
+ */
+class qdma_card
+: public sc_core::sc_module
+{
+public:
+	/* Card memory, stream windows and registers.  */
+	sparse_memory mem;
+	tlm_utils::simple_target_socket<qdma_card> mem_socket;
+	tlm_utils::simple_target_socket<qdma_card> stream_socket;
+	tlm_utils::simple_target_socket<qdma_card> reg_socket;
+
+	qdma_card(sc_core::sc_module_name name, const qdma_card_config &cfg);
+
+private:
+	struct engine {
+		enum qdma_card_pattern pattern;
+		double rate;
+		uint64_t offset;
+		uint64_t bytes;
+		uint64_t errors;
+		uint64_t err_at;
+		sc_time first;
+		sc_time last;
+		sc_time busy_until;
+	};
+
+	qdma_card_config cfg;
+	tlm_utils::simple_initiator_socket<qdma_card> mem_init_socket;
+	engine h2c[QDMA_CARD_MAX_QUEUES];
+	engine c2h[QDMA_CARD_MAX_QUEUES];
+	uint64_t mem_wr;
+	uint64_t mem_rd;
+	uint32_t latched_hi;
+
+	void reset_engine(engine &e, enum qdma_card_pattern pattern,
+			double rate);
+	void pace(engine &e, unsigned int len, sc_time &delay);
+	bool counter(uint64_t addr, uint64_t &v);
+	uint64_t reg_read(uint64_t addr, unsigned int len);
+	void reg_write(uint64_t addr, uint32_t v);
+
+	void mem_b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	unsigned int mem_transport_dbg(tlm::tlm_generic_payload& trans);
+	void stream_b_transport(tlm::tlm_generic_payload& trans,
+				sc_time& delay);
+	void reg_b_transport(tlm::tlm_generic_payload& trans, sc_time& delay);
+	void end_of_simulation(void);
+};
+#endif
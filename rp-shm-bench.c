@@ -0,0 +1,339 @@
+/*
+ * Benchmark and stand-in peer for the remote-port shared memory transport.
+ *
+ * Compares the shared memory rings with a Unix stream socket, the transport
+ * remote-port normally uses.  A forked echo peer plays the part of QEMU.
+ * Reports round-trip latency for one outstanding message (an MMIO access)
+ * and messages per second with a window of messages in flight (a stream
+ * of DMA or posted accesses).
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "rp-shm.h"
+
+/* The size of a remote-port bus access packet with a 4 byte payload.  */
+#define DEFAULT_MSG_SIZE	64
+#define DEFAULT_COUNT		200000
+#define DEFAULT_WINDOW		32
+#define MAX_MSG_SIZE		(64 * 1024)
+#define ATTACH_TIMEOUT_MS	10000
+
+struct transport {
+	const char *name;
+	ssize_t (*read)(struct transport *t, void *buf, size_t len);
+	ssize_t (*write)(struct transport *t, const void *buf, size_t len);
+	void (*close)(struct transport *t);
+	int fd;
+	struct rp_shm *shm;
+};
+
+static ssize_t sk_read(struct transport *t, void *buf, size_t len)
+{
+	return read(t->fd, buf, len);
+}
+
+static ssize_t sk_write(struct transport *t, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		r = write(t->fd, p + done, len - done);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return r;
+		}
+		done += r;
+	}
+	return done;
+}
+
+static void sk_close(struct transport *t)
+{
+	close(t->fd);
+}
+
+static ssize_t shm_read(struct transport *t, void *buf, size_t len)
+{
+	return rp_shm_read(t->shm, buf, len);
+}
+
+static ssize_t shm_write(struct transport *t, const void *buf, size_t len)
+{
+	return rp_shm_write(t->shm, buf, len);
+}
+
+static void shm_close(struct transport *t)
+{
+	rp_shm_close(t->shm);
+}
+
+/* Reads exactly len bytes.  Returns false on EOF or error.  */
+static bool read_full(struct transport *t, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		r = t->read(t, p + done, len - done);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		done += r;
+	}
+	return true;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Echoes msg_size messages back until the other side closes.  */
+static void echo_peer(struct transport *t, size_t msg_size)
+{
+	uint8_t buf[MAX_MSG_SIZE];
+
+	while (read_full(t, buf, msg_size)) {
+		if (t->write(t, buf, msg_size) < 0)
+			break;
+	}
+	t->close(t);
+}
+
+static void run_bench(struct transport *t, size_t msg_size,
+		      unsigned long count, unsigned long window)
+{
+	uint8_t buf[MAX_MSG_SIZE];
+	uint64_t *rtt;
+	uint64_t start, elapsed;
+	unsigned long sent, received, i;
+
+	rtt = calloc(count, sizeof *rtt);
+	if (!rtt) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	memset(buf, 0x5a, msg_size);
+
+	/* Round trip latency with a single message in flight.  */
+	for (i = 0; i < count; i++) {
+		start = now_ns();
+		if (t->write(t, buf, msg_size) < 0 ||
+		    !read_full(t, buf, msg_size)) {
+			fprintf(stderr, "%s: peer went away\n", t->name);
+			exit(EXIT_FAILURE);
+		}
+		rtt[i] = now_ns() - start;
+	}
+	qsort(rtt, count, sizeof *rtt, cmp_u64);
+
+	/* Throughput with up to window messages in flight.  */
+	sent = received = 0;
+	start = now_ns();
+	while (received < count) {
+		while (sent < count && sent - received < window) {
+			if (t->write(t, buf, msg_size) < 0) {
+				fprintf(stderr, "%s: peer went away\n", t->name);
+				exit(EXIT_FAILURE);
+			}
+			sent++;
+		}
+		if (!read_full(t, buf, msg_size)) {
+			fprintf(stderr, "%s: peer went away\n", t->name);
+			exit(EXIT_FAILURE);
+		}
+		received++;
+	}
+	elapsed = now_ns() - start;
+
+	printf("%-6s rtt p50 %8.2f us  p99 %8.2f us  p999 %8.2f us  "
+	       "%10.0f msgs/s\n",
+	       t->name,
+	       rtt[count / 2] / 1e3,
+	       rtt[(count * 99) / 100] / 1e3,
+	       rtt[(count * 999) / 1000] / 1e3,
+	       count / (elapsed / 1e9));
+
+	free(rtt);
+}
+
+static void bench_socket(size_t msg_size, unsigned long count,
+			 unsigned long window)
+{
+	struct transport t = {
+		.name = "unix", .read = sk_read, .write = sk_write,
+		.close = sk_close,
+	};
+	int sv[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		close(sv[0]);
+		t.fd = sv[1];
+		echo_peer(&t, msg_size);
+		_exit(0);
+	}
+
+	close(sv[1]);
+	t.fd = sv[0];
+	run_bench(&t, msg_size, count, window);
+	t.close(&t);
+	waitpid(pid, NULL, 0);
+}
+
+static void bench_shm(const char *descr, size_t msg_size,
+		      unsigned long count, unsigned long window)
+{
+	struct transport t = {
+		.name = "shm", .read = shm_read, .write = shm_write,
+		.close = shm_close,
+	};
+	pid_t pid;
+
+	t.shm = rp_shm_open(descr, true, 0);
+	if (!t.shm) {
+		perror(descr);
+		exit(EXIT_FAILURE);
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		/* Attach afresh, as a separate peer would.  */
+		t.shm = rp_shm_open(descr, false, ATTACH_TIMEOUT_MS);
+		if (!t.shm) {
+			perror(descr);
+			_exit(1);
+		}
+		echo_peer(&t, msg_size);
+		_exit(0);
+	}
+
+	run_bench(&t, msg_size, count, window);
+	t.close(&t);
+	waitpid(pid, NULL, 0);
+}
+
+static void usage(const char *prog)
+{
+	printf("%s [-n count] [-s msg-size] [-w window] [-d shm:/name]\n", prog);
+	printf("%s -p shm:/name [-s msg-size]\n", prog);
+	printf("  -p  run only the echo peer, attached to an existing channel\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *descr = NULL;
+	const char *peer = NULL;
+	unsigned long count = DEFAULT_COUNT;
+	unsigned long window = DEFAULT_WINDOW;
+	size_t msg_size = DEFAULT_MSG_SIZE;
+	char default_descr[64];
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:w:d:p:h")) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			msg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			descr = optarg;
+			break;
+		case 'p':
+			peer = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (count == 0 || window == 0 || msg_size == 0 ||
+	    msg_size > MAX_MSG_SIZE) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (peer) {
+		struct transport t = {
+			.name = "shm", .read = shm_read, .write = shm_write,
+			.close = shm_close,
+		};
+
+		t.shm = rp_shm_open(peer, false, ATTACH_TIMEOUT_MS);
+		if (!t.shm) {
+			perror(peer);
+			return EXIT_FAILURE;
+		}
+		echo_peer(&t, msg_size);
+		return EXIT_SUCCESS;
+	}
+
+	if (!descr) {
+		snprintf(default_descr, sizeof default_descr,
+			 "shm:/rp-shm-bench-%d", (int) getpid());
+		descr = default_descr;
+	}
+
+	printf("%lu messages of %zu bytes, window %lu\n",
+	       count, msg_size, window);
+	bench_socket(msg_size, count, window);
+	bench_shm(descr, msg_size, count, window);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,353 @@
+/*
+ * Shared memory transport for remote-port.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "rp-shm.h"
+
+#define RP_SHM_MAGIC		0x52505348	/* "RPSH" */
+#define RP_SHM_VERSION		1
+#define RP_SHM_RING_SIZE	(1u << 20)
+#define RP_SHM_SPIN		2000	/* default spins before sleeping */
+#define RP_SHM_CACHELINE	64
+
+/*
+ * One direction of the channel.  The producer owns head and the consumer
+ * owns tail, each on its own cache line.  The *_seq words are futexes the
+ * producer (data_seq) and consumer (space_seq) bump after moving their
+ * index, and the *_sleeping flags tell the other side a wake is needed.
+ */
+struct rp_shm_ring {
+	_Atomic uint64_t head __attribute__((aligned(RP_SHM_CACHELINE)));
+	_Atomic uint32_t data_seq;
+	_Atomic uint32_t writer_sleeping;
+
+	_Atomic uint64_t tail __attribute__((aligned(RP_SHM_CACHELINE)));
+	_Atomic uint32_t space_seq;
+	_Atomic uint32_t reader_sleeping;
+
+	uint8_t data[RP_SHM_RING_SIZE] __attribute__((aligned(RP_SHM_CACHELINE)));
+};
+
+struct rp_shm_region {
+	_Atomic uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	_Atomic uint32_t closed;
+	/* ring[0] carries creator to attacher, ring[1] the other way.  */
+	struct rp_shm_ring ring[2];
+};
+
+struct rp_shm {
+	struct rp_shm_region *region;
+	int spin;
+	struct rp_shm_ring *tx;
+	struct rp_shm_ring *rx;
+	char *name;
+	bool creator;
+};
+
+static const char rp_shm_prefix[] = "shm:";
+
+static void futex_wait(_Atomic uint32_t *addr, uint32_t val)
+{
+	syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr)
+{
+	syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Waits until cond() holds or the channel closes.  Spins first, then
+ * advertises itself as sleeping and waits on seq.  The cond() re-check
+ * after setting the flag closes the race with a concurrent update, and
+ * a stale seq value makes FUTEX_WAIT return immediately.
+ */
+static void rp_shm_wait(struct rp_shm *shm, struct rp_shm_ring *ring,
+			_Atomic uint32_t *seq, _Atomic uint32_t *sleeping,
+			bool (*cond)(struct rp_shm_ring *ring))
+{
+	int i;
+
+	for (i = 0; i < shm->spin; i++) {
+		if (cond(ring) || atomic_load(&shm->region->closed))
+			return;
+		cpu_relax();
+	}
+
+	while (!cond(ring) && !atomic_load(&shm->region->closed)) {
+		uint32_t val = atomic_load(seq);
+
+		atomic_store(sleeping, 1);
+		if (cond(ring) || atomic_load(&shm->region->closed)) {
+			atomic_store(sleeping, 0);
+			return;
+		}
+		futex_wait(seq, val);
+		atomic_store(sleeping, 0);
+	}
+}
+
+static void rp_shm_notify(_Atomic uint32_t *seq, _Atomic uint32_t *sleeping)
+{
+	atomic_fetch_add(seq, 1);
+	if (atomic_load(sleeping))
+		futex_wake(seq);
+}
+
+static bool ring_has_data(struct rp_shm_ring *ring)
+{
+	return atomic_load_explicit(&ring->head, memory_order_acquire) !=
+	       atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+static bool ring_has_space(struct rp_shm_ring *ring)
+{
+	return atomic_load_explicit(&ring->head, memory_order_relaxed) -
+	       atomic_load_explicit(&ring->tail, memory_order_acquire) <
+	       RP_SHM_RING_SIZE;
+}
+
+/*
+ * Spinning only pays off when the peer can run at the same time.  On a
+ * single CPU it just delays the peer, so go straight to the futex.  The
+ * RP_SHM_SPIN environment variable overrides the default.
+ */
+static int rp_shm_spin_count(void)
+{
+	const char *env = getenv("RP_SHM_SPIN");
+
+	if (env)
+		return atoi(env);
+	return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RP_SHM_SPIN : 0;
+}
+
+bool rp_shm_descr_match(const char *descr)
+{
+	return strncmp(descr, rp_shm_prefix, sizeof rp_shm_prefix - 1) == 0;
+}
+
+struct rp_shm *rp_shm_open(const char *descr, bool create, int timeout_ms)
+{
+	struct rp_shm *shm;
+	struct stat st;
+	void *p;
+	int fd = -1;
+	int waited = 0;
+
+	if (!rp_shm_descr_match(descr)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	shm = calloc(1, sizeof *shm);
+	if (!shm)
+		return NULL;
+
+	/* shm_open wants a name with a single leading slash.  */
+	descr += sizeof rp_shm_prefix - 1;
+	while (*descr == '/')
+		descr++;
+	if (asprintf(&shm->name, "/%s", descr) < 0) {
+		shm->name = NULL;
+		goto err;
+	}
+	shm->creator = create;
+	shm->spin = rp_shm_spin_count();
+
+	if (create) {
+		shm_unlink(shm->name);
+		fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0 || ftruncate(fd, sizeof *shm->region) < 0)
+			goto err;
+	} else {
+		/* Wait for the creator to size the object.  */
+		for (;;) {
+			fd = shm_open(shm->name, O_RDWR, 0);
+			if (fd >= 0 && fstat(fd, &st) == 0 &&
+			    st.st_size >= (off_t) sizeof *shm->region)
+				break;
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+			if (waited >= timeout_ms) {
+				errno = ETIMEDOUT;
+				goto err;
+			}
+			usleep(1000);
+			waited++;
+		}
+	}
+
+	p = mmap(NULL, sizeof *shm->region, PROT_READ | PROT_WRITE,
+		 MAP_SHARED, fd, 0);
+	close(fd);
+	fd = -1;
+	if (p == MAP_FAILED)
+		goto err;
+	shm->region = p;
+
+	if (create) {
+		/* ftruncate zero filled the rings.  Publish the header last.  */
+		shm->region->version = RP_SHM_VERSION;
+		shm->region->ring_size = RP_SHM_RING_SIZE;
+		atomic_store(&shm->region->magic, RP_SHM_MAGIC);
+	} else {
+		while (atomic_load(&shm->region->magic) != RP_SHM_MAGIC) {
+			if (waited >= timeout_ms) {
+				errno = ETIMEDOUT;
+				goto err;
+			}
+			usleep(1000);
+			waited++;
+		}
+		if (shm->region->version != RP_SHM_VERSION ||
+		    shm->region->ring_size != RP_SHM_RING_SIZE) {
+			errno = EPROTO;
+			goto err;
+		}
+	}
+
+	shm->tx = &shm->region->ring[create ? 0 : 1];
+	shm->rx = &shm->region->ring[create ? 1 : 0];
+	return shm;
+
+err:
+	if (fd >= 0)
+		close(fd);
+	if (shm->region)
+		munmap(shm->region, sizeof *shm->region);
+	if (create && shm->name)
+		shm_unlink(shm->name);
+	free(shm->name);
+	free(shm);
+	return NULL;
+}
+
+void rp_shm_close(struct rp_shm *shm)
+{
+	struct rp_shm_ring *r;
+	int i;
+
+	atomic_store(&shm->region->closed, 1);
+	for (i = 0; i < 2; i++) {
+		r = &shm->region->ring[i];
+		rp_shm_notify(&r->data_seq, &r->reader_sleeping);
+		rp_shm_notify(&r->space_seq, &r->writer_sleeping);
+	}
+
+	munmap(shm->region, sizeof *shm->region);
+	if (shm->creator)
+		shm_unlink(shm->name);
+	free(shm->name);
+	free(shm);
+}
+
+ssize_t rp_shm_write(struct rp_shm *shm, const void *buf, size_t len)
+{
+	struct rp_shm_ring *r = shm->tx;
+	const uint8_t *src = buf;
+	size_t done = 0;
+
+	while (done < len) {
+		uint64_t head, tail, space, off, n, first;
+
+		if (!ring_has_space(r)) {
+			rp_shm_wait(shm, r, &r->space_seq, &r->writer_sleeping,
+				    ring_has_space);
+		}
+		if (atomic_load(&shm->region->closed)) {
+			errno = EPIPE;
+			return -1;
+		}
+
+		head = atomic_load_explicit(&r->head, memory_order_relaxed);
+		tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+		space = RP_SHM_RING_SIZE - (head - tail);
+		n = len - done < space ? len - done : space;
+
+		off = head & (RP_SHM_RING_SIZE - 1);
+		first = RP_SHM_RING_SIZE - off < n ? RP_SHM_RING_SIZE - off : n;
+		memcpy(&r->data[off], src + done, first);
+		memcpy(&r->data[0], src + done + first, n - first);
+
+		atomic_store_explicit(&r->head, head + n, memory_order_release);
+		rp_shm_notify(&r->data_seq, &r->reader_sleeping);
+		done += n;
+	}
+	return done;
+}
+
+ssize_t rp_shm_read(struct rp_shm *shm, void *buf, size_t len)
+{
+	struct rp_shm_ring *r = shm->rx;
+	uint8_t *dst = buf;
+	uint64_t head, tail, avail, off, n, first;
+
+	if (len == 0)
+		return 0;
+
+	if (!ring_has_data(r)) {
+		rp_shm_wait(shm, r, &r->data_seq, &r->reader_sleeping,
+			    ring_has_data);
+		if (!ring_has_data(r))
+			return 0;	/* closed and drained */
+	}
+
+	head = atomic_load_explicit(&r->head, memory_order_acquire);
+	tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	avail = head - tail;
+	n = len < avail ? len : avail;
+
+	off = tail & (RP_SHM_RING_SIZE - 1);
+	first = RP_SHM_RING_SIZE - off < n ? RP_SHM_RING_SIZE - off : n;
+	memcpy(dst, &r->data[off], first);
+	memcpy(dst + first, &r->data[0], n - first);
+
+	atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+	rp_shm_notify(&r->space_seq, &r->writer_sleeping);
+	return n;
+}
@@ -0,0 +1,77 @@
+/*
+ * Shared memory transport for remote-port.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __RP_SHM_H__
+#define __RP_SHM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A bidirectional byte stream between two processes, built from a pair of
+ * single-producer/single-consumer rings in a POSIX shared memory object.
+ * Reads and writes have the same semantics as on a stream socket, so the
+ * remote-port protocol code can run over it unchanged.  Peers spin briefly
+ * on an empty or full ring and then sleep on a futex, so an idle link costs
+ * no CPU and a busy one makes no syscalls.
+ *
+ * Channels are named by descriptors of the form "shm:/name".  One side
+ * creates the channel and the other attaches to it.
+ */
+struct rp_shm;
+
+/* True if descr selects the shared memory transport.  */
+bool rp_shm_descr_match(const char *descr);
+
+/*
+ * Creates (create = true) or attaches to the channel named by descr.
+ * Attaching waits up to timeout_ms for the creator.  Returns NULL with
+ * errno set on failure.
+ */
+struct rp_shm *rp_shm_open(const char *descr, bool create, int timeout_ms);
+
+/*
+ * Marks the channel closed, wakes the peer and unmaps it.  The creator
+ * also unlinks the shared memory object.  The peer's reads return 0 once
+ * it has drained the data already queued.
+ */
+void rp_shm_close(struct rp_shm *shm);
+
+/* Writes all of buf, blocking while the ring is full.  */
+ssize_t rp_shm_write(struct rp_shm *shm, const void *buf, size_t len);
+
+/*
+ * Reads up to len bytes, blocking until at least one is available.
+ * Returns 0 when the peer has closed the channel.
+ */
+ssize_t rp_shm_read(struct rp_shm *shm, void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
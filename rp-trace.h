@@ -0,0 +1,450 @@
+/*
+ * Record and replay of the traffic crossing the remote-port adaptors.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __RP_TRACE_H__
+#define __RP_TRACE_H__
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "systemc.h"
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+#include "tlm-pool.h"
+
+/*
+ * Trace file layout, in host byte order:
+ *
+ *   header:  "RPTRACE1", u32 version, u32 reserved
+ *   records: struct rp_trace_record, followed for transactions by the
+ *            write data or read response data (len bytes) and then the
+ *            byte enables (be_len bytes).
+ *
+ * Transaction records carry the simulated time at which the transaction
+ * was issued (time stamp plus annotated delay).  Wire records carry the
+ * new value of the wire in cmd.
+ */
+#define RP_TRACE_MAGIC		"RPTRACE1"
+#define RP_TRACE_VERSION	1
+
+enum {
+	RP_TRACE_TLM = 1,
+	RP_TRACE_WIRE = 2,
+};
+
+struct rp_trace_record {
+	uint8_t type;
+	uint8_t channel;
+	uint8_t cmd;
+	int8_t resp;
+	uint32_t len;
+	uint64_t time_ps;
+	uint64_t addr;
+	uint32_t streaming_width;
+	uint32_t be_len;
+};
+
+static inline uint64_t rp_trace_time_ps(const sc_core::sc_time &t)
+{
+	return (uint64_t) (t.to_seconds() * 1e12 + 0.5);
+}
+
+class rp_trace_writer
+{
+public:
+	rp_trace_writer(const char *path)
+	{
+		char hdr[16] = RP_TRACE_MAGIC;
+		uint32_t version = RP_TRACE_VERSION;
+
+		fp = fopen(path, "wb");
+		if (!fp) {
+			perror(path);
+			SC_REPORT_FATAL("rp-trace", "unable to create trace file");
+		}
+		setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+		memcpy(hdr + 8, &version, sizeof version);
+		fwrite(hdr, sizeof hdr, 1, fp);
+	}
+
+	~rp_trace_writer()
+	{
+		fclose(fp);
+	}
+
+	void write_tlm(uint8_t channel, const tlm::tlm_generic_payload &gp,
+			uint64_t time_ps)
+	{
+		struct rp_trace_record r = {};
+
+		r.type = RP_TRACE_TLM;
+		r.channel = channel;
+		r.cmd = gp.get_command();
+		r.resp = gp.get_response_status();
+		r.len = gp.get_data_length();
+		r.time_ps = time_ps;
+		r.addr = gp.get_address();
+		r.streaming_width = gp.get_streaming_width();
+		r.be_len = gp.get_byte_enable_ptr() ?
+				gp.get_byte_enable_length() : 0;
+
+		fwrite(&r, sizeof r, 1, fp);
+		if (r.cmd != tlm::TLM_IGNORE_COMMAND) {
+			fwrite(gp.get_data_ptr(), r.len, 1, fp);
+		}
+		fwrite(gp.get_byte_enable_ptr(), r.be_len, 1, fp);
+	}
+
+	void flush(void)
+	{
+		fflush(fp);
+	}
+
+	void write_wire(uint8_t channel, bool value, uint64_t time_ps)
+	{
+		struct rp_trace_record r = {};
+
+		r.type = RP_TRACE_WIRE;
+		r.channel = channel;
+		r.cmd = value;
+		r.time_ps = time_ps;
+		fwrite(&r, sizeof r, 1, fp);
+	}
+
+private:
+	FILE *fp;
+};
+
+class rp_trace_reader
+{
+public:
+	rp_trace_reader(const char *path)
+	{
+		char hdr[16];
+		uint32_t version;
+
+		fp = fopen(path, "rb");
+		if (!fp) {
+			perror(path);
+			SC_REPORT_FATAL("rp-trace", "unable to open trace file");
+		}
+		setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+		if (fread(hdr, sizeof hdr, 1, fp) != 1 ||
+		    memcmp(hdr, RP_TRACE_MAGIC, 8)) {
+			SC_REPORT_FATAL("rp-trace", "not a remote-port trace");
+		}
+		memcpy(&version, hdr + 8, sizeof version);
+		if (version != RP_TRACE_VERSION) {
+			SC_REPORT_FATAL("rp-trace", "unsupported trace version");
+		}
+	}
+
+	~rp_trace_reader()
+	{
+		fclose(fp);
+	}
+
+	/* Reads the next record.  Returns false at the end of the trace.  */
+	bool next(struct rp_trace_record &r, std::vector<unsigned char> &data,
+		  std::vector<unsigned char> &be)
+	{
+		if (fread(&r, sizeof r, 1, fp) != 1) {
+			return false;
+		}
+
+		if (r.type != RP_TRACE_TLM) {
+			return true;
+		}
+
+		data.resize(r.len);
+		be.resize(r.be_len);
+		if ((r.cmd != tlm::TLM_IGNORE_COMMAND &&
+		     r.len && fread(data.data(), r.len, 1, fp) != 1) ||
+		    (r.be_len && fread(be.data(), r.be_len, 1, fp) != 1)) {
+			SC_REPORT_WARNING("rp-trace", "truncated trace record");
+			return false;
+		}
+		return true;
+	}
+
+private:
+	FILE *fp;
+};
+
+/*
+ * Pass-through placed between a remote-port master and the bus, which
+ * records every transaction with its response.  DMI is refused so that
+ * no accesses bypass the recorder.
+ */
+class tlm_trace_recorder
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<tlm_trace_recorder> tgt_socket;
+	tlm_utils::simple_initiator_socket<tlm_trace_recorder> init_socket;
+
+	tlm_trace_recorder(sc_core::sc_module_name name,
+			rp_trace_writer *writer, uint8_t channel)
+		: sc_module(name),
+		  tgt_socket("tgt-socket"),
+		  init_socket("init-socket"),
+		  writer(writer),
+		  channel(channel)
+	{
+		tgt_socket.register_b_transport(this,
+				&tlm_trace_recorder::b_transport);
+		tgt_socket.register_transport_dbg(this,
+				&tlm_trace_recorder::transport_dbg);
+	}
+
+private:
+	rp_trace_writer *writer;
+	uint8_t channel;
+
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
+	{
+		uint64_t issued = rp_trace_time_ps(sc_time_stamp() + delay);
+
+		trans.set_dmi_allowed(false);
+		init_socket->b_transport(trans, delay);
+		trans.set_dmi_allowed(false);
+
+		writer->write_tlm(channel, trans, issued);
+	}
+
+	unsigned int transport_dbg(tlm::tlm_generic_payload& trans)
+	{
+		return init_socket->transport_dbg(trans);
+	}
+};
+
+/* Records every change on a set of wires, e.g. interrupt lines.  */
+class wire_trace_recorder
+: public sc_core::sc_module
+{
+public:
+	std::vector<sc_in<bool> *> wires;
+
+	SC_HAS_PROCESS(wire_trace_recorder);
+	wire_trace_recorder(sc_core::sc_module_name name,
+			rp_trace_writer *writer, uint8_t first_channel,
+			unsigned int nr_wires)
+		: sc_module(name),
+		  writer(writer),
+		  first_channel(first_channel),
+		  last(nr_wires, false)
+	{
+		char txt[32];
+		unsigned int i;
+
+		SC_METHOD(wire_changed);
+		dont_initialize();
+
+		for (i = 0; i < nr_wires; i++) {
+			snprintf(txt, sizeof txt, "wire_%d", i);
+			wires.push_back(new sc_in<bool>(txt));
+			sensitive << *wires[i];
+		}
+	}
+
+private:
+	rp_trace_writer *writer;
+	uint8_t first_channel;
+	std::vector<bool> last;
+
+	void wire_changed(void)
+	{
+		uint64_t now = rp_trace_time_ps(sc_time_stamp());
+		unsigned int i;
+
+		for (i = 0; i < wires.size(); i++) {
+			bool v = wires[i]->read();
+
+			if (v != last[i]) {
+				last[i] = v;
+				writer->write_wire(first_channel + i, v, now);
+			}
+		}
+	}
+};
+
+/*
+ * Replays the transactions of a trace into the model in place of QEMU.
+ * Transaction channel n is issued on init_socket[n].  Wire records are
+ * outputs of the models (interrupts) and are only counted.
+ *
+ * Paced replay issues each transaction at its recorded time.  Fast
+ * replay issues them back to back, only advancing time by the delays
+ * the targets annotate.  Read data that differs from the recording is
+ * counted as a mismatch.  The simulation stops at the end of the trace.
+ */
+class rp_trace_replayer
+: public sc_core::sc_module
+{
+public:
+	std::vector<tlm_utils::simple_initiator_socket<rp_trace_replayer> *> init_socket;
+
+	SC_HAS_PROCESS(rp_trace_replayer);
+	rp_trace_replayer(sc_core::sc_module_name name, const char *path,
+			bool fast, unsigned int nr_channels)
+		: sc_module(name),
+		  reader(path),
+		  fast(fast)
+	{
+		char txt[32];
+		unsigned int i;
+
+		for (i = 0; i < nr_channels; i++) {
+			snprintf(txt, sizeof txt, "init_socket_%d", i);
+			init_socket.push_back(
+				new tlm_utils::simple_initiator_socket<rp_trace_replayer>(txt));
+		}
+
+		SC_THREAD(replay);
+	}
+
+private:
+	rp_trace_reader reader;
+	bool fast;
+
+	void replay(void)
+	{
+		std::chrono::steady_clock::time_point start;
+		std::vector<unsigned char> data, be, expected;
+		struct rp_trace_record r;
+		uint64_t nr_tlm = 0, nr_wire = 0, bytes = 0, mismatches = 0;
+		double wall;
+
+		start = std::chrono::steady_clock::now();
+
+		while (reader.next(r, data, be)) {
+			if (r.type == RP_TRACE_WIRE) {
+				nr_wire++;
+				continue;
+			}
+			if (r.type != RP_TRACE_TLM ||
+			    r.channel >= init_socket.size()) {
+				SC_REPORT_WARNING("rp-trace", "skipping record");
+				continue;
+			}
+
+			if (!fast) {
+				sc_time t(r.time_ps, SC_PS);
+
+				if (t > sc_time_stamp()) {
+					wait(t - sc_time_stamp());
+				}
+			}
+
+			if (r.cmd == tlm::TLM_READ_COMMAND) {
+				expected = data;
+			}
+
+			issue(r, data, be);
+
+			if (r.cmd == tlm::TLM_READ_COMMAND && data != expected) {
+				mismatches++;
+			}
+			nr_tlm++;
+			bytes += r.len;
+		}
+
+		wall = std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+
+		printf("%s: replayed %lu transactions (%lu bytes) and "
+			"skipped %lu wire changes\n", name(),
+			(unsigned long) nr_tlm, (unsigned long) bytes,
+			(unsigned long) nr_wire);
+		printf("%s: %.3f s wall, %s simulated, %.0f transactions/s, "
+			"%lu read mismatches\n", name(), wall,
+			sc_time_stamp().to_string().c_str(),
+			wall > 0 ? nr_tlm / wall : 0.0,
+			(unsigned long) mismatches);
+		sc_stop();
+	}
+
+	void issue(const struct rp_trace_record &r,
+		   std::vector<unsigned char> &data,
+		   std::vector<unsigned char> &be)
+	{
+		tlm::tlm_generic_payload *gp = tlm_payload_pool::shared().allocate();
+		sc_time delay(SC_ZERO_TIME);
+
+		gp->set_command((tlm::tlm_command) r.cmd);
+		gp->set_address(r.addr);
+		gp->set_data_ptr(data.data());
+		gp->set_data_length(r.len);
+		gp->set_streaming_width(r.streaming_width);
+		gp->set_byte_enable_ptr(r.be_len ? be.data() : NULL);
+		gp->set_byte_enable_length(r.be_len);
+		gp->set_dmi_allowed(false);
+		gp->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+		(*init_socket[r.channel])->b_transport(*gp, delay);
+
+		if (gp->get_response_status() != r.resp) {
+			printf("%s: response %d differs from the recording "
+				"at %lx\n", name(), gp->get_response_status(),
+				(unsigned long) r.addr);
+		}
+		gp->release();
+
+		if (fast && delay != SC_ZERO_TIME) {
+			wait(delay);
+		}
+	}
+};
+
+/*
+ * Stands in for QEMU's memory when replaying.  Reads return zeroes and
+ * writes are dropped.
+ */
+class tlm_trace_sink
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<tlm_trace_sink> socket;
+
+	tlm_trace_sink(sc_core::sc_module_name name)
+		: sc_module(name),
+		  socket("socket")
+	{
+		socket.register_b_transport(this, &tlm_trace_sink::b_transport);
+	}
+
+private:
+	void b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
+	{
+		if (trans.get_command() == tlm::TLM_READ_COMMAND) {
+			memset(trans.get_data_ptr(), 0, trans.get_data_length());
+		}
+		trans.set_response_status(tlm::TLM_OK_RESPONSE);
+	}
+};
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Cycle-based RTL models evaluated on their own host thread.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __RTL_THREAD_H__
+#define __RTL_THREAD_H__
+
+#include <assert.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A bounded single-producer single-consumer queue.  push() and pop()
+ * never lock.  pop_wait() spins for a while and then sleeps until the
+ * producer pushes, or until quit is set.
+ */
+template<class T>
+class rtl_channel
+{
+public:
+	rtl_channel(unsigned int size)
+		: ring(size + 1), head(0), tail(0), sleeping(false) {}
+
+	bool push(const T &v)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t n = (t + 1) % ring.size();
+
+		if (n == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		ring[t] = v;
+		tail.store(n, std::memory_order_release);
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_relaxed)) {
+			wake();
+		}
+		return true;
+	}
+
+	bool pop(T &v)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		v = ring[h];
+		head.store((h + 1) % ring.size(), std::memory_order_release);
+		return true;
+	}
+
+	/* Returns false if quit was set while the queue was empty.  */
+	bool pop_wait(T &v, const std::atomic<bool> &quit)
+	{
+		unsigned int i;
+
+		for (i = 0; i < SPINS; i++) {
+			if (pop(v)) {
+				return true;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!pop(v)) {
+			sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (pop(v)) {
+				break;
+			}
+			if (quit.load()) {
+				sleeping.store(false, std::memory_order_relaxed);
+				return false;
+			}
+			cond.wait(lock);
+		}
+		sleeping.store(false, std::memory_order_relaxed);
+		return true;
+	}
+
+	/* Wakes a sleeping consumer, e.g after setting its quit flag.  */
+	void wake(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cond.notify_one();
+	}
+
+private:
+	enum { SPINS = 4096 };
+
+	std::vector<T> ring;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+	std::atomic<bool> sleeping;
+	std::mutex mutex;
+	std::condition_variable cond;
+};
+
+/*
+ * Runs a cycle-based model (e.g a Verilated --cc model) on a host thread
+ * of its own, so RTL evaluation overlaps with the SystemC kernel.
+ *
+ * At each falling edge of clk, the kernel side samples the input pins
+ * into an IN and queues it for the model.  The host thread sets the
+ * inputs, evaluates a rising edge and queues the outputs in an OUT.  The
+ * kernel side then takes the outputs of lag cycles back and drives them
+ * on the output pins.  So the model has lag cycles of host time to
+ * evaluate an edge, and the kernel only waits for it when it has fallen
+ * further behind.
+ *
+ * With lag 1 the outputs of a rising edge are on the pins before the
+ * next rising edge, as with the model evaluated inline, for outputs
+ * driven by registers.  Combinational paths from inputs to outputs take
+ * a cycle longer.  A larger lag delays all outputs by lag - 1 cycles
+ * and only suits interfaces that tolerate it.
+ *
+ * Subclasses implement the pin handling:
+ *  rtl_sample() and rtl_apply() run in the kernel's thread.
+ *  rtl_settle() and rtl_cycle() run in the host thread.  rtl_settle()
+ *  is called once before the first cycle and gives the reset outputs.
+ */
+template<class IN, class OUT>
+class rtl_thread
+: public sc_core::sc_module
+{
+public:
+	sc_in<bool> clk;
+
+	SC_HAS_PROCESS(rtl_thread);
+	rtl_thread(sc_core::sc_module_name name, unsigned int lag = 1)
+		: sc_module(name),
+		  clk("clk"),
+		  lag(lag ? lag : 1),
+		  inputs(this->lag + 1),
+		  outputs(this->lag + 1),
+		  quit(false),
+		  cycles(0),
+		  stalls(0)
+	{
+		SC_METHOD(negedge);
+		dont_initialize();
+		sensitive << clk.neg();
+	}
+
+	virtual ~rtl_thread()
+	{
+		stop_rtl();
+	}
+
+protected:
+	virtual void rtl_sample(IN &in) = 0;
+	virtual void rtl_apply(const OUT &out) = 0;
+	virtual void rtl_settle(OUT &out) = 0;
+	virtual void rtl_cycle(const IN &in, OUT &out) = 0;
+
+	/*
+	 * Stops and joins the host thread.  Subclasses call it before
+	 * they destroy the model.
+	 */
+	void stop_rtl(void)
+	{
+		if (worker.joinable()) {
+			quit = true;
+			inputs.wake();
+			worker.join();
+		}
+	}
+
+private:
+	unsigned int lag;
+	rtl_channel<IN> inputs;
+	rtl_channel<OUT> outputs;
+	std::atomic<bool> quit;
+	std::thread worker;
+
+	/* Statistics for the end of simulation report.  */
+	uint64_t cycles;
+	uint64_t stalls;
+
+	void run(void)
+	{
+		unsigned int i;
+		OUT out;
+		IN in;
+
+		rtl_settle(out);
+		for (i = 0; i < lag; i++) {
+			outputs.push(out);
+		}
+
+		while (inputs.pop_wait(in, quit)) {
+			rtl_cycle(in, out);
+			outputs.push(out);
+		}
+	}
+
+	void negedge(void)
+	{
+		bool ok;
+		OUT out;
+		IN in;
+
+		rtl_sample(in);
+		ok = inputs.push(in);
+		assert(ok);
+
+		if (!outputs.pop(out)) {
+			stalls++;
+			outputs.pop_wait(out, quit);
+		}
+		rtl_apply(out);
+		cycles++;
+	}
+
+	void start_of_simulation(void)
+	{
+		worker = std::thread(&rtl_thread::run, this);
+	}
+
+	void end_of_simulation(void)
+	{
+		stop_rtl();
+		printf("%s: %" PRIu64 " cycles on the RTL thread, "
+			"kernel waited on %" PRIu64 "\n",
+			name(), cycles, stalls);
+	}
+};
+#endif
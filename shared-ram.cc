@@ -0,0 +1,235 @@
+/*
+ * Guest RAM shared with QEMU through a memory backend file.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "shared-ram.h"
+
+shared_ram::shared_ram(sc_module_name name, const char *spec)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  init_socket("init-socket"),
+	  base(0),
+	  size(0),
+	  mem(NULL)
+{
+	string s(spec);
+	string path = s.substr(0, s.find(','));
+	size_t pos = path.size();
+	struct stat st;
+	void *p;
+	int fd;
+
+	tgt_socket.register_b_transport(this, &shared_ram::b_transport);
+	tgt_socket.register_transport_dbg(this, &shared_ram::transport_dbg);
+	tgt_socket.register_get_direct_mem_ptr(this,
+				&shared_ram::get_direct_mem_ptr);
+	init_socket.register_invalidate_direct_mem_ptr(this,
+				&shared_ram::invalidate_direct_mem_ptr);
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos + 1);
+		string item = s.substr(pos + 1, end == string::npos ?
+					string::npos : end - pos - 1);
+
+		pos = end == string::npos ? s.size() : end;
+		if (item.compare(0, 5, "base=") == 0) {
+			base = strtoull(item.c_str() + 5, NULL, 0);
+		} else if (item.compare(0, 5, "size=") == 0) {
+			size = strtoull(item.c_str() + 5, NULL, 0);
+		} else if (!item.empty()) {
+			printf("%s: unknown option %s\n", this->name(),
+				item.c_str());
+		}
+	}
+
+	fd = open(path.c_str(), O_RDWR);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path.c_str());
+		SC_REPORT_FATAL("shared-ram", "cannot open guest RAM file");
+		return;
+	}
+	if (size == 0 || size > (uint64_t) st.st_size) {
+		size = st.st_size;
+	}
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		perror(path.c_str());
+		SC_REPORT_FATAL("shared-ram", "cannot map guest RAM file");
+		return;
+	}
+	mem = (unsigned char *) p;
+
+	printf("%s: guest RAM 0x%" PRIx64 " - 0x%" PRIx64 " shared from %s\n",
+		this->name(), base, base + size - 1, path.c_str());
+}
+
+shared_ram::~shared_ram()
+{
+	if (mem) {
+		munmap(mem, size);
+	}
+}
+
+bool shared_ram::in_window(uint64_t addr, unsigned int len)
+{
+	return addr >= base && addr - base < size && len <= size - (addr - base);
+}
+
+/*
+ * Plain accesses within the window are done here.  Returns false for
+ * anything init_socket should see instead.
+ */
+bool shared_ram::local(tlm::tlm_generic_payload &trans)
+{
+	uint64_t addr = trans.get_address();
+	unsigned char *data = trans.get_data_ptr();
+	unsigned int len = trans.get_data_length();
+
+	if (!in_window(addr, len) || trans.get_byte_enable_ptr() ||
+	    trans.get_streaming_width() < len) {
+		return false;
+	}
+
+	switch (trans.get_command()) {
+	case tlm::TLM_READ_COMMAND:
+		memcpy(data, mem + addr - base, len);
+		break;
+	case tlm::TLM_WRITE_COMMAND:
+		memcpy(mem + addr - base, data, len);
+		break;
+	default:
+		break;
+	}
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+	return true;
+}
+
+void shared_ram::b_transport(tlm::tlm_generic_payload &trans, sc_time &delay)
+{
+	if (local(trans)) {
+		trans.set_dmi_allowed(true);
+		return;
+	}
+	init_socket->b_transport(trans, delay);
+}
+
+unsigned int shared_ram::transport_dbg(tlm::tlm_generic_payload &trans)
+{
+	if (local(trans)) {
+		return trans.get_data_length();
+	}
+	return init_socket->transport_dbg(trans);
+}
+
+bool shared_ram::get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+				tlm::tlm_dmi &dmi_data)
+{
+	if (!in_window(trans.get_address(), 1)) {
+		return init_socket->get_direct_mem_ptr(trans, dmi_data);
+	}
+
+	dmi_data.set_dmi_ptr(mem);
+	dmi_data.set_start_address(base);
+	dmi_data.set_end_address(base + size - 1);
+	dmi_data.set_read_latency(SC_ZERO_TIME);
+	dmi_data.set_write_latency(SC_ZERO_TIME);
+	dmi_data.allow_read_write();
+	return true;
+}
+
+void shared_ram::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+					sc_dt::uint64 end)
+{
+	tgt_socket->invalidate_direct_mem_ptr(start, end);
+}
+
+tlm_write_hook::tlm_write_hook(sc_module_name name)
+	: sc_module(name),
+	  tgt_socket("tgt-socket"),
+	  init_socket("init-socket")
+{
+	tgt_socket.register_b_transport(this, &tlm_write_hook::b_transport);
+	tgt_socket.register_transport_dbg(this, &tlm_write_hook::transport_dbg);
+	tgt_socket.register_get_direct_mem_ptr(this,
+				&tlm_write_hook::get_direct_mem_ptr);
+	init_socket.register_invalidate_direct_mem_ptr(this,
+				&tlm_write_hook::invalidate_direct_mem_ptr);
+}
+
+void tlm_write_hook::b_transport(tlm::tlm_generic_payload &trans,
+				sc_time &delay)
+{
+	init_socket->b_transport(trans, delay);
+
+	if (trans.is_write() && trans.is_response_ok()) {
+		for (auto &f : hooks) {
+			f(trans.get_address(), trans.get_data_length());
+		}
+	}
+}
+
+unsigned int tlm_write_hook::transport_dbg(tlm::tlm_generic_payload &trans)
+{
+	unsigned int len = init_socket->transport_dbg(trans);
+
+	if (trans.is_write() && len) {
+		for (auto &f : hooks) {
+			f(trans.get_address(), len);
+		}
+	}
+	return len;
+}
+
+bool tlm_write_hook::get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+				tlm::tlm_dmi &dmi_data)
+{
+	if (!init_socket->get_direct_mem_ptr(trans, dmi_data) ||
+	    !dmi_data.is_read_allowed()) {
+		return false;
+	}
+	dmi_data.allow_read();
+	return true;
+}
+
+void tlm_write_hook::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+					sc_dt::uint64 end)
+{
+	tgt_socket->invalidate_direct_mem_ptr(start, end);
+}
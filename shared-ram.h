@@ -0,0 +1,98 @@
+/*
+ * Guest RAM shared with QEMU through a memory backend file.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __SHARED_RAM_H__
+#define __SHARED_RAM_H__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Sits in front of a PS slave port, e.g. zynq.s_axi_hpc_fpd[0], and
+ * serves accesses to the guest RAM window straight from the file QEMU
+ * uses as the RAM's memory backend (share=on), mapped MAP_SHARED.  DMI
+ * is granted over the whole window, so SystemC masters and QEMU both
+ * access the RAM directly and nothing in the window goes through
+ * remote-port.  Everything else, and accesses with byte enables or
+ * streaming, are passed on to init_socket.
+ *
+ * The spec is <file>[,base=<addr>][,size=<bytes>].  base defaults to 0
+ * and size to the size of the file.
+ */
+class shared_ram
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<shared_ram> tgt_socket;
+	tlm_utils::simple_initiator_socket<shared_ram> init_socket;
+
+	shared_ram(sc_core::sc_module_name name, const char *spec);
+	~shared_ram();
+
+private:
+	uint64_t base;
+	uint64_t size;
+	unsigned char *mem;
+
+	bool in_window(uint64_t addr, unsigned int len);
+	bool local(tlm::tlm_generic_payload &trans);
+
+	void b_transport(tlm::tlm_generic_payload &trans, sc_time &delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload &trans);
+	bool get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+				tlm::tlm_dmi &dmi_data);
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
+};
+
+/*
+ * Coherence hook for memory that another agent caches, e.g. QEMU's
+ * iomem-cache in front of a DDR modelled in SystemC.  Goes on the path
+ * of the SystemC masters that write the memory and calls every hook
+ * with the range of each write that passes.  Write DMI is withheld from
+ * the masters so no write slips past.
+ */
+class tlm_write_hook
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_target_socket<tlm_write_hook> tgt_socket;
+	tlm_utils::simple_initiator_socket<tlm_write_hook> init_socket;
+
+	tlm_write_hook(sc_core::sc_module_name name);
+
+	void add_hook(std::function<void(uint64_t addr, unsigned int len)> f)
+	{
+		hooks.push_back(f);
+	}
+
+private:
+	std::vector<std::function<void(uint64_t, unsigned int)> > hooks;
+
+	void b_transport(tlm::tlm_generic_payload &trans, sc_time &delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload &trans);
+	bool get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+				tlm::tlm_dmi &dmi_data);
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
+};
+#endif
@@ -0,0 +1,289 @@
+/*
+ * A sparse, lazily allocated memory.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "sparse-memory.h"
+
+const uint64_t sparse_memory::chunk_size;
+
+sparse_memory::sparse_memory(sc_module_name name, sc_time latency,
+			uint64_t size, bool huge_pages)
+	: sc_module(name),
+	  socket("socket"),
+	  latency(latency),
+	  size(size),
+	  chunk_populated((size + chunk_size - 1) / chunk_size, false),
+	  nr_populated(0)
+{
+	uintptr_t p;
+
+	socket.register_b_transport(this, &sparse_memory::b_transport);
+	socket.register_transport_dbg(this, &sparse_memory::transport_dbg);
+	socket.register_get_direct_mem_ptr(this,
+				&sparse_memory::get_direct_mem_ptr);
+
+	/*
+	 * Round up to whole chunks and map one extra so the start can be
+	 * aligned to a chunk, which lets the kernel back it with huge pages.
+	 */
+	map_size = (chunk_populated.size() + 1) * chunk_size;
+	map_base = (unsigned char *) mmap(NULL, map_size,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				-1, 0);
+	if (map_base == MAP_FAILED) {
+		perror(sc_module::name());
+		SC_REPORT_FATAL("sparse-memory", "cannot map backing store");
+		return;
+	}
+
+	p = ((uintptr_t) map_base + chunk_size - 1) & ~(chunk_size - 1);
+	mem = (unsigned char *) p;
+
+#ifdef MADV_HUGEPAGE
+	if (huge_pages && madvise(mem, chunk_populated.size() * chunk_size,
+					MADV_HUGEPAGE) < 0) {
+		perror("madvise");
+	}
+#endif
+}
+
+sparse_memory::~sparse_memory()
+{
+	if (map_base != MAP_FAILED) {
+		munmap(map_base, map_size);
+	}
+}
+
+void sparse_memory::populate(uint64_t start, uint64_t len)
+{
+	uint64_t i;
+
+	for (i = start / chunk_size; i <= (start + len - 1) / chunk_size; i++) {
+		if (!chunk_populated[i]) {
+			chunk_populated[i] = true;
+			nr_populated++;
+		}
+	}
+}
+
+/*
+ * Drops the contents of chunk i.  It reads as zeroes again and holds no
+ * memory until it is next written.
+ */
+void sparse_memory::unpopulate(uint64_t i)
+{
+	unsigned char *dst = mem + i * chunk_size;
+
+	if (mmap(dst, chunk_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+			-1, 0) == MAP_FAILED) {
+		memset(dst, 0, min(chunk_size, size - i * chunk_size));
+	}
+	chunk_populated[i] = false;
+	nr_populated--;
+}
+
+/*
+ * Returns false if the access is out of range.  Reads from chunks that
+ * were never written are zero filled from here, so the kernel doesn't
+ * have to map anything for them.
+ */
+bool sparse_memory::access(tlm::tlm_generic_payload &trans)
+{
+	tlm::tlm_command cmd = trans.get_command();
+	uint64_t addr = trans.get_address();
+	unsigned char *data = trans.get_data_ptr();
+	unsigned int len = trans.get_data_length();
+	unsigned char *be = trans.get_byte_enable_ptr();
+	unsigned int be_len = trans.get_byte_enable_length();
+	unsigned int i;
+
+	if (addr >= size || len > size - addr) {
+		trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		return false;
+	}
+	if (trans.get_streaming_width() < len) {
+		trans.set_response_status(tlm::TLM_BURST_ERROR_RESPONSE);
+		return false;
+	}
+	if (len == 0) {
+		trans.set_response_status(tlm::TLM_OK_RESPONSE);
+		return true;
+	}
+
+	if (cmd == tlm::TLM_WRITE_COMMAND) {
+		populate(addr, len);
+		if (be) {
+			for (i = 0; i < len; i++) {
+				if (be[i % be_len] == tlm::TLM_BYTE_ENABLED) {
+					mem[addr + i] = data[i];
+				}
+			}
+		} else {
+			memcpy(mem + addr, data, len);
+		}
+	} else if (cmd == tlm::TLM_READ_COMMAND) {
+		for (i = 0; i < len; ) {
+			uint64_t a = addr + i;
+			unsigned int n = min<uint64_t>(len - i,
+					chunk_size - a % chunk_size);
+			const unsigned char *src = NULL;
+			unsigned int j;
+
+			if (chunk_populated[a / chunk_size]) {
+				src = mem + a;
+			}
+			if (be) {
+				for (j = 0; j < n; j++) {
+					if (be[(i + j) % be_len] ==
+							tlm::TLM_BYTE_ENABLED) {
+						data[i + j] = src ? src[j] : 0;
+					}
+				}
+			} else if (src) {
+				memcpy(data + i, src, n);
+			} else {
+				memset(data + i, 0, n);
+			}
+			i += n;
+		}
+	}
+
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+	return true;
+}
+
+void sparse_memory::b_transport(tlm::tlm_generic_payload &trans,
+				sc_time &delay)
+{
+	if (access(trans)) {
+		trans.set_dmi_allowed(true);
+	}
+	delay += latency;
+}
+
+unsigned int sparse_memory::transport_dbg(tlm::tlm_generic_payload &trans)
+{
+	return access(trans) ? trans.get_data_length() : 0;
+}
+
+/*
+ * Grants one chunk at a time, so an initiator's DMI cache never pins
+ * more of the backing store than it has asked for.
+ */
+bool sparse_memory::get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+				tlm::tlm_dmi &dmi_data)
+{
+	uint64_t addr = trans.get_address();
+	uint64_t start, end;
+
+	if (addr >= size) {
+		return false;
+	}
+
+	start = addr & ~(chunk_size - 1);
+	end = min(start + chunk_size, size) - 1;
+
+	dmi_data.set_dmi_ptr(mem + start);
+	dmi_data.set_start_address(start);
+	dmi_data.set_end_address(end);
+	dmi_data.set_read_latency(latency);
+	dmi_data.set_write_latency(latency);
+
+	if (trans.get_command() == tlm::TLM_READ_COMMAND &&
+	    !chunk_populated[start / chunk_size]) {
+		/*
+		 * Reads through the pointer see the kernel's zero page.  The
+		 * first write goes through b_transport and the initiator asks
+		 * again for write access.
+		 */
+		dmi_data.allow_read();
+	} else {
+		populate(start, end - start + 1);
+		dmi_data.allow_read_write();
+	}
+	return true;
+}
+
+void sparse_memory::checkpoint_save(checkpoint_writer &ck)
+{
+	uint64_t i;
+
+	for (i = 0; i < chunk_populated.size(); i++) {
+		if (chunk_populated[i]) {
+			ck.add(string(name()) + ".chunk." + to_string(i),
+				mem + i * chunk_size,
+				min(chunk_size, size - i * chunk_size));
+		}
+	}
+}
+
+void sparse_memory::checkpoint_restore(checkpoint_reader &ck)
+{
+	uint64_t i;
+
+	for (i = 0; i < chunk_populated.size(); i++) {
+		unsigned char *dst = mem + i * chunk_size;
+		uint64_t clen = min(chunk_size, size - i * chunk_size);
+		uint64_t len;
+		void *p;
+
+		p = ck.map(string(name()) + ".chunk." + to_string(i), &len);
+		if (p && len != clen) {
+			printf("%s: chunk %" PRIu64 " resized in checkpoint\n",
+				name(), i);
+			p = NULL;
+		}
+		if (!p) {
+			/* Not written when the checkpoint was taken.  */
+			if (chunk_populated[i]) {
+				unpopulate(i);
+			}
+			continue;
+		}
+
+		/*
+		 * Move the checkpoint's private mapping of the chunk into
+		 * place, so pages are only read from the file when the guest
+		 * touches them.  The reader keeps no other use for it.
+		 */
+		if (mremap(p, len, len, MREMAP_MAYMOVE | MREMAP_FIXED,
+						dst) == MAP_FAILED) {
+			memcpy(dst, p, len);
+		}
+		populate(i * chunk_size, len);
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * A sparse, lazily allocated memory.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __SPARSE_MEMORY_H__
+#define __SPARSE_MEMORY_H__
+
+#include <vector>
+#include "checkpoint.h"
+
+/*
+ * A drop-in for the libsystemctlm-soc memory model, for large memories
+ * of which the guest touches a small part.
+ *
+ * The backing store is an anonymous MAP_NORESERVE mapping, so the host
+ * only allocates pages as they are written.  The memory is tracked in
+ * 2MB chunks.  Reads of chunks that were never written return zeroes
+ * without touching the mapping.  DMI is granted one chunk at a time:
+ * read-only for a read request to an unwritten chunk (the host maps its
+ * zero page), read-write otherwise.  With huge_pages the mapping is
+ * 2MB aligned and advised for transparent huge pages.
+ *
+ * Checkpoints hold only the written chunks, and a restore moves them
+ * from the checkpoint mapping into place without copying.
+ */
+class sparse_memory
+: public sc_core::sc_module, public checkpointable
+{
+public:
+	static const uint64_t chunk_size = 2 * 1024 * 1024;
+
+	tlm_utils::simple_target_socket<sparse_memory> socket;
+
+	sparse_memory(sc_core::sc_module_name name, sc_time latency,
+			uint64_t size, bool huge_pages = false);
+	~sparse_memory();
+
+	/* Bytes in chunks which have been written or handed out for writing.  */
+	uint64_t populated(void) const { return nr_populated * chunk_size; }
+
+	void checkpoint_save(checkpoint_writer &ck);
+	void checkpoint_restore(checkpoint_reader &ck);
+
+private:
+	sc_time latency;
+	uint64_t size;
+	unsigned char *map_base;
+	uint64_t map_size;
+	unsigned char *mem;
+	std::vector<bool> chunk_populated;
+	uint64_t nr_populated;
+
+	bool access(tlm::tlm_generic_payload &trans);
+	void populate(uint64_t start, uint64_t len);
+	void unpopulate(uint64_t i);
+
+	void b_transport(tlm::tlm_generic_payload &trans, sc_time &delay);
+	unsigned int transport_dbg(tlm::tlm_generic_payload &trans);
+	bool get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+				tlm::tlm_dmi &dmi_data);
+};
+#endif
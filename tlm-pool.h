@@ -0,0 +1,166 @@
+/*
+ * Pooled TLM generic payloads and extensions.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __TLM_POOL_H__
+#define __TLM_POOL_H__
+
+#include <vector>
+#include "tlm.h"
+
+/*
+ * A memory manager handing out reusable generic payloads.
+ *
+ * Payloads come back acquired (reference count 1) and return to the pool
+ * when the last reference is released.  Extensions set with set_extension()
+ * are sticky: they stay attached to the payload across reuse, so after
+ * warm-up an initiator using get_extension() below never allocates.
+ *
+ * The pool is shared by all initiators in the simulation through shared().
+ */
+class tlm_payload_pool
+: public tlm::tlm_mm_interface
+{
+public:
+	static tlm_payload_pool &shared(void)
+	{
+		static tlm_payload_pool pool;
+		return pool;
+	}
+
+	tlm::tlm_generic_payload *allocate(void)
+	{
+		tlm::tlm_generic_payload *gp;
+
+		if (free_list.empty()) {
+			gp = new tlm::tlm_generic_payload(this);
+			n_allocated++;
+		} else {
+			gp = free_list.back();
+			free_list.pop_back();
+		}
+
+		gp->acquire();
+		return gp;
+	}
+
+	/*
+	 * Called by the payload when its reference count drops to zero.
+	 * reset() only clears the extensions, so drop the pointers into
+	 * the last user's buffers as well.
+	 */
+	void free(tlm::tlm_generic_payload *gp)
+	{
+		gp->reset();
+		gp->set_data_ptr(NULL);
+		gp->set_byte_enable_ptr(NULL);
+		gp->set_byte_enable_length(0);
+		free_list.push_back(gp);
+	}
+
+	/*
+	 * Returns the payload's sticky extension of type EXT, creating it
+	 * on first use.  The extension is reset to its default state.
+	 */
+	template<class EXT>
+	static EXT *get_extension(tlm::tlm_generic_payload *gp)
+	{
+		static const EXT clean;
+		EXT *ext;
+
+		gp->get_extension(ext);
+		if (!ext) {
+			ext = new EXT();
+			gp->set_extension(ext);
+		} else {
+			ext->copy_from(clean);
+		}
+		return ext;
+	}
+
+	/* Number of payloads ever allocated.  Flat in steady state.  */
+	size_t allocated(void) const { return n_allocated; }
+
+	~tlm_payload_pool()
+	{
+		/* Outstanding payloads are owned by whoever holds them.  */
+		for (tlm::tlm_generic_payload *gp : free_list) {
+			gp->free_all_extensions();
+			delete gp;
+		}
+	}
+
+private:
+	tlm_payload_pool() : n_allocated(0) {}
+
+	std::vector<tlm::tlm_generic_payload *> free_list;
+	size_t n_allocated;
+};
+
+/*
+ * A free list of extensions, for modules which decorate payloads they
+ * don't own.  get() an extension, set it on the payload, and put() it back
+ * after clearing it from the payload once the transaction completes.
+ */
+template<class EXT>
+class tlm_extension_pool
+{
+public:
+	static tlm_extension_pool &shared(void)
+	{
+		static tlm_extension_pool pool;
+		return pool;
+	}
+
+	EXT *get(void)
+	{
+		static const EXT clean;
+		EXT *ext;
+
+		if (free_list.empty()) {
+			return new EXT();
+		}
+
+		ext = free_list.back();
+		free_list.pop_back();
+		ext->copy_from(clean);
+		return ext;
+	}
+
+	void put(EXT *ext)
+	{
+		free_list.push_back(ext);
+	}
+
+	~tlm_extension_pool()
+	{
+		for (EXT *ext : free_list) {
+			delete ext;
+		}
+	}
+
+private:
+	tlm_extension_pool() {}
+
+	std::vector<EXT *> free_list;
+};
+#endif
@@ -21,8 +21,34 @@
  * THE SOFTWARE.
  */
 
+#ifndef TLM2APB_BRIDGE_H__
+#define TLM2APB_BRIDGE_H__
+
 #define SC_INCLUDE_DYNAMIC_PROCESSES
 
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+/*
+ * Bridges TLM accesses onto an APB bus.
+ *
+ * By default every 32-bit word is clocked out on the pins, waiting for
+ * the clk edges of the setup and access phases.  With fast set, the
+ * bridge computes the APB timing instead (one setup and one access
+ * cycle per word) and annotates it as delay, without waiting:
+ *
+ *  - If fast_socket is bound, each word is forwarded on it, for APB
+ *    targets modeled at TLM level or evaluated on demand.
+ *  - Otherwise writes are dropped and reads return prdata as it is,
+ *    for buses tied off to a constant.
+ *
+ * In fast mode the pins are only driven when trace_pins is set, so
+ * waveforms still show the accesses.  A method process then drives them
+ * from the last access, so the pins keep a single writer.
+ *
+ * Accesses longer than a word are split into words.  A streaming width
+ * shorter than the access wraps the address every width bytes.
+ */
 template
 <class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
 class tlm2apb_bridge
@@ -30,8 +56,9 @@ class tlm2apb_bridge
 {
 public:
 	tlm_utils::simple_target_socket<tlm2apb_bridge> tgt_socket;
+	tlm_utils::simple_initiator_socket_optional<tlm2apb_bridge> fast_socket;
 
-	tlm2apb_bridge(sc_core::sc_module_name name);
+	tlm2apb_bridge(sc_core::sc_module_name name, bool fast = false);
 	SC_HAS_PROCESS(tlm2apb_bridge);
 
 	sc_in<BOOL_TYPE> clk;
@@ -43,15 +70,40 @@ public:
 	sc_in<DATA_TYPE<DATA_WIDTH> > prdata;
 	sc_in<BOOL_TYPE> pready;
 
+	bool trace_pins;
+
 private:
+	enum { WORD_SIZE = 4 };
+
+	bool fast;
+	sc_time period;
+
+	/* The last fast access, for drive_pins() to show on the pins.  */
+	sc_event ev_pins;
+	sc_event ev_pins_idle;
+	tlm::tlm_command pins_cmd;
+	sc_dt::uint64 pins_addr;
+	uint32_t pins_wdata;
+
+	void end_of_elaboration(void);
+	void drive_pins(void);
+
+	void setup_pins(tlm::tlm_command cmd, sc_dt::uint64 addr,
+			uint32_t tpwdata);
+	bool clocked_access(tlm::tlm_command cmd, sc_dt::uint64 addr,
+			unsigned char *data);
+	bool fast_access(tlm::tlm_command cmd, sc_dt::uint64 addr,
+			unsigned char *data, sc_time &delay);
+
 	virtual void b_transport(tlm::tlm_generic_payload& trans,
 					sc_time& delay);
 };
 
 template
 <class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
-tlm2apb_bridge<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH> ::tlm2apb_bridge(sc_module_name name)
+tlm2apb_bridge<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH> ::tlm2apb_bridge(sc_module_name name, bool fast)
 	: sc_module(name), tgt_socket("tgt-socket"),
+	fast_socket("fast-socket"),
 	clk("clk"),
 	psel("psel"),
 	penable("penable"),
@@ -59,54 +111,80 @@ tlm2apb_bridge<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH> ::tlm2ap
 	paddr("paddr"),
 	pwdata("pwdata"),
 	prdata("prdata"),
-	pready("pready")
+	pready("pready"),
+	trace_pins(false),
+	fast(fast),
+	pins_cmd(tlm::TLM_IGNORE_COMMAND),
+	pins_addr(0),
+	pins_wdata(0)
 {
 	tgt_socket.register_b_transport(this, &tlm2apb_bridge::b_transport);
+
+	SC_METHOD(drive_pins);
+	dont_initialize();
+	sensitive << ev_pins << ev_pins_idle;
 }
 
 template
 <class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
 void tlm2apb_bridge
 <BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH>
-::b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
+::end_of_elaboration(void)
 {
-	tlm::tlm_command cmd = trans.get_command();
-	sc_dt::uint64    addr = trans.get_address();
-	unsigned char*   data = trans.get_data_ptr();
-	unsigned int     len = trans.get_data_length();
-	unsigned char*   byt = trans.get_byte_enable_ptr();
-	unsigned int     wid = trans.get_streaming_width();
-	uint32_t tprdata = 0;
-	uint32_t tpwdata = 0;
+	sc_clock *c = dynamic_cast<sc_clock *>(clk.get_interface());
 
-	if (byt != 0) {
-		trans.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
-		return;
+	/* Fast mode times the accesses by the clock's period.  */
+	if (c) {
+		period = c->period();
+	} else if (fast) {
+		SC_REPORT_WARNING("tlm2apb-bridge",
+			"clk is not an sc_clock, fast accesses take no time");
 	}
+}
 
-	if (len != 4 || wid < len) {
-		trans.set_response_status(tlm::TLM_BURST_ERROR_RESPONSE);
+template
+<class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
+void tlm2apb_bridge
+<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH>
+::drive_pins(void)
+{
+	if (ev_pins_idle.triggered()) {
+		psel = BOOL_TYPE(false);
+		penable = BOOL_TYPE(false);
 		return;
 	}
+	setup_pins(pins_cmd, pins_addr, pins_wdata);
+	penable = BOOL_TYPE(true);
+}
 
-	/* FIXME: This truncation should be done somewhere else.  */
-	addr >>= 2;
-
+template
+<class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
+void tlm2apb_bridge
+<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH>
+::setup_pins(tlm::tlm_command cmd, sc_dt::uint64 addr, uint32_t tpwdata)
+{
 	/* Setup phase. Prepare all ctrl signals except enable.  */
 	psel = BOOL_TYPE(1);
-	paddr = addr;
+	/* FIXME: This truncation should be done somewhere else.  */
+	paddr = addr >> 2;
+	pwrite = BOOL_TYPE(cmd == tlm::TLM_WRITE_COMMAND);
+	pwdata = (uint64_t) tpwdata;
+}
+
+template
+<class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
+bool tlm2apb_bridge
+<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH>
+::clocked_access(tlm::tlm_command cmd, sc_dt::uint64 addr,
+		unsigned char *data)
+{
+	uint32_t tprdata = 0;
+	uint32_t tpwdata = 0;
 
-	pwrite = BOOL_TYPE(false);
 	if (cmd == tlm::TLM_WRITE_COMMAND) {
-		memcpy(&tpwdata, data, len);
-		pwrite = BOOL_TYPE(true);
+		memcpy(&tpwdata, data, WORD_SIZE);
 	}
-
-	pwdata = (uint64_t) tpwdata;
-
-	/* Because we wait for events we need to accomodate delay.  */
-	wait(delay);
-	delay = SC_ZERO_TIME;
+	setup_pins(cmd, addr, tpwdata);
 
 	wait(clk.posedge_event());
 	wait(clk.negedge_event());
@@ -118,11 +196,107 @@ void tlm2apb_bridge
 		/* Readout data.  */
 		if (cmd == tlm::TLM_READ_COMMAND) {
 			tprdata = prdata.read().to_uint64();
-			memcpy(data, &tprdata, len);
+			memcpy(data, &tprdata, WORD_SIZE);
 		}
 
 		psel = pready == BOOL_TYPE(true) ? BOOL_TYPE(false) : BOOL_TYPE(true);
 		penable = pready == BOOL_TYPE(true) ? BOOL_TYPE(false) : BOOL_TYPE(true);
 	} while (pready.read() == BOOL_TYPE(false));
+	return true;
+}
+
+template
+<class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
+bool tlm2apb_bridge
+<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH>
+::fast_access(tlm::tlm_command cmd, sc_dt::uint64 addr,
+		unsigned char *data, sc_time &delay)
+{
+	uint32_t tprdata = 0;
+	bool ok = true;
+
+	if (trace_pins) {
+		pins_cmd = cmd;
+		pins_addr = addr;
+		pins_wdata = 0;
+		if (cmd == tlm::TLM_WRITE_COMMAND) {
+			memcpy(&pins_wdata, data, WORD_SIZE);
+		}
+		ev_pins.notify(SC_ZERO_TIME);
+	}
+
+	if (fast_socket.size()) {
+		tlm::tlm_generic_payload tr;
+
+		tr.set_command(cmd);
+		tr.set_address(addr);
+		tr.set_data_ptr(data);
+		tr.set_data_length(WORD_SIZE);
+		tr.set_streaming_width(WORD_SIZE);
+		tr.set_dmi_allowed(false);
+		tr.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+		fast_socket->b_transport(tr, delay);
+		ok = tr.get_response_status() == tlm::TLM_OK_RESPONSE;
+	} else if (cmd == tlm::TLM_READ_COMMAND) {
+		tprdata = prdata.read().to_uint64();
+		memcpy(data, &tprdata, WORD_SIZE);
+	}
+
+	/* One setup and one access cycle, no wait states.  */
+	delay += 2 * period;
+
+	if (trace_pins) {
+		ev_pins_idle.cancel();
+		ev_pins_idle.notify(delay);
+	}
+	return ok;
+}
+
+template
+<class BOOL_TYPE, template <int> class ADDR_TYPE, int ADDR_WIDTH, template <int> class DATA_TYPE, int DATA_WIDTH>
+void tlm2apb_bridge
+<BOOL_TYPE, ADDR_TYPE, ADDR_WIDTH, DATA_TYPE, DATA_WIDTH>
+::b_transport(tlm::tlm_generic_payload& trans, sc_time& delay)
+{
+	tlm::tlm_command cmd = trans.get_command();
+	sc_dt::uint64    addr = trans.get_address();
+	unsigned char*   data = trans.get_data_ptr();
+	unsigned int     len = trans.get_data_length();
+	unsigned char*   byt = trans.get_byte_enable_ptr();
+	unsigned int     wid = trans.get_streaming_width();
+	unsigned int     pos;
+
+	if (byt != 0) {
+		trans.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
+		return;
+	}
+
+	if (len == 0 || len % WORD_SIZE || wid == 0 || wid % WORD_SIZE) {
+		trans.set_response_status(tlm::TLM_BURST_ERROR_RESPONSE);
+		return;
+	}
+
+	if (!fast) {
+		/* Because we wait for events we need to accomodate delay.  */
+		wait(delay);
+		delay = SC_ZERO_TIME;
+	}
+
+	for (pos = 0; pos < len; pos += WORD_SIZE) {
+		sc_dt::uint64 a = addr + pos % wid;
+		bool ok;
+
+		if (fast) {
+			ok = fast_access(cmd, a, data + pos, delay);
+		} else {
+			ok = clocked_access(cmd, a, data + pos);
+		}
+		if (!ok) {
+			trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
+			return;
+		}
+	}
 	trans.set_response_status(tlm::TLM_OK_RESPONSE);
 }
+#endif
@@ -0,0 +1,302 @@
+/*
+ * A synthetic traffic generator.
+ *
+ * Stands in for the PS master port so the interconnect and the models
+ * behind it can be stressed without QEMU.  Each of the depth worker
+ * threads keeps one blocking transaction in flight and then waits out
+ * the delay the target annotated, so depth sets the number of
+ * outstanding requests.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include <inttypes.h>
+#include <algorithm>
+
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+using namespace sc_core;
+using namespace std;
+
+#include "traffic-gen.h"
+#include "tlm-pool.h"
+
+traffic_gen_config::traffic_gen_config()
+	: base(0),
+	  size(64 * 1024),
+	  read_pct(50),
+	  burst(4),
+	  pattern(TRAFFIC_SEQUENTIAL),
+	  stride(4096),
+	  hot_size(4096),
+	  hot_pct(90),
+	  depth(1),
+	  count(100000),
+	  rate(0),
+	  seed(1),
+	  stop(true)
+{
+}
+
+bool traffic_gen_config::parse(const char *spec)
+{
+	string s(spec);
+	size_t pos = 0;
+
+	while (pos < s.size()) {
+		size_t end = s.find(',', pos);
+		string item = s.substr(pos, end == string::npos ?
+						string::npos : end - pos);
+		size_t eq = item.find('=');
+		string key, val;
+
+		pos = end == string::npos ? s.size() : end + 1;
+		if (item.empty()) {
+			continue;
+		}
+		if (eq == string::npos) {
+			printf("traffic-gen: missing value for %s\n",
+				item.c_str());
+			return false;
+		}
+		key = item.substr(0, eq);
+		val = item.substr(eq + 1);
+
+		if (key == "base") {
+			base = strtoull(val.c_str(), NULL, 0);
+		} else if (key == "size") {
+			size = strtoull(val.c_str(), NULL, 0);
+		} else if (key == "read") {
+			read_pct = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "burst") {
+			burst = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "pattern") {
+			if (val == "seq") {
+				pattern = TRAFFIC_SEQUENTIAL;
+			} else if (val == "random") {
+				pattern = TRAFFIC_RANDOM;
+			} else if (val == "stride") {
+				pattern = TRAFFIC_STRIDED;
+			} else if (val == "hotset") {
+				pattern = TRAFFIC_HOTSET;
+			} else {
+				printf("traffic-gen: unknown pattern %s\n",
+					val.c_str());
+				return false;
+			}
+		} else if (key == "stride") {
+			stride = strtoull(val.c_str(), NULL, 0);
+		} else if (key == "hot") {
+			hot_size = strtoull(val.c_str(), NULL, 0);
+		} else if (key == "hotpct") {
+			hot_pct = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "depth") {
+			depth = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "count") {
+			count = strtoull(val.c_str(), NULL, 0);
+		} else if (key == "rate") {
+			rate = strtod(val.c_str(), NULL);
+		} else if (key == "seed") {
+			seed = strtoul(val.c_str(), NULL, 0);
+		} else if (key == "stop") {
+			stop = strtoul(val.c_str(), NULL, 0);
+		} else {
+			printf("traffic-gen: unknown key %s\n", key.c_str());
+			return false;
+		}
+	}
+
+	if (burst == 0 || size < burst || depth == 0 || read_pct > 100 ||
+	    hot_pct > 100) {
+		printf("traffic-gen: invalid configuration\n");
+		return false;
+	}
+	return true;
+}
+
+traffic_gen::traffic_gen(sc_module_name name, const traffic_gen_config &cfg)
+	: sc_module(name),
+	  init_socket("init-socket"),
+	  cfg(cfg),
+	  rng(cfg.seed),
+	  issued(0),
+	  completed(0),
+	  nr_reads(0),
+	  nr_writes(0),
+	  nr_errors(0),
+	  bytes(0),
+	  running(cfg.depth),
+	  sample_rng(cfg.seed),
+	  lat_sum(0),
+	  lat_min(UINT64_MAX),
+	  lat_max(0)
+{
+	unsigned int i;
+
+	latency.reserve(min(cfg.count, (uint64_t) TRAFFIC_LATENCY_SAMPLES));
+
+	for (i = 0; i < cfg.depth; i++) {
+		char txt[32];
+
+		snprintf(txt, sizeof txt, "worker%d", i);
+		sc_spawn(sc_bind(&traffic_gen::worker, this, i), txt);
+	}
+}
+
+void traffic_gen::start_of_simulation(void)
+{
+	start_time = sc_time_stamp();
+	wall_start = chrono::steady_clock::now();
+}
+
+/* Returns the address of the n'th transaction, aligned to the burst.  */
+uint64_t traffic_gen::next_addr(uint64_t n)
+{
+	uint64_t slots = cfg.size / cfg.burst;
+	uint64_t hot_slots;
+
+	switch (cfg.pattern) {
+	case TRAFFIC_RANDOM:
+		return cfg.base + (rng() % slots) * cfg.burst;
+	case TRAFFIC_STRIDED:
+		return cfg.base + ((n * cfg.stride / cfg.burst) % slots) *
+					cfg.burst;
+	case TRAFFIC_HOTSET:
+		hot_slots = min(cfg.hot_size, cfg.size) / cfg.burst;
+		if (hot_slots && rng() % 100 < cfg.hot_pct) {
+			return cfg.base + (rng() % hot_slots) * cfg.burst;
+		}
+		return cfg.base + (rng() % slots) * cfg.burst;
+	case TRAFFIC_SEQUENTIAL:
+	default:
+		return cfg.base + (n % slots) * cfg.burst;
+	}
+}
+
+void traffic_gen::worker(unsigned int id)
+{
+	vector<unsigned char> data(cfg.burst);
+	unsigned int i;
+
+	for (i = 0; i < cfg.burst; i++) {
+		data[i] = id + i;
+	}
+
+	while (issued < cfg.count) {
+		tlm::tlm_generic_payload *gp;
+		sc_time delay = SC_ZERO_TIME;
+		sc_time issue;
+		uint64_t n = issued++;
+		uint64_t lat;
+		bool is_read;
+
+		if (cfg.rate > 0) {
+			sc_time due = start_time + sc_time(n / cfg.rate, SC_SEC);
+
+			if (due > sc_time_stamp()) {
+				wait(due - sc_time_stamp());
+			}
+		}
+
+		is_read = rng() % 100 < cfg.read_pct;
+
+		gp = tlm_payload_pool::shared().allocate();
+		gp->set_command(is_read ? tlm::TLM_READ_COMMAND :
+					tlm::TLM_WRITE_COMMAND);
+		gp->set_address(next_addr(n));
+		gp->set_data_ptr(data.data());
+		gp->set_data_length(cfg.burst);
+		gp->set_streaming_width(cfg.burst);
+		gp->set_dmi_allowed(false);
+		gp->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+		issue = sc_time_stamp();
+		init_socket->b_transport(*gp, delay);
+
+		if (gp->get_response_status() != tlm::TLM_OK_RESPONSE) {
+			nr_errors++;
+		}
+		gp->release();
+
+		lat = (sc_time_stamp() - issue + delay).to_seconds() * 1e12;
+		lat_sum += lat;
+		lat_min = min(lat_min, lat);
+		lat_max = max(lat_max, lat);
+		if (latency.size() < TRAFFIC_LATENCY_SAMPLES) {
+			latency.push_back(lat);
+		} else {
+			uint64_t j = sample_rng() % (completed + 1);
+
+			if (j < TRAFFIC_LATENCY_SAMPLES) {
+				latency[j] = lat;
+			}
+		}
+		if (is_read) {
+			nr_reads++;
+		} else {
+			nr_writes++;
+		}
+		bytes += cfg.burst;
+		completed++;
+
+		wait(delay);
+	}
+
+	if (--running == 0) {
+		end_time = sc_time_stamp();
+		wall_end = chrono::steady_clock::now();
+		report();
+		if (cfg.stop) {
+			sc_stop();
+		}
+	}
+}
+
+void traffic_gen::report(void)
+{
+	double sim = (end_time - start_time).to_seconds();
+	double wall = chrono::duration<double>(wall_end - wall_start).count();
+	vector<uint64_t> lat(latency);
+
+	printf("%s: %" PRIu64 " transactions, %" PRIu64 " reads, %" PRIu64
+		" writes, %" PRIu64 " errors, %" PRIu64 " bytes\n",
+		name(), completed, nr_reads, nr_writes, nr_errors, bytes);
+	printf("%s: %.6f s simulated, %.3f s wall, %.1f MB/s simulated, "
+		"%.0f transactions/s wall\n", name(), sim, wall,
+		sim > 0 ? bytes / sim / 1e6 : 0.0,
+		wall > 0 ? completed / wall : 0.0);
+
+	if (lat.empty()) {
+		return;
+	}
+
+	sort(lat.begin(), lat.end());
+	printf("%s: latency ns min %.3f mean %.3f p50 %.3f p99 %.3f "
+		"p999 %.3f max %.3f\n", name(),
+		lat_min / 1e3, (double) lat_sum / completed / 1e3,
+		lat[lat.size() / 2] / 1e3,
+		lat[(lat.size() * 99) / 100] / 1e3,
+		lat[(lat.size() * 999) / 1000] / 1e3,
+		lat_max / 1e3);
+}
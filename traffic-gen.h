@@ -0,0 +1,113 @@
+/*
+ * A synthetic traffic generator.
+ *
+ * Copyright (c) 2022 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __TRAFFIC_GEN_H__
+#define __TRAFFIC_GEN_H__
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+/* Latency samples kept for the percentiles.  */
+#define TRAFFIC_LATENCY_SAMPLES	(1 << 20)
+
+enum traffic_pattern {
+	TRAFFIC_SEQUENTIAL,
+	TRAFFIC_RANDOM,
+	TRAFFIC_STRIDED,
+	TRAFFIC_HOTSET,
+};
+
+/*
+ * Describes the generated traffic.  parse() takes a comma separated list
+ * of key=value pairs, e.g.
+ *   base=0xa0800000,size=0x10000,read=70,burst=64,pattern=random,depth=4
+ * Keys: base, size, read (percentage of reads), burst (bytes), pattern
+ * (seq, random, stride, hotset), stride (bytes), hot (bytes at base),
+ * hotpct (percentage of accesses to the hot set), depth (outstanding
+ * requests), count (transactions), rate (transactions per simulated
+ * second, 0 for no limit), seed and stop (end the simulation when done).
+ */
+struct traffic_gen_config {
+	uint64_t base;
+	uint64_t size;
+	unsigned int read_pct;
+	unsigned int burst;
+	enum traffic_pattern pattern;
+	uint64_t stride;
+	uint64_t hot_size;
+	unsigned int hot_pct;
+	unsigned int depth;
+	uint64_t count;
+	double rate;
+	unsigned int seed;
+	bool stop;
+
+	traffic_gen_config();
+	bool parse(const char *spec);
+};
+
+class traffic_gen
+: public sc_core::sc_module
+{
+public:
+	tlm_utils::simple_initiator_socket<traffic_gen> init_socket;
+
+	traffic_gen(sc_core::sc_module_name name,
+			const traffic_gen_config &cfg);
+	SC_HAS_PROCESS(traffic_gen);
+
+	void report(void);
+
+private:
+	traffic_gen_config cfg;
+	std::mt19937_64 rng;
+
+	uint64_t issued;
+	uint64_t completed;
+	uint64_t nr_reads;
+	uint64_t nr_writes;
+	uint64_t nr_errors;
+	uint64_t bytes;
+	unsigned int running;
+
+	sc_time start_time;
+	sc_time end_time;
+	std::chrono::steady_clock::time_point wall_start;
+	std::chrono::steady_clock::time_point wall_end;
+
+	/*
+	 * Latencies in ps.  Past TRAFFIC_LATENCY_SAMPLES transactions this
+	 * is a uniform sample of them, the sum, min and max stay exact.
+	 */
+	std::vector<uint64_t> latency;
+	std::mt19937_64 sample_rng;
+	uint64_t lat_sum;
+	uint64_t lat_min;
+	uint64_t lat_max;
+
+	void start_of_simulation(void);
+	uint64_t next_addr(uint64_t n);
+	void worker(unsigned int id);
+};
+#endif
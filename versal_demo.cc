@@ -42,6 +42,10 @@ using namespace std;
 #include "trace.h"
 #include "iconnect.h"
 #include "tests/test-modules/memory.h"
+#include "sparse-memory.h"
+#include "shared-ram.h"
+#include "checkpoint.h"
+#include "gated-clock.h"
 #include "debugdev.h"
 #include "demo-dma.h"
 #include "xilinx-axidma.h"
@@ -49,7 +53,7 @@ using namespace std;
 
 #include "tlm-bridges/tlm2axilite-bridge.h"
 #include "tlm-bridges/tlm2axi-bridge.h"
-#include "tlm-bridges/tlm2apb-bridge.h"
+#include "tlm2apb-bridge.h"
 
 #ifdef HAVE_VERILOG_VERILATOR
 #include "Vapb_timer.h"
@@ -72,8 +76,12 @@ using namespace std;
  * the SystemC side (through the device tree). Normally this will slow down
  * QEMUs execution to a high degree. For obtaining a more resonable execution
  * speed an option is to launch QEMU with an 'iomem-cache' operating in front
- * of the DDR (to note is that a mechanism making the cache coherent with other
- * potential masters on the SystemC side is yet to be implemented).
+ * of the DDR. Writes by the SystemC masters to the DDR go through a
+ * tlm_write_hook that invalidates DMI over the written range, which reaches
+ * the cache through the remote-port adaptors.
+ *
+ * Without the flag, shared-ram=<file> maps the DDR from the file QEMU uses as
+ * its memory backend and serves the SystemC masters' accesses to it directly.
  *
  * If unsure, do not enable the flag.
  *
@@ -90,11 +98,17 @@ SC_MODULE(Top)
 	iconnect<NR_MASTERS, NR_DEVICES> *bus;
 	xilinx_versal versal;
 	memory mem;
+	tlm_memory_checkpoint *mem_ck;
 #ifdef DDR_IN_SYSTEMC
-	memory *ddr;
+	sparse_memory *ddr;
+	tlm_write_hook *ddr_coherence;
+#else
+	shared_ram *ddr_shared;
 #endif
 	memory mem_lpd_rsvd;
 	memory mem_me_tile0;
+	tlm_memory_checkpoint *mem_lpd_rsvd_ck;
+	tlm_memory_checkpoint *mem_me_tile0_ck;
 	debugdev *debug;
 	demodma *dma;
 
@@ -102,7 +116,15 @@ SC_MODULE(Top)
 	sc_signal<bool> dummy_irq1;
 	sc_signal<bool> rst, rst_n;
 
+#ifdef HAVE_VERILOG
+	gated_clock *clk;
+	/* The guest can read the timer's free-running counter, never gate it.  */
+	sc_clock *tmr_clk;
+	clock_wake_probe *al_wake;
+	clock_wake_probe *af_wake;
+#else
 	sc_clock *clk;
+#endif
 #define AXIFULL_DATA_WIDTH 128
 #define AXIFULL_ID_WIDTH 8
 #ifdef HAVE_VERILOG
@@ -207,9 +229,13 @@ SC_MODULE(Top)
 		rst_n.write(!rst.read());
 	}
 
-	Top(sc_module_name name, const char *sk_descr, sc_time quantum) :
+	Top(sc_module_name name, const char *sk_descr, sc_time quantum,
+		const char *shared_ram_spec = NULL) :
 		versal("versal", sk_descr),
 		mem("mem", sc_time(1, SC_NS), 64 *1024),
+#ifndef DDR_IN_SYSTEMC
+		ddr_shared(NULL),
+#endif
 		mem_lpd_rsvd("mem_lpd_rsvd", sc_time(1, SC_NS), 1024 * 1024),
 		mem_me_tile0("mem_me_tile0", sc_time(1, SC_NS), 32 * 1024),
 		dummy_irq0("dummy_irq0"),
@@ -311,6 +337,16 @@ SC_MODULE(Top)
 
 		m_qk.set_global_quantum(quantum);
 
+		mem_ck = new tlm_memory_checkpoint(mem.name(),
+					mem.socket.get_base_interface(),
+					64 * 1024);
+		mem_lpd_rsvd_ck = new tlm_memory_checkpoint(mem_lpd_rsvd.name(),
+					mem_lpd_rsvd.socket.get_base_interface(),
+					1024 * 1024);
+		mem_me_tile0_ck = new tlm_memory_checkpoint(mem_me_tile0.name(),
+					mem_me_tile0.socket.get_base_interface(),
+					32 * 1024);
+
 		versal.rst(rst);
 
 		bus   = new iconnect<NR_MASTERS, NR_DEVICES> ("bus");
@@ -327,18 +363,37 @@ SC_MODULE(Top)
 		bus->memmap(MM_TOP_ME, 32 * 1024 - 1,
 				ADDRMODE_RELATIVE, -1, mem_me_tile0.socket);
 
+#ifdef HAVE_VERILOG
+		/*
+		 * Slow clocks to keep simulation fast.  The AXI devices' clock
+		 * is also gated, so it only runs while they have accesses to
+		 * serve.  The timer counts on a clock of its own, as its
+		 * free-running counter must keep time while the guest is idle.
+		 */
+		clk = new gated_clock("clk", sc_time(10, SC_US));
+		clk->add_busy(rst);
+		tmr_clk = new sc_clock("tmr-clk", sc_time(10, SC_US));
+
 		tlm2apb_tmr = new tlm2apb_bridge<bool, sc_bv, 16, sc_bv, 32> ("tlm2apb-tmr-bridge");
 		bus->memmap(0x80020000ULL, 0x10 - 1,
 				ADDRMODE_RELATIVE, -1, tlm2apb_tmr->tgt_socket);
 
-#ifdef HAVE_VERILOG
 		tlm2axi_al = new tlm2axilite_bridge<4, 32> ("tlm2axi-al-bridge");
 		tlm2axi_af = new tlm2axi_bridge<10, AXIFULL_DATA_WIDTH> ("tlm2axi-af-bridge");
+		al_wake = new clock_wake_probe("al-wake", clk);
+		af_wake = new clock_wake_probe("af-wake", clk);
+		al_wake->init_socket.bind(tlm2axi_al->tgt_socket);
+		af_wake->init_socket.bind(tlm2axi_af->tgt_socket);
 		bus->memmap(0xa0450000ULL, 0x10 - 1,
-				ADDRMODE_RELATIVE, -1, tlm2axi_al->tgt_socket);
+				ADDRMODE_RELATIVE, -1, al_wake->tgt_socket);
 		bus->memmap(0xa0460000ULL, 0x400 - 1,
-				ADDRMODE_RELATIVE, -1, tlm2axi_af->tgt_socket);
+				ADDRMODE_RELATIVE, -1, af_wake->tgt_socket);
 #else
+		/* Only tie-offs behind the pins, no need to clock them.  */
+		tlm2apb_tmr = new tlm2apb_bridge<bool, sc_bv, 16, sc_bv, 32> ("tlm2apb-tmr-bridge", true);
+		bus->memmap(0x80020000ULL, 0x10 - 1,
+				ADDRMODE_RELATIVE, -1, tlm2apb_tmr->tgt_socket);
+
 		bus->memmap(0xa0450000ULL, 0x10 - 1,
 				ADDRMODE_RELATIVE, -1, mem_al.socket);
 		bus->memmap(0xa0460000ULL, 0x400 - 1,
@@ -351,16 +406,32 @@ SC_MODULE(Top)
 				ADDRMODE_RELATIVE, -1, mem_lpd_rsvd.socket);
 
 #ifdef DDR_IN_SYSTEMC
-		ddr = new memory("ddr", sc_time(1, SC_NS), MM_DDR_SIZE),
+		ddr = new sparse_memory("ddr", sc_time(1, SC_NS), MM_DDR_SIZE, true),
 
 		bus->memmap(0x0ULL, MM_DDR_SIZE - 1,
 				ADDRMODE_RELATIVE, -1, ddr->socket);
 
 		bus->memmap(MM_DDR_SIZE, 0xffffffff - 1,
 				ADDRMODE_RELATIVE, -1, *(versal.s_axi_fpd));
+
+		ddr_coherence = new tlm_write_hook("ddr-coherence");
+		ddr_coherence->add_hook([this](uint64_t addr, unsigned int len) {
+			if (addr < MM_DDR_SIZE) {
+				ddr->socket->invalidate_direct_mem_ptr(addr,
+							addr + len - 1);
+			}
+		});
 #else
-		bus->memmap(0x0LL, 0xffffffff - 1,
+		if (shared_ram_spec) {
+			ddr_shared = new shared_ram("ddr-shared",
+						shared_ram_spec);
+			ddr_shared->init_socket.bind(*(versal.s_axi_fpd));
+			bus->memmap(0x0LL, 0xffffffff - 1,
+				ADDRMODE_RELATIVE, -1, ddr_shared->tgt_socket);
+		} else {
+			bus->memmap(0x0LL, 0xffffffff - 1,
 				ADDRMODE_RELATIVE, -1, *(versal.s_axi_fpd));
+		}
 #endif
 
 		versal.m_axi_fpd->bind(*(bus->t_sk[0]));
@@ -369,21 +440,23 @@ SC_MODULE(Top)
 		versal.fpd_cci_noc_0->bind(*(bus->t_sk[3]));
 		versal.noc_lpd_axi_0->bind(*(bus->t_sk[4]));
 
+#ifdef DDR_IN_SYSTEMC
+		dma->init_socket.bind(ddr_coherence->tgt_socket);
+		ddr_coherence->init_socket.bind(*(bus->t_sk[5]));
+#else
 		dma->init_socket.bind(*(bus->t_sk[5]));
+#endif
 
 		debug->irq(versal.pl2ps_irq[0]);
 		dma->irq(versal.pl2ps_irq[1]);
 
 #ifdef HAVE_VERILOG
-		/* Slow clock to keep simulation fast.  */
-		clk = new sc_clock("clk", sc_time(10, SC_US));
-
 #ifdef HAVE_VERILOG_VERILATOR
 		apb_timer = new Vapb_timer("apb_timer");
 		al = new Vaxilite_dev("axilite-dev");
 		af = new Vaxifull_dev("axifull-dev");
 #endif
-                apb_timer->clk(*clk);
+                apb_timer->clk(*tmr_clk);
                 apb_timer->rst(rst);
                 apb_timer->irq(irq_tmr);
                 apb_timer->psel(apbsig_timer_psel);
@@ -394,7 +467,7 @@ SC_MODULE(Top)
                 apb_timer->prdata(apbsig_timer_prdata);
                 apb_timer->pready(apbsig_timer_pready);
 
-                tlm2apb_tmr->clk(*clk);
+                tlm2apb_tmr->clk(*tmr_clk);
 
 
 		al->s00_axi_aclk(*clk);
@@ -580,13 +653,18 @@ private:
 
 void usage(void)
 {
-	cout << "tlm socket-path sync-quantum-ns" << endl;
+	cout << "tlm socket-path sync-quantum-ns "
+		"[checkpoint=<file>] [restore=<file>] "
+		"[shared-ram=<file>[,base=<addr>][,size=<bytes>]]" << endl;
 }
 
 int sc_main(int argc, char* argv[])
 {
 	Top *top;
 	uint64_t sync_quantum;
+	const char *checkpoint = NULL, *restore = NULL;
+	const char *shared_ram_spec = NULL;
+	int i;
 
 #if HAVE_VERILOG_VERILATOR
 	Verilated::commandArgs(argc, argv);
@@ -598,9 +676,27 @@ int sc_main(int argc, char* argv[])
 		sync_quantum = strtoull(argv[2], NULL, 10);
 	}
 
+	for (i = 3; i < argc; i++) {
+		if (strncmp(argv[i], "shared-ram=", 11) == 0) {
+			shared_ram_spec = argv[i] + 11;
+		} else if (strncmp(argv[i], "checkpoint=", 11) == 0) {
+			checkpoint = argv[i] + 11;
+		} else if (strncmp(argv[i], "restore=", 8) == 0) {
+			restore = argv[i] + 8;
+		} else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	sc_set_time_resolution(1, SC_PS);
 
-	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS));
+	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS),
+			shared_ram_spec);
+
+	if (restore && !checkpoint_restore_all(restore)) {
+		exit(EXIT_FAILURE);
+	}
 
 	if (argc < 3) {
 		sc_start(1, SC_PS);
@@ -615,6 +711,9 @@ int sc_main(int argc, char* argv[])
 	top->rst.write(false);
 
 	sc_start();
+	if (checkpoint && !checkpoint_save_all(checkpoint)) {
+		printf("failed to save checkpoint %s\n", checkpoint);
+	}
 
 	return 0;
 }
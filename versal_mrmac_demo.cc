@@ -29,6 +29,7 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 
@@ -47,8 +48,14 @@ using namespace std;
 #include "soc/xilinx/versal/xilinx-versal.h"
 #include "soc/net/ethernet/xilinx/mrmac/mrmac.h"
 #include "soc/dma/xilinx/mcdma/mcdma.h"
-
-#define NR_MASTERS	3
+#include "eth-traffic.h"
+#include "pcap-tap.h"
+#include "eth-switch-port.h"
+#include "eth-rss.h"
+
+/* Each DMA queue has its own MCDMA, register window and interrupt pair.  */
+#define MAX_DMA_QUEUES	8
+#define NR_MASTERS	(2 + MAX_DMA_QUEUES)
 #define NR_DEVICES	8
 
 //#define BASE_ADDR       0x28000000ULL
@@ -60,10 +67,41 @@ SC_MODULE(Top)
 {
 	SC_HAS_PROCESS(Top);
 	iconnect<NR_MASTERS, NR_DEVICES> bus;
-	xilinx_versal versal;
+	xilinx_versal *versal;
 
 	xilinx_mrmac mac;
-	xilinx_mcdma dma;
+	xilinx_mcdma *dma[MAX_DMA_QUEUES];
+	unsigned int nr_queues;
+
+	/*
+	 * With several queues, rss steers the received frames to them by
+	 * flow and mux merges the frames they transmit.
+	 */
+	eth_rss *rss;
+	eth_mux *mux;
+
+	/* Ties off the bus master ports nothing drives.  */
+	tlm_utils::simple_initiator_socket<Top> *unused_master[NR_MASTERS];
+
+	/*
+	 * Ethernet frame generators and sinks.  phy_gen and phy_sink stand
+	 * in for the link partner, dma_gen and dma_sink for the MCDMA.
+	 * Without QEMU versal is NULL and the DMA side must be replaced.
+	 */
+	eth_traffic_gen *phy_gen;
+	eth_traffic_gen *dma_gen;
+	eth_traffic_sink *phy_sink;
+	eth_traffic_sink *dma_sink;
+
+	/* Link to an Ethernet switch shared with other demos.  */
+	eth_switch_port *sw_port;
+
+	/* Taps on the four streams of the MAC, capturing if cap is set.  */
+	pcap_writer *cap;
+	pcap_tap tap_mac_tx;
+	pcap_tap tap_mac_rx;
+	pcap_tap tap_phy_tx;
+	pcap_tap tap_phy_rx;
 
 	// Dummy models.
 	memory gt_ctrl0;
@@ -88,11 +126,28 @@ SC_MODULE(Top)
 		rst_n.write(!rst.read());
 	}
 
-	Top(sc_module_name name, const char *sk_descr, sc_time quantum) :
+	Top(sc_module_name name, const char *sk_descr, sc_time quantum,
+		const eth_traffic_config *eth = NULL,
+		const eth_traffic_config *eth_dma = NULL,
+		const pcap_tap_config *capture = NULL,
+		const char *switch_descr = NULL,
+		const eth_rss_config *rss_cfg = NULL) :
 		bus("bus"),
-		versal("versal", sk_descr, remoteport_tlm_sync_untimed_ptr, true),
+		versal(NULL),
 		mac("mac", true),
-		dma("dma", 1),
+		nr_queues(0),
+		rss(NULL),
+		mux(NULL),
+		phy_gen(NULL),
+		dma_gen(NULL),
+		phy_sink(NULL),
+		dma_sink(NULL),
+		sw_port(NULL),
+		cap(capture ? new pcap_writer("capture", *capture) : NULL),
+		tap_mac_tx("tap-mac-tx", cap),
+		tap_mac_rx("tap-mac-rx", cap),
+		tap_phy_tx("tap-phy-tx", cap),
+		tap_phy_rx("tap-phy-rx", cap),
 		gt_ctrl0("gt_ctrl0", SC_ZERO_TIME, 0x100),
 		gt_ctrl1("gt_ctrl1", SC_ZERO_TIME, 0x100),
 		gt_ctrl2("gt_ctrl2", SC_ZERO_TIME, 0x100),
@@ -102,6 +157,8 @@ SC_MODULE(Top)
 		rst("rst"),
 		rst_n("rst_n")
 	{
+		unsigned int i;
+
 		SC_THREAD(pull_reset);
 
 		SC_METHOD(gen_rst_n);
@@ -109,15 +166,31 @@ SC_MODULE(Top)
 
 		m_qk.set_global_quantum(quantum);
 
-		versal.rst(rst);
+		if (sk_descr) {
+			versal = new xilinx_versal("versal", sk_descr,
+					remoteport_tlm_sync_untimed_ptr, true);
+			versal->rst(rst);
+		}
+		if (!eth_dma) {
+			nr_queues = rss_cfg ? rss_cfg->queues : 1;
+		}
+		for (i = 0; i < nr_queues; i++) {
+			char name[16];
+
+			snprintf(name, sizeof name, "dma%u", i);
+			dma[i] = new xilinx_mcdma(name, 1);
+			dma[i]->rst(rst);
+		}
 		mac.rst(rst);
-		dma.rst(rst);
 
 		bus.memmap(BASE_ADDR + 0x10000ULL, 0x10000 - 1,
 				ADDRMODE_RELATIVE, -1, mac.reg_socket);
 
-		bus.memmap(BASE_ADDR + 0x20000ULL, 0x1000 - 1,
-				ADDRMODE_RELATIVE, -1, dma.target_socket);
+		for (i = 0; i < nr_queues; i++) {
+			bus.memmap(BASE_ADDR + 0x20000ULL + i * 0x1000ULL,
+				0x1000 - 1, ADDRMODE_RELATIVE, -1,
+				dma[i]->target_socket);
+		}
 
 		bus.memmap(BASE_ADDR + 0x60000ULL, 0x100 - 1,
 				ADDRMODE_RELATIVE, -1, gt_ctrl0.socket);
@@ -134,24 +207,89 @@ SC_MODULE(Top)
 		bus.memmap(BASE_ADDR + 0xa0000ULL, 0x100 - 1,
 				ADDRMODE_RELATIVE, -1, gt_pll.socket);
 
-		bus.memmap(0x0LL, 0xffffffff - 1,
-				ADDRMODE_RELATIVE, -1, *(versal.s_axi_fpd));
-
-		versal.m_axi_lpd->bind(*(bus.t_sk[0]));
-		versal.m_axi_fpd->bind(*(bus.t_sk[1]));
-
-		dma.init_socket.bind(*(bus.t_sk[2]));
-
-		dma.mm2s_stream_socket[0].bind(mac.mac_tx_socket);
-		mac.mac_rx_socket.bind(dma.s2mm_stream_socket[0]);
-
-		dma.mm2s_irq(versal.pl2ps_irq[0]);
-		dma.s2mm_irq(versal.pl2ps_irq[1]);
-
-		versal.user_master[0]->bind(mac.phy_rx_socket);
-		mac.phy_tx_socket.bind(*versal.user_slave[0]);
-
-		versal.tie_off();
+		if (versal) {
+			bus.memmap(0x0LL, 0xffffffff - 1,
+				ADDRMODE_RELATIVE, -1, *(versal->s_axi_fpd));
+
+			versal->m_axi_lpd->bind(*(bus.t_sk[0]));
+			versal->m_axi_fpd->bind(*(bus.t_sk[1]));
+		}
+
+		tap_mac_tx.init_socket.bind(mac.mac_tx_socket);
+		mac.mac_rx_socket.bind(tap_mac_rx.tgt_socket);
+		tap_phy_rx.init_socket.bind(mac.phy_rx_socket);
+		mac.phy_tx_socket.bind(tap_phy_tx.tgt_socket);
+
+		if (nr_queues > 1) {
+			rss = new eth_rss("rss", *rss_cfg);
+			mux = new eth_mux("mux", nr_queues);
+
+			tap_mac_rx.init_socket.bind(rss->tgt_socket);
+			mux->init_socket.bind(tap_mac_tx.tgt_socket);
+		}
+		for (i = 0; i < nr_queues; i++) {
+			dma[i]->init_socket.bind(*(bus.t_sk[2 + i]));
+
+			if (mux) {
+				dma[i]->mm2s_stream_socket[0].bind(
+						*mux->tgt_socket[i]);
+				rss->init_socket[i]->bind(
+						dma[i]->s2mm_stream_socket[0]);
+			} else {
+				dma[i]->mm2s_stream_socket[0].bind(
+						tap_mac_tx.tgt_socket);
+				tap_mac_rx.init_socket.bind(
+						dma[i]->s2mm_stream_socket[0]);
+			}
+
+			dma[i]->mm2s_irq(versal->pl2ps_irq[2 * i]);
+			dma[i]->s2mm_irq(versal->pl2ps_irq[2 * i + 1]);
+		}
+		if (!nr_queues) {
+			dma_gen = new eth_traffic_gen("dma-gen", *eth_dma);
+			dma_gen->init_socket.bind(tap_mac_tx.tgt_socket);
+		}
+
+		if (eth) {
+			phy_gen = new eth_traffic_gen("phy-gen", *eth);
+			phy_gen->init_socket.bind(tap_phy_rx.tgt_socket);
+		} else if (switch_descr) {
+			sw_port = new eth_switch_port("switch-port", switch_descr);
+			sw_port->init_socket.bind(tap_phy_rx.tgt_socket);
+		} else if (versal) {
+			versal->user_master[0]->bind(tap_phy_rx.tgt_socket);
+		}
+
+		/* Each sink counts the drops of the generator across the MAC.  */
+		if (sw_port) {
+			tap_phy_tx.init_socket.bind(sw_port->tgt_socket);
+		} else if (eth || !versal) {
+			phy_sink = new eth_traffic_sink("phy-sink", dma_gen);
+			tap_phy_tx.init_socket.bind(phy_sink->tgt_socket);
+		} else {
+			tap_phy_tx.init_socket.bind(*versal->user_slave[0]);
+		}
+		if (!nr_queues) {
+			dma_sink = new eth_traffic_sink("dma-sink", phy_gen);
+			tap_mac_rx.init_socket.bind(dma_sink->tgt_socket);
+		}
+
+		for (i = 0; i < NR_MASTERS; i++) {
+			char name[32];
+
+			unused_master[i] = NULL;
+			if (i < 2 ? versal != NULL : i - 2 < nr_queues) {
+				continue;
+			}
+			snprintf(name, sizeof name, "unused-master%u", i);
+			unused_master[i] = new tlm_utils::
+				simple_initiator_socket<Top>(name);
+			unused_master[i]->bind(*(bus.t_sk[i]));
+		}
+
+		if (versal) {
+			versal->tie_off();
+		}
 	}
 
 private:
@@ -160,13 +298,37 @@ private:
 
 void usage(void)
 {
-	cout << "tlm socket-path sync-quantum-ns" << endl;
+	cout << "tlm socket-path sync-quantum-ns [eth=<spec>] "
+		"[eth-dma=<spec>] [capture=<file>[,key=value...]] "
+		"[switch=unix:<path>|shm:/<name>] [rss=<spec>]" << endl;
+	cout << "  eth= sends frames into the MAC from the PHY side, "
+		"eth-dma= from the DMA side" << endl;
+	cout << "  spec: key=value,... with keys pcap, loop, timed, mix, "
+		"rate, count, fcs, tag, drain, seed, stop" << endl;
+	cout << "  socket-path - runs without QEMU, this needs eth-dma="
+		<< endl;
+	cout << "  capture= writes the MAC's frames to a pcapng file, keys "
+		"snaplen, ethertype, min, max, every, ring" << endl;
+	cout << "  switch= links the PHY side to a port of eth-switch "
+		"instead of QEMU" << endl;
+	cout << "  rss= spreads the traffic over several MCDMA queues, keys "
+		"queues (at most " << MAX_DMA_QUEUES << "), key, udp, l4"
+		<< endl;
 }
 
 int sc_main(int argc, char* argv[])
 {
 	Top *top;
 	uint64_t sync_quantum;
+	const char *sk_descr = argc > 1 ? argv[1] : NULL;
+	eth_traffic_config eth_cfg, eth_dma_cfg;
+	eth_traffic_config *eth = NULL, *eth_dma = NULL;
+	pcap_tap_config cap_cfg;
+	pcap_tap_config *capture = NULL;
+	const char *switch_descr = NULL;
+	eth_rss_config rss_cfg;
+	eth_rss_config *rss = NULL;
+	int i;
 
 	if (argc < 3) {
 		sync_quantum = 10000;
@@ -174,9 +336,64 @@ int sc_main(int argc, char* argv[])
 		sync_quantum = strtoull(argv[2], NULL, 10);
 	}
 
+	for (i = 3; i < argc; i++) {
+		if (strncmp(argv[i], "eth=", 4) == 0) {
+			if (!eth_cfg.parse(argv[i] + 4)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			eth = &eth_cfg;
+		} else if (strncmp(argv[i], "eth-dma=", 8) == 0) {
+			if (!eth_dma_cfg.parse(argv[i] + 8)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			eth_dma = &eth_dma_cfg;
+		} else if (strncmp(argv[i], "capture=", 8) == 0) {
+			if (!cap_cfg.parse(argv[i] + 8)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			capture = &cap_cfg;
+		} else if (strncmp(argv[i], "switch=", 7) == 0) {
+			switch_descr = argv[i] + 7;
+		} else if (strncmp(argv[i], "rss=", 4) == 0) {
+			if (!rss_cfg.parse(argv[i] + 4) ||
+			    rss_cfg.queues > MAX_DMA_QUEUES) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			rss = &rss_cfg;
+		} else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* The PHY side has one peer.  */
+	if (eth && switch_descr) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	/* The queues belong to the MCDMA, which eth-dma= replaces.  */
+	if (rss && eth_dma) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (!sk_descr || strcmp(sk_descr, "-") == 0) {
+		if (!eth_dma) {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+		sk_descr = NULL;
+	}
+
 	sc_set_time_resolution(1, SC_PS);
 
-	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS));
+	top = new Top("top", sk_descr, sc_time((double) sync_quantum, SC_NS),
+			eth, eth_dma, capture, switch_descr, rss);
 
 	if (argc < 3) {
 		sc_start(1, SC_PS);
@@ -44,7 +44,9 @@ using namespace std;
 #include "soc/xilinx/versal-net/xilinx-versal-net.h"
 #include "soc/dma/xilinx-cdma.h"
 #include "tlm-extensions/genattr.h"
+#include "tlm-pool.h"
 #include "memory.h"
+#include "sparse-memory.h"
 
 #define RAM_SIZE (2 * 1024 * 1024)
 
@@ -119,12 +121,16 @@ private:
 	virtual void b_transport(tlm::tlm_generic_payload& trans,
 			sc_time& delay)
 	{
+		tlm_extension_pool<genattr_extension> &pool =
+			tlm_extension_pool<genattr_extension>::shared();
 		genattr_extension *genattr;
+		bool pooled = false;
 
 		trans.get_extension(genattr);
 		if (!genattr) {
-			genattr = new genattr_extension();
+			genattr = pool.get();
 			trans.set_extension(genattr);
+			pooled = true;
 		}
 
 		//
@@ -133,6 +139,11 @@ private:
 		genattr->set_master_id(m_smid);
 
 		init_socket->b_transport(trans, delay);
+
+		if (pooled) {
+			trans.clear_extension(genattr);
+			pool.put(genattr);
+		}
 	}
 
 	uint32_t m_smid;
@@ -144,8 +155,8 @@ SC_MODULE(Top)
 	xilinx_versal_net versal_net;
 	debugdev debugdev_cpm;
 
-	memory mem0;
-	memory mem1;
+	sparse_memory mem0;
+	sparse_memory mem1;
 
 	xilinx_cdma cdma0;
 	SMIDdev smid_cdma0;
@@ -35,6 +35,7 @@ using namespace sc_core;
 using namespace std;
 
 #include "tlm-extensions/genattr.h"
+#include "tlm-pool.h"
 #include "xilinx-axidma.h"
 #include <sys/types.h>
 
@@ -45,18 +46,21 @@ using namespace std;
 		}			\
 	} while (0)
 
-axidma_mm2s::axidma_mm2s(sc_module_name name, bool use_memcpy)
-	: axidma(name, use_memcpy), stream_socket("stream-socket")
+axidma_mm2s::axidma_mm2s(sc_module_name name, bool use_memcpy,
+			bool use_method)
+	: axidma(name, use_memcpy, use_method), stream_socket("stream-socket"),
+	  done_pending(false)
 {
 }
 
-axidma_s2mm::axidma_s2mm(sc_module_name name, bool use_memcpy)
-	: axidma(name, use_memcpy), stream_socket("stream-socket")
+axidma_s2mm::axidma_s2mm(sc_module_name name, bool use_memcpy,
+			bool use_method)
+	: axidma(name, use_memcpy, use_method), stream_socket("stream-socket")
 {
 	stream_socket.register_b_transport(this, &axidma_s2mm::s_b_transport);
 }
 
-axidma::axidma(sc_module_name name, bool use_memcpy)
+axidma::axidma(sc_module_name name, bool use_memcpy, bool use_method)
 	: sc_module(name), tgt_socket("tgt-socket"), irq("irq"),
 	  use_memcpy(use_memcpy)
 {
@@ -66,7 +70,14 @@ axidma::axidma(sc_module_name name, bool use_memcpy)
 	SC_METHOD(update_irqs);
 	dont_initialize();
 	sensitive << ev_update_irqs;
-	SC_THREAD(do_dma_copy);
+
+	if (use_method) {
+		SC_METHOD(dma_copy_method);
+		dont_initialize();
+		sensitive << ev_dma_copy;
+	} else {
+		SC_THREAD(do_dma_copy);
+	}
 }
 
 void axidma::do_dma_trans(tlm::tlm_command cmd, unsigned char *buf,
@@ -93,26 +104,28 @@ void axidma_mm2s::do_stream_trans(tlm::tlm_command cmd, unsigned char *buf,
 				sc_dt::uint64 addr, sc_dt::uint64 len, bool eop,
 				sc_time &delay)
 {
-	tlm::tlm_generic_payload tr;
-	genattr_extension *genattr = new genattr_extension();
+	tlm_payload_pool &pool = tlm_payload_pool::shared();
+	tlm::tlm_generic_payload *tr = pool.allocate();
+	genattr_extension *genattr;
 
-	tr.set_command(cmd);
-	tr.set_address(addr);
-	tr.set_data_ptr(buf);
-	tr.set_data_length(len);
-	tr.set_streaming_width(len);
-	tr.set_dmi_allowed(false);
-	tr.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+	genattr = tlm_payload_pool::get_extension<genattr_extension>(tr);
+
+	tr->set_command(cmd);
+	tr->set_address(addr);
+	tr->set_data_ptr(buf);
+	tr->set_data_length(len);
+	tr->set_streaming_width(len);
+	tr->set_dmi_allowed(false);
+	tr->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
 
 	genattr->set_eop(eop);
-	tr.set_extension(genattr);
 
-	stream_socket->b_transport(tr, delay);
-	if (tr.get_response_status() != tlm::TLM_OK_RESPONSE) {
+	stream_socket->b_transport(*tr, delay);
+	if (tr->get_response_status() != tlm::TLM_OK_RESPONSE) {
 		printf("%s:%d DMA transaction error!\n", __func__, __LINE__);
 	}
 
-	tr.release_extension(genattr);
+	tr->release();
 }
 
 void axidma::update_irqs(void)
@@ -123,45 +136,108 @@ void axidma::update_irqs(void)
 
 void axidma_s2mm::do_dma_copy(void) {}
 
+void axidma_mm2s::dma_copy_chunk(void)
+{
+	unsigned char buf[2 * 1024];
+	uint64_t addr;
+	sc_time delay = qk.get_local_time();
+	unsigned int tlen;
+	bool eop;
+
+	assert(!(regs.sr & AXIDMA_SR_IDLE));
+	tlen = regs.length > sizeof buf ? sizeof buf : regs.length;
+	eop = tlen == regs.length;
+
+	addr = regs.addr_msb;
+	addr <<= 32;
+	addr += regs.addr;
+
+	if (use_memcpy) {
+		memcpy(buf, (void *) addr, tlen);
+	} else {
+		do_dma_trans(tlm::TLM_READ_COMMAND, buf, addr, tlen, delay);
+	}
+	do_stream_trans(tlm::TLM_WRITE_COMMAND, buf, addr, tlen, eop, delay);
+	qk.set(delay);
+
+	addr += tlen;
+	regs.length -= tlen;
+
+	regs.addr = addr;
+	regs.addr_msb = addr >> 32;
+}
+
+/* Called once the kernel has caught up with the last chunk.  */
+void axidma_mm2s::dma_done(void)
+{
+	/* If the DMA was running, signal done.  */
+	regs.sr |= AXIDMA_SR_IDLE | AXIDMA_SR_IOC_IRQ;
+	ev_update_irqs.notify();
+}
+
 void axidma_mm2s::do_dma_copy(void)
 {
+	qk.reset();
 	while (1) {
-		unsigned char buf[2 * 1024];
-		uint64_t addr;
-		sc_time delay = SC_ZERO_TIME;
-		unsigned int tlen;
-		bool eop;
-
 		if (!regs.length) {
 			wait(ev_dma_copy);
+			qk.reset();
+		}
+		dma_copy_chunk();
+		if (regs.length == 0) {
+			qk.sync();
+			dma_done();
+		} else if (qk.need_sync()) {
+			qk.sync();
 		}
+	}
+}
+
+/*
+ * Copies chunks until the transfer is done or the quantum is used up,
+ * then sleeps for the local time, like the thread's sync.  Done is
+ * signalled on the wakeup after the last chunk.
+ */
+void axidma_mm2s::dma_copy_method(void)
+{
+	sc_time t;
 
-		assert(!(regs.sr & AXIDMA_SR_IDLE));
-		tlen = regs.length > sizeof buf ? sizeof buf : regs.length;
-		eop = tlen == regs.length;
+	if (done_pending) {
+		done_pending = false;
+		dma_done();
+	}
+	if (!regs.length) {
+		return;
+	}
+	qk.reset();
 
-		addr = regs.addr_msb;
-		addr <<= 32;
-		addr += regs.addr;
+	do {
+		dma_copy_chunk();
+	} while (regs.length && !qk.need_sync());
 
-		if (use_memcpy) {
-			memcpy(buf, (void *) addr, tlen);
-		} else {
-			do_dma_trans(tlm::TLM_READ_COMMAND, buf, addr, tlen, delay);
-		}
-		do_stream_trans(tlm::TLM_WRITE_COMMAND, buf, addr, tlen, eop, delay);
+	done_pending = regs.length == 0;
+	t = qk.get_local_time();
+	qk.reset();
+	next_trigger(t);
+}
 
-		addr += tlen;
-		regs.length -= tlen;
+void axidma::checkpoint_save(checkpoint_writer &ck)
+{
+	ck.add(string(name()) + ".regs", regs);
+	ck.add(string(name()) + ".length_copied", length_copied);
+}
 
-		regs.addr = addr;
-		regs.addr_msb = addr >> 32;
+void axidma::checkpoint_restore(checkpoint_reader &ck)
+{
+	ck.get(string(name()) + ".regs", regs);
+	ck.get(string(name()) + ".length_copied", length_copied);
+}
 
-		if (regs.length == 0) {
-			/* If the DMA was running, signal done.  */
-			regs.sr |= AXIDMA_SR_IDLE | AXIDMA_SR_IOC_IRQ;
-			ev_update_irqs.notify();
-		}
+void axidma::checkpoint_resume(void)
+{
+	ev_update_irqs.notify(SC_ZERO_TIME);
+	if (!(regs.sr & AXIDMA_SR_IDLE)) {
+		ev_dma_copy.notify(SC_ZERO_TIME);
 	}
 }
 
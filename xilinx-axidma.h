@@ -21,6 +21,9 @@
  * THE SOFTWARE.
  */
 
+#include "tlm_utils/tlm_quantumkeeper.h"
+#include "checkpoint.h"
+
 enum {
 	AXIDMA_CR_RS		= 1 << 0,
 	AXIDMA_CR_RESET		= 1 << 2,
@@ -47,15 +50,26 @@ enum {
 
 /* Base class common to both the mm2s and s2mm channels.  */
 class axidma
-: public sc_core::sc_module
+: public sc_core::sc_module, public checkpointable
 {
 public:
 	tlm_utils::simple_initiator_socket<axidma> init_socket;
 	tlm_utils::simple_target_socket<axidma> tgt_socket;
 
 	sc_out<bool> irq;
-	axidma(sc_core::sc_module_name name, bool use_memcpy = false);
+
+	/*
+	 * With use_method, the channel's copy engine runs as a method
+	 * process instead of a thread.  The targets it copies between must
+	 * then never wait() in b_transport.
+	 */
+	axidma(sc_core::sc_module_name name, bool use_memcpy = false,
+		bool use_method = false);
 	SC_HAS_PROCESS(axidma);
+
+	void checkpoint_save(checkpoint_writer &ck);
+	void checkpoint_restore(checkpoint_reader &ck);
+	void checkpoint_resume(void);
 protected:
 	union {
 		struct {
@@ -74,9 +88,16 @@ protected:
 
 	bool use_memcpy;
 
+	/*
+	 * Time the channel has run ahead of the kernel.  It only syncs
+	 * once per quantum, or when a transfer completes.
+	 */
+	tlm_utils::tlm_quantumkeeper qk;
+
 	sc_event ev_update_irqs;
 	sc_event ev_dma_copy;
 	virtual void do_dma_copy(void) {};
+	virtual void dma_copy_method(void) {};
 	void do_dma_trans(tlm::tlm_command cmd, unsigned char *buf,
 			sc_dt::uint64 addr, sc_dt::uint64 len, sc_time &delay);
 	void update_irqs(void);
@@ -89,10 +110,15 @@ class axidma_mm2s : public axidma
 {
 public:
 	tlm_utils::simple_initiator_socket<axidma_mm2s> stream_socket;
-	axidma_mm2s(sc_core::sc_module_name name, bool use_memcpy = false);
+	axidma_mm2s(sc_core::sc_module_name name, bool use_memcpy = false,
+			bool use_method = false);
 protected:
 	virtual void do_dma_copy(void);
+	virtual void dma_copy_method(void);
 private:
+	bool done_pending;
+	void dma_copy_chunk(void);
+	void dma_done(void);
 	void do_stream_trans(tlm::tlm_command cmd, unsigned char *buf,
 			sc_dt::uint64 addr, sc_dt::uint64 len, bool eop, sc_time &delay);
 };
@@ -101,7 +127,8 @@ class axidma_s2mm : public axidma
 {
 public:
 	tlm_utils::simple_target_socket<axidma_s2mm> stream_socket;
-	axidma_s2mm(sc_core::sc_module_name name, bool use_memcpy = false);
+	axidma_s2mm(sc_core::sc_module_name name, bool use_memcpy = false,
+			bool use_method = false);
 protected:
 	virtual void do_dma_copy(void);
 private:
@@ -45,11 +45,17 @@ using namespace std;
 #include "debugdev.h"
 #include "demo-dma.h"
 #include "soc/xilinx/zynqmp/xilinx-zynqmp.h"
+#include "rp-trace.h"
+#include "traffic-gen.h"
+#include "adaptive-quantum.h"
+#include "shared-ram.h"
+#include "gated-clock.h"
+#include "checkpoint.h"
 
 #include "checkers/pc-axilite.h"
 #include "tlm-bridges/tlm2axilite-bridge.h"
 #include "tlm-bridges/tlm2axi-bridge.h"
-#include "tlm-bridges/tlm2apb-bridge.h"
+#include "tlm2apb-bridge.h"
 #ifdef HAVE_VERILOG_VCS
 #include "apb_slave_timer.h"
 #endif
@@ -70,14 +76,50 @@ SC_MODULE(Top)
 {
 	SC_HAS_PROCESS(Top);
 	iconnect<NR_MASTERS, NR_DEVICES> bus;
-	xilinx_zynqmp zynq;
+	xilinx_zynqmp *zynq;
 	memory mem;
+	tlm_memory_checkpoint *mem_ck;
 	debugdev debug;
 	demodma *dma[NR_DEMODMA];
 
 	sc_signal<bool> rst, rst_n;
 
+	/*
+	 * Remote-port record and replay, and the traffic generator.  When
+	 * replaying or generating traffic, zynq is NULL, the replayer or the
+	 * generator drives the PS master port, the sink stands in for PS
+	 * memory and the interrupts go to replay_irq.
+	 */
+	rp_trace_writer *rp_writer;
+	tlm_trace_recorder *rp_recorder;
+	wire_trace_recorder *irq_recorder;
+	rp_trace_replayer *rp_replayer;
+	traffic_gen *tgen;
+	tlm_trace_sink *rp_sink;
+	sc_signal<bool> replay_irq[1 + NR_DEMODMA];
+
+	/* Adaptive quantum controller and its MMIO and DMA probes.  */
+	adaptive_quantum *aq;
+	tlm_activity_probe *aq_mmio;
+	tlm_activity_probe *aq_dma;
+
+	/* PS DDR mapped from QEMU's memory backend file.  */
+	shared_ram *ddr_shared;
+
+	sc_signal<bool> &pl2ps_irq(unsigned int i)
+	{
+		return zynq ? zynq->pl2ps_irq[i] : replay_irq[i];
+	}
+
+#ifdef HAVE_VERILOG
+	gated_clock *clk;
+	/* The guest can read the timer's free-running counter, never gate it.  */
+	sc_clock *tmr_clk;
+	clock_wake_probe *al_wake;
+	clock_wake_probe *af_wake;
+#else
 	sc_clock *clk;
+#endif
 #define AXIFULL_DATA_WIDTH 128
 #define AXIFULL_ID_WIDTH 8
 #ifdef HAVE_VERILOG
@@ -202,13 +244,29 @@ SC_MODULE(Top)
 		return cfg;
 	}
 
-	Top(sc_module_name name, const char *sk_descr, sc_time quantum) :
+	Top(sc_module_name name, const char *sk_descr, sc_time quantum,
+		const char *record = NULL, const char *replay = NULL,
+		bool replay_fast = false,
+		const traffic_gen_config *traffic = NULL,
+		sc_time max_quantum = SC_ZERO_TIME,
+		const char *shared_ram_spec = NULL,
+		bool posted_mmio = false) :
 		bus("bus"),
-		zynq("zynq", sk_descr),
+		zynq(NULL),
 		mem("mem", sc_time(1, SC_NS), 64 * 1024),
 		debug("debug"),
 		rst("rst"),
 		rst_n("rst_n"),
+		rp_writer(NULL),
+		rp_recorder(NULL),
+		irq_recorder(NULL),
+		rp_replayer(NULL),
+		tgen(NULL),
+		rp_sink(NULL),
+		aq(NULL),
+		aq_mmio(NULL),
+		aq_dma(NULL),
+		ddr_shared(NULL),
 #ifdef HAVE_VERILOG
 		checker("checker", checker_config()),
 		irq_tmr("irq_tmr"),
@@ -307,7 +365,27 @@ SC_MODULE(Top)
 
 		m_qk.set_global_quantum(quantum);
 
-		zynq.rst(rst);
+		mem_ck = new tlm_memory_checkpoint(mem.name(),
+					mem.socket.get_base_interface(),
+					64 * 1024);
+
+		if (max_quantum > quantum) {
+			aq = new adaptive_quantum("adaptive-quantum", quantum,
+						max_quantum, 1 + NR_DEMODMA, 4,
+						"quantum.log");
+		}
+
+		if (replay) {
+			rp_replayer = new rp_trace_replayer("rp-replay", replay,
+							replay_fast, 1);
+			rp_sink = new tlm_trace_sink("rp-sink");
+		} else if (traffic) {
+			tgen = new traffic_gen("traffic-gen", *traffic);
+			rp_sink = new tlm_trace_sink("rp-sink");
+		} else {
+			zynq = new xilinx_zynqmp("zynq", sk_descr);
+			zynq->rst(rst);
+		}
 
 		for (i = 0; i < (sizeof dma / sizeof dma[0]); i++) {
 			char name[16];
@@ -316,26 +394,53 @@ SC_MODULE(Top)
 			dma[i] = new demodma(name);
 		}
 
+		/*
+		 * With posted_mmio, guest writes to the debug device and the
+		 * DMA registers complete without waiting for the models.
+		 * All initiators on this bus are threads, as posted regions
+		 * require.
+		 */
 		bus.memmap(0xa0000000ULL, 0x100 - 1,
-				ADDRMODE_RELATIVE, -1, debug.socket);
+				ADDRMODE_RELATIVE, -1, debug.socket,
+				posted_mmio);
 
 		for (i = 0; i < (sizeof dma / sizeof dma[0]); i++) {
 			bus.memmap(0xa0010000ULL + 0x100 * i, 0x18 - 1,
-				ADDRMODE_RELATIVE, -1, dma[i]->tgt_socket);
+				ADDRMODE_RELATIVE, -1, dma[i]->tgt_socket,
+				posted_mmio);
 		}
 
+#ifdef HAVE_VERILOG
+		/*
+		 * Slow clocks to keep simulation fast.  The AXI devices' clock
+		 * is also gated, so it only runs while they have accesses to
+		 * serve.  The timer counts on a clock of its own, as its
+		 * free-running counter must keep time while the guest is idle.
+		 */
+		clk = new gated_clock("clk", sc_time(10, SC_US));
+		clk->add_busy(rst);
+		tmr_clk = new sc_clock("tmr-clk", sc_time(10, SC_US));
+
 		tlm2apb_tmr = new tlm2apb_bridge<bool, sc_bv, 16, sc_bv, 32> ("tlm2apb-tmr-bridge");
 		bus.memmap(0xa0020000ULL, 0x10 - 1,
 				ADDRMODE_RELATIVE, -1, tlm2apb_tmr->tgt_socket);
 
-#ifdef HAVE_VERILOG
 		tlm2axi_al = new tlm2axilite_bridge<4, 32> ("tlm2axi-al-bridge");
 		tlm2axi_af = new tlm2axi_bridge<10, AXIFULL_DATA_WIDTH> ("tlm2axi-af-bridge");
+		al_wake = new clock_wake_probe("al-wake", clk);
+		af_wake = new clock_wake_probe("af-wake", clk);
+		al_wake->init_socket.bind(tlm2axi_al->tgt_socket);
+		af_wake->init_socket.bind(tlm2axi_af->tgt_socket);
 		bus.memmap(0xa0450000ULL, 0x10 - 1,
-				ADDRMODE_RELATIVE, -1, tlm2axi_al->tgt_socket);
+				ADDRMODE_RELATIVE, -1, al_wake->tgt_socket);
 		bus.memmap(0xa0460000ULL, 0x400 - 1,
-				ADDRMODE_RELATIVE, -1, tlm2axi_af->tgt_socket);
+				ADDRMODE_RELATIVE, -1, af_wake->tgt_socket);
 #else
+		/* Only tie-offs behind the pins, no need to clock them.  */
+		tlm2apb_tmr = new tlm2apb_bridge<bool, sc_bv, 16, sc_bv, 32> ("tlm2apb-tmr-bridge", true);
+		bus.memmap(0xa0020000ULL, 0x10 - 1,
+				ADDRMODE_RELATIVE, -1, tlm2apb_tmr->tgt_socket);
+
 		bus.memmap(0xa0450000ULL, 0x10 - 1,
 				ADDRMODE_RELATIVE, -1, mem_al.socket);
 		bus.memmap(0xa0460000ULL, 0x400 - 1,
@@ -344,21 +449,71 @@ SC_MODULE(Top)
 		bus.memmap(0xa0800000ULL, 64 * 1024 - 1,
 				ADDRMODE_RELATIVE, -1, mem.socket);
 
-		bus.memmap(0x0LL, 0xffffffff - 1,
-				ADDRMODE_RELATIVE, -1, *(zynq.s_axi_hpc_fpd[0]));
-
-		zynq.s_axi_hpm_fpd[0]->bind(*(bus.t_sk[0]));
+		if (rp_sink) {
+			bus.memmap(0x0LL, 0xffffffff - 1,
+				ADDRMODE_RELATIVE, -1, rp_sink->socket);
+			if (rp_replayer) {
+				rp_replayer->init_socket[0]->bind(*(bus.t_sk[0]));
+			} else {
+				tgen->init_socket.bind(*(bus.t_sk[0]));
+			}
+		} else {
+			tlm::tlm_target_socket<> *ps_master = bus.t_sk[0];
+			tlm::tlm_target_socket<> *ps_slave = zynq->s_axi_hpc_fpd[0];
+
+			if (aq) {
+				aq_dma = new tlm_activity_probe("aq-dma", aq);
+				aq_dma->init_socket.bind(*ps_slave);
+				ps_slave = &aq_dma->tgt_socket;
+
+				aq_mmio = new tlm_activity_probe("aq-mmio", aq);
+				aq_mmio->init_socket.bind(*ps_master);
+				ps_master = &aq_mmio->tgt_socket;
+			}
+
+			if (shared_ram_spec) {
+				ddr_shared = new shared_ram("ddr-shared",
+							shared_ram_spec);
+				ddr_shared->init_socket.bind(*ps_slave);
+				ps_slave = &ddr_shared->tgt_socket;
+			}
+
+			bus.memmap(0x0LL, 0xffffffff - 1,
+				ADDRMODE_RELATIVE, -1, *ps_slave);
+
+			if (record) {
+				rp_writer = new rp_trace_writer(record);
+				rp_recorder = new tlm_trace_recorder("rp-record",
+								rp_writer, 0);
+				rp_recorder->init_socket.bind(*ps_master);
+				ps_master = &rp_recorder->tgt_socket;
+			}
+
+			zynq->s_axi_hpm_fpd[0]->bind(*ps_master);
+		}
 
 		for (i = 0; i < (sizeof dma / sizeof dma[0]); i++) {
 			dma[i]->init_socket.bind(*(bus.t_sk[1 + i]));
-			dma[i]->irq(zynq.pl2ps_irq[1 + i]);
+			dma[i]->irq(pl2ps_irq(1 + i));
 		}
 
-		debug.irq(zynq.pl2ps_irq[0]);
+		debug.irq(pl2ps_irq(0));
+
+		if (aq) {
+			for (i = 0; i < 1 + NR_DEMODMA; i++) {
+				(*aq->irq[i])(pl2ps_irq(i));
+			}
+		}
+
+		if (rp_writer) {
+			irq_recorder = new wire_trace_recorder("rp-record-irq",
+						rp_writer, 1, 1 + NR_DEMODMA);
+			for (i = 0; i < 1 + NR_DEMODMA; i++) {
+				(*irq_recorder->wires[i])(pl2ps_irq(i));
+			}
+		}
 
 #ifdef HAVE_VERILOG
-		/* Slow clock to keep simulation fast.  */
-		clk = new sc_clock("clk", sc_time(10, SC_US));
 #ifdef HAVE_VERILOG_VCS
 		apb_timer = new apb_slave_timer("apb_timer");
 #elif defined(HAVE_VERILOG_VERILATOR)
@@ -366,7 +521,7 @@ SC_MODULE(Top)
 		al = new Vaxilite_dev("axilite-dev");
 		af = new Vaxifull_dev("axifull-dev");
 #endif
-                apb_timer->clk(*clk);
+                apb_timer->clk(*tmr_clk);
                 apb_timer->rst(rst);
                 apb_timer->irq(irq_tmr);
                 apb_timer->psel(apbsig_timer_psel);
@@ -377,7 +532,7 @@ SC_MODULE(Top)
                 apb_timer->prdata(apbsig_timer_prdata);
                 apb_timer->pready(apbsig_timer_pready);
 
-                tlm2apb_tmr->clk(*clk);
+                tlm2apb_tmr->clk(*tmr_clk);
 
 		checker.clk(*clk);
 		checker.resetn(rst_n);
@@ -580,24 +735,49 @@ SC_MODULE(Top)
                 tlm2apb_tmr->prdata(apbsig_timer_prdata);
                 tlm2apb_tmr->pready(apbsig_timer_pready);
 
-		zynq.tie_off();
+		if (zynq) {
+			zynq->tie_off();
+		}
 
 		SC_THREAD(pull_reset);
 	}
 
+	void end_of_simulation(void)
+	{
+		if (rp_writer) {
+			rp_writer->flush();
+		}
+	}
+
 private:
 	tlm_utils::tlm_quantumkeeper m_qk;
 };
 
 void usage(void)
 {
-	cout << "tlm socket-path sync-quantum-ns" << endl;
+	cout << "tlm socket-path sync-quantum-ns[:max-quantum-ns] [record=<file> | "
+		"replay=<file> | replay-fast=<file> | traffic=<spec>] "
+		"[checkpoint=<file>] [restore=<file>] "
+		"[shared-ram=<file>[,base=<addr>][,size=<bytes>]] "
+		"[posted-mmio]" << endl;
+	cout << "  traffic spec: key=value,... with keys base, size, read, "
+		"burst, pattern (seq, random, stride, hotset), stride, hot, "
+		"hotpct, depth, count, rate, seed, stop" << endl;
 }
 
 int sc_main(int argc, char* argv[])
 {
 	Top *top;
 	uint64_t sync_quantum;
+	uint64_t max_quantum = 0;
+	const char *record = NULL, *replay = NULL;
+	const char *checkpoint = NULL, *restore = NULL;
+	const char *shared_ram_spec = NULL;
+	bool posted_mmio = false;
+	int i;
+	bool replay_fast = false;
+	traffic_gen_config traffic_cfg;
+	traffic_gen_config *traffic = NULL;
 	sc_trace_file *trace_fp = NULL;
 
 #if HAVE_VERILOG_VERILATOR
@@ -607,12 +787,56 @@ int sc_main(int argc, char* argv[])
 	if (argc < 3) {
 		sync_quantum = 10000;
 	} else {
-		sync_quantum = strtoull(argv[2], NULL, 10);
+		char *end;
+
+		/* min:max selects the adaptive quantum.  */
+		sync_quantum = strtoull(argv[2], &end, 10);
+		if (*end == ':') {
+			max_quantum = strtoull(end + 1, NULL, 10);
+		}
+	}
+
+	for (i = 3; i < argc; i++) {
+		if (strncmp(argv[i], "record=", 7) == 0) {
+			record = argv[i] + 7;
+		} else if (strncmp(argv[i], "replay=", 7) == 0) {
+			replay = argv[i] + 7;
+		} else if (strncmp(argv[i], "replay-fast=", 12) == 0) {
+			replay = argv[i] + 12;
+			replay_fast = true;
+		} else if (strncmp(argv[i], "traffic=", 8) == 0) {
+			/* Default to the memory behind the bus.  */
+			traffic_cfg.base = 0xa0800000ULL;
+			traffic_cfg.size = 64 * 1024;
+			if (!traffic_cfg.parse(argv[i] + 8)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			traffic = &traffic_cfg;
+		} else if (strncmp(argv[i], "checkpoint=", 11) == 0) {
+			checkpoint = argv[i] + 11;
+		} else if (strncmp(argv[i], "restore=", 8) == 0) {
+			restore = argv[i] + 8;
+		} else if (strncmp(argv[i], "shared-ram=", 11) == 0) {
+			shared_ram_spec = argv[i] + 11;
+		} else if (strcmp(argv[i], "posted-mmio") == 0) {
+			posted_mmio = true;
+		} else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
 	}
 
 	sc_set_time_resolution(1, SC_PS);
 
-	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS));
+	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS),
+			record, replay, replay_fast, traffic,
+			sc_time((double) max_quantum, SC_NS), shared_ram_spec,
+			posted_mmio);
+
+	if (restore && !checkpoint_restore_all(restore)) {
+		exit(EXIT_FAILURE);
+	}
 
 	if (argc < 3) {
 		sc_start(1, SC_PS);
@@ -640,6 +864,9 @@ int sc_main(int argc, char* argv[])
 #endif
 
 	sc_start();
+	if (checkpoint && !checkpoint_save_all(checkpoint)) {
+		printf("failed to save checkpoint %s\n", checkpoint);
+	}
 	if (trace_fp) {
 		sc_close_vcd_trace_file(trace_fp);
 	}
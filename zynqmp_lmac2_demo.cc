@@ -42,17 +42,24 @@ using namespace std;
 #include "trace.h"
 #include "iconnect.h"
 #include "xilinx-axidma.h"
+#include "gated-clock.h"
 #include "soc/xilinx/zynqmp/xilinx-zynqmp.h"
 
-#include "tlm-bridges/tlm2apb-bridge.h"
+#include "tlm2apb-bridge.h"
 #include "tlm-bridges/tlm2axis-bridge.h"
 #include "tlm-bridges/axis2tlm-bridge.h"
 #include "tlm-xgmii-phy.h"
+#include "eth-traffic.h"
+#include "pcap-tap.h"
+#include "eth-switch-port.h"
 
 #ifdef HAVE_VERILOG_VERILATOR
 #include <verilated_vcd_sc.h>
 #include "Vlmac_wrapper_top.h"
 #include "verilated.h"
+#ifdef LMAC_RTL_THREAD
+#include "lmac-rtl-thread.h"
+#endif
 #endif
 
 #define NR_MASTERS	3
@@ -76,13 +83,33 @@ SC_MODULE(Top)
 
 	sc_signal<bool> rst, rst_n;
 
-	sc_clock *clk;
+	gated_clock *clk;
+	clock_wake_probe *apb_wake;
+	clock_wake_probe *tx_wake;
+	clock_wake_probe *rx_wake;
 
 	tlm2apb_bridge<bool, sc_bv, 16, sc_bv, 32> *tlm2apb_lmac;
 
+#ifdef LMAC_RTL_THREAD
+	lmac_rtl_thread<Vlmac_wrapper_top, 64> *lmac;
+#else
 	Vlmac_wrapper_top *lmac;
+#endif
 	tlm_xgmii_phy phy;
 
+	/* Stand in for the link partner instead of QEMU's user ports.  */
+	eth_traffic_gen *phy_gen;
+	eth_traffic_sink *phy_sink;
+	/* Or link to an Ethernet switch shared with other demos.  */
+	eth_switch_port *sw_port;
+
+	/* Taps on the XGMII and AXI-Stream sides, capturing if cap is set.  */
+	pcap_writer *cap;
+	pcap_tap tap_axis_tx;
+	pcap_tap tap_axis_rx;
+	pcap_tap tap_phy_tx;
+	pcap_tap tap_phy_rx;
+
 	sc_signal<sc_bv<64> > phy_txd;
 	sc_signal<sc_bv<8> > phy_txc;
 	sc_signal<sc_bv<64> > phy_rxd;
@@ -123,7 +150,10 @@ SC_MODULE(Top)
 		rst_n.write(!rst.read());
 	}
 
-	Top(sc_module_name name, const char *sk_descr, sc_time quantum) :
+	Top(sc_module_name name, const char *sk_descr, sc_time quantum,
+		const eth_traffic_config *eth = NULL,
+		const pcap_tap_config *capture = NULL,
+		const char *switch_descr = NULL) :
 		zynq("zynq", sk_descr, remoteport_tlm_sync_untimed_ptr, false),
 		dma_mm2s_A("dma_mm2s_A"),
 		dma_s2mm_C("dma_s2mm_C"),
@@ -133,6 +163,14 @@ SC_MODULE(Top)
 		rst_n("rst_n"),
 
 		phy("phy"),
+		phy_gen(NULL),
+		phy_sink(NULL),
+		sw_port(NULL),
+		cap(capture ? new pcap_writer("capture", *capture) : NULL),
+		tap_axis_tx("tap-axis-tx", cap),
+		tap_axis_rx("tap-axis-rx", cap),
+		tap_phy_tx("tap-phy-tx", cap),
+		tap_phy_rx("tap-phy-rx", cap),
 		phy_txd("phy_txd"),
 		phy_txc("phy_txc"),
 		phy_rxd("phy_rxd"),
@@ -179,9 +217,28 @@ SC_MODULE(Top)
 
 		bus   = new iconnect<NR_MASTERS, NR_DEVICES> ("bus");
 
+		/*
+		 * The clock runs at the XGMII rate, but only while the MAC
+		 * has register accesses, frames to send or frames to hand
+		 * back to the DMA.
+		 */
+		clk = new gated_clock("clk", sc_time(6400, SC_PS));
+		clk->add_busy(rst);
+		clk->add_busy(tx_axis_mac_tvalid);
+		clk->add_busy(rx_axis_mac_tvalid);
+		clk->add_busy([this]() {
+			/* Anything but idle control characters on the lanes.  */
+			return phy_txc.read() != sc_bv<8>(0xff) ||
+				phy_rxc.read() != sc_bv<8>(0xff);
+		});
+		apb_wake = new clock_wake_probe("apb-wake", clk);
+		tx_wake = new clock_wake_probe("tx-wake", clk);
+		rx_wake = new clock_wake_probe("rx-wake", clk);
+
 		tlm2apb_lmac = new tlm2apb_bridge<bool, sc_bv, 16, sc_bv, 32> ("tlm2apb-lmac-bridge");
+		apb_wake->init_socket.bind(tlm2apb_lmac->tgt_socket);
 		bus->memmap(BASE_ADDR + 0x30000ULL, 0x4000 - 1,
-				ADDRMODE_RELATIVE, -1, tlm2apb_lmac->tgt_socket);
+				ADDRMODE_RELATIVE, -1, apb_wake->tgt_socket);
 
 		bus->memmap(BASE_ADDR + 0x34000ULL, 0x100 - 1,
 				ADDRMODE_RELATIVE, -1, dma_mm2s_A.tgt_socket);
@@ -196,15 +253,20 @@ SC_MODULE(Top)
 		dma_mm2s_A.init_socket.bind(*(bus->t_sk[1]));
 		dma_s2mm_C.init_socket.bind(*(bus->t_sk[2]));
 
-		dma_mm2s_A.stream_socket.bind(tlm2axis.tgt_socket);
-		axis2tlm.socket.bind(dma_s2mm_C.stream_socket);
+		dma_mm2s_A.stream_socket.bind(tx_wake->tgt_socket);
+		tx_wake->init_socket.bind(tap_axis_tx.tgt_socket);
+		tap_axis_tx.init_socket.bind(tlm2axis.tgt_socket);
+		axis2tlm.socket.bind(tap_axis_rx.tgt_socket);
+		tap_axis_rx.init_socket.bind(dma_s2mm_C.stream_socket);
 
 		dma_mm2s_A.irq(zynq.pl2ps_irq[2]);
 		dma_s2mm_C.irq(zynq.pl2ps_irq[4]);
 
-		/* Slow clock to keep simulation fast.  */
-		clk = new sc_clock("clk", sc_time(10, SC_US));
+#ifdef LMAC_RTL_THREAD
+		lmac = new lmac_rtl_thread<Vlmac_wrapper_top, 64>("lmac");
+#else
 		lmac = new Vlmac_wrapper_top("lmac");
+#endif
 
 		tlm2axis.clk(*clk);
 		tlm2axis.resetn(rst_n);
@@ -257,8 +319,22 @@ SC_MODULE(Top)
 		phy.rx.xxd(phy_rxd);
 		phy.rx.xxc(phy_rxc);
 
-		zynq.user_master[0]->bind(phy.rx.tgt_socket);
-		phy.tx.init_socket.bind(*zynq.user_slave[0]);
+		if (eth) {
+			phy_gen = new eth_traffic_gen("phy-gen", *eth);
+			phy_sink = new eth_traffic_sink("phy-sink");
+			phy_gen->init_socket.bind(rx_wake->tgt_socket);
+			tap_phy_tx.init_socket.bind(phy_sink->tgt_socket);
+		} else if (switch_descr) {
+			sw_port = new eth_switch_port("switch-port", switch_descr);
+			sw_port->init_socket.bind(rx_wake->tgt_socket);
+			tap_phy_tx.init_socket.bind(sw_port->tgt_socket);
+		} else {
+			zynq.user_master[0]->bind(rx_wake->tgt_socket);
+			tap_phy_tx.init_socket.bind(*zynq.user_slave[0]);
+		}
+		rx_wake->init_socket.bind(tap_phy_rx.tgt_socket);
+		tap_phy_rx.init_socket.bind(phy.rx.tgt_socket);
+		phy.tx.init_socket.bind(tap_phy_tx.tgt_socket);
 
 		tlm2apb_lmac->clk(*clk);
 		tlm2apb_lmac->psel(apbsig_lmac_psel);
@@ -278,7 +354,16 @@ private:
 
 void usage(void)
 {
-	cout << "tlm socket-path sync-quantum-ns" << endl;
+	cout << "tlm socket-path sync-quantum-ns [eth=<spec>] "
+		"[capture=<file>[,key=value...]] "
+		"[switch=unix:<path>|shm:/<name>]" << endl;
+	cout << "  eth= sends frames into the PHY instead of QEMU" << endl;
+	cout << "  spec: key=value,... with keys pcap, loop, timed, mix, "
+		"rate, count, fcs, tag, drain, seed, stop" << endl;
+	cout << "  capture= writes the MAC's frames to a pcapng file, keys "
+		"snaplen, ethertype, min, max, every, ring" << endl;
+	cout << "  switch= links the PHY to a port of eth-switch instead "
+		"of QEMU" << endl;
 }
 
 int sc_main(int argc, char* argv[])
@@ -286,6 +371,12 @@ int sc_main(int argc, char* argv[])
 	Top *top;
 	uint64_t sync_quantum;
 	sc_trace_file *trace_fp = NULL;
+	eth_traffic_config eth_cfg;
+	eth_traffic_config *eth = NULL;
+	pcap_tap_config cap_cfg;
+	pcap_tap_config *capture = NULL;
+	const char *switch_descr = NULL;
+	int i;
 
 #if HAVE_VERILOG_VERILATOR
 	Verilated::commandArgs(argc, argv);
@@ -297,9 +388,40 @@ int sc_main(int argc, char* argv[])
 		sync_quantum = strtoull(argv[2], NULL, 10);
 	}
 
+	for (i = 3; i < argc; i++) {
+		if (argv[i][0] == '+') {
+			/* Verilator's plusargs.  */
+			continue;
+		} else if (strncmp(argv[i], "eth=", 4) == 0) {
+			if (!eth_cfg.parse(argv[i] + 4)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			eth = &eth_cfg;
+		} else if (strncmp(argv[i], "capture=", 8) == 0) {
+			if (!cap_cfg.parse(argv[i] + 8)) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			capture = &cap_cfg;
+		} else if (strncmp(argv[i], "switch=", 7) == 0) {
+			switch_descr = argv[i] + 7;
+		} else {
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* The PHY has one peer.  */
+	if (eth && switch_descr) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
 	sc_set_time_resolution(1, SC_PS);
 
-	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS));
+	top = new Top("top", argv[1], sc_time((double) sync_quantum, SC_NS),
+			eth, capture, switch_descr);
 
 	if (argc < 3) {
 		sc_start(1, SC_PS);
@@ -319,7 +441,9 @@ int sc_main(int argc, char* argv[])
 	const char* flag = Verilated::commandArgsPlusMatch("trace");
 	if (flag && 0 == strcmp(flag, "+trace")) {
 		tfp = new VerilatedVcdSc;
+#ifndef LMAC_RTL_THREAD
 		top->lmac->trace(tfp, 99);
+#endif
 		tfp->open("vlt_dump.vcd");
 	}
 #endif